@@ -29,13 +29,15 @@ LOCAL_C_INCLUDES += \
 
 
 LOCAL_SRC_FILES := gstamladec.c \
-	amlaudioinfo.c
+	amlaudioinfo.c \
+	amlapeparser.c \
+	amlpcmconv.c
 
 #LOCAL_STATIC_LIBRARIES +=
 LOCAL_SHARED_LIBRARIES += libamlstreaminfo
 
 LOCAL_LDFLAGS += -L$(gcv_sme_out_so_path) -L$(gcv_3rd_install_prefix)/lib \
-	-lgstreamer-1.0 -lgstaudio-1.0 -lglib-2.0 -lgobject-2.0 -lamplayer 
+	-lgstreamer-1.0 -lgstbase-1.0 -lgstaudio-1.0 -lglib-2.0 -lgobject-2.0 -lamplayer 
 #	-lsme_generic -lsme_mediautils \
 #	-lgstreamer-1.0 -lgstbase-1.0 -lglib-2.0 -lgobject-2.0 \
 #	-lgmodule-2.0 -lgio-2.0 -lgstvideo-1.0 -lgstapp-1.0
@@ -0,0 +1,477 @@
+/*
+ * amlapeparser.c
+ *
+ * Incremental APE parser, see amlapeparser.h.
+ *
+ * Layout, version 3980 and later: "MAC " descriptor, header, seek table,
+ * stored WAV header, frames. Older files put a single header first and
+ * the WAV header before the seek table. Versions before 3810 also carry
+ * a bit table and are not handled.
+ */
+
+#include <string.h>
+#include <gst/base/gstadapter.h>
+#include "amlapeparser.h"
+
+#define APE_MAGIC                   0x4D414320  /* "MAC " */
+#define APE_MIN_VERSION             3810
+#define APE_NEW_VERSION             3980
+#define APE_DESCRIPTOR_SIZE         52
+#define APE_HEADER_SIZE             24
+#define APE_OLD_HEADER_SIZE         32
+
+#define APE_FLAG_8_BIT              0x0001
+#define APE_FLAG_HAS_PEAK_LEVEL     0x0004
+#define APE_FLAG_24_BIT             0x0008
+#define APE_FLAG_HAS_SEEK_ELEMENTS  0x0010
+#define APE_FLAG_CREATE_WAV_HEADER  0x0020
+
+/* how far into the stream the descriptor may start, after junk */
+#define APE_SCAN_MAX                (64 * 1024)
+/* seek table entries, 4 bytes each */
+#define APE_FRAMES_MAX              (1 << 20)
+#define APE_CHANNELS_MAX            8
+
+typedef enum {
+    APE_STATE_HEADER,
+    APE_STATE_SEEKTABLE,
+    APE_STATE_FRAMES,
+    APE_STATE_LOST,             /* flushed, waiting for the seek's byte offset */
+    APE_STATE_DONE
+} AmlApeState;
+
+struct _AmlApeParser {
+    GstAdapter *adapter;
+    guint64 offset;             /* stream offset of the adapter's first byte */
+    AmlApeState state;
+    AmlApeInfo info;
+    guint32 junk;               /* bytes before the descriptor */
+    guint64 seektable;          /* stream offset of the seek table */
+    guint64 firstframe;
+    GArray *table;              /* guint32 frame offsets, without junk */
+    guint frame;                /* next to hand out */
+    gsize frame_max;            /* sanity bound of a frame's compressed size */
+    gboolean mapped;
+};
+
+static inline guint16 ape_rl16(const guint8 *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline guint32 ape_rl32(const guint8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+AmlApeParser *amlApeParserNew(void)
+{
+    AmlApeParser *parser = g_new0(AmlApeParser, 1);
+
+    parser->adapter = gst_adapter_new();
+    parser->table = g_array_new(FALSE, FALSE, sizeof(guint32));
+    return parser;
+}
+
+void amlApeParserFree(AmlApeParser *parser)
+{
+    if (!parser)
+        return;
+    amlApeParserReset(parser);
+    g_object_unref(parser->adapter);
+    g_array_free(parser->table, TRUE);
+    g_free(parser);
+}
+
+void amlApeParserReset(AmlApeParser *parser)
+{
+    if (parser->mapped) {
+        gst_adapter_unmap(parser->adapter);
+        parser->mapped = FALSE;
+    }
+    gst_adapter_clear(parser->adapter);
+    g_array_set_size(parser->table, 0);
+    memset(&parser->info, 0, sizeof(parser->info));
+    parser->offset = 0;
+    parser->state = APE_STATE_HEADER;
+    parser->frame = 0;
+}
+
+void amlApeParserPush(AmlApeParser *parser, GstBuffer *buf)
+{
+    gst_adapter_push(parser->adapter, buf);
+}
+
+const AmlApeInfo *amlApeParserGetInfo(AmlApeParser *parser)
+{
+    return &parser->info;
+}
+
+static void ape_skip(AmlApeParser *parser, gsize size)
+{
+    gst_adapter_flush(parser->adapter, size);
+    parser->offset += size;
+}
+
+/* header and whole seek table read */
+static gboolean ape_indexed(AmlApeParser *parser)
+{
+    return parser->info.totalframes && parser->table->len == parser->info.totalframes;
+}
+
+static guint64 ape_frame_pos(AmlApeParser *parser, guint index)
+{
+    if (index == 0)
+        return parser->firstframe;
+    return (guint64) g_array_index(parser->table, guint32, index) + parser->junk;
+}
+
+/* frames start on the 32-bit word holding their first bit */
+static guint32 ape_frame_skip(AmlApeParser *parser, guint index)
+{
+    return (ape_frame_pos(parser, index) - parser->firstframe) & 3;
+}
+
+static guint64 ape_frame_start(AmlApeParser *parser, guint index)
+{
+    return ape_frame_pos(parser, index) - ape_frame_skip(parser, index);
+}
+
+static GstClockTime ape_frame_pts(AmlApeParser *parser, guint index)
+{
+    return gst_util_uint64_scale((guint64) index * parser->info.blocksperframe,
+            GST_SECOND, parser->info.samplerate);
+}
+
+static AmlApeResult ape_parse_header(AmlApeParser *parser)
+{
+    AmlApeInfo *info = &parser->info;
+    gsize avail = gst_adapter_available(parser->adapter);
+    guint8 head[APE_DESCRIPTOR_SIZE + APE_OLD_HEADER_SIZE];
+    guint32 descriptorlength, headerlength, seektablelength, wavheaderlength;
+    guint64 bytes;
+    gssize magic;
+
+    magic = gst_adapter_masked_scan_uint32(parser->adapter, 0xffffffff, APE_MAGIC, 0, avail);
+    if (magic < 0) {
+        if (parser->offset + avail > APE_SCAN_MAX)
+            return AML_APE_ERROR;
+        /* keep the last 3 bytes, the magic may straddle buffers */
+        if (avail > 3)
+            ape_skip(parser, avail - 3);
+        return AML_APE_NEED_DATA;
+    }
+    if (magic > 0)
+        ape_skip(parser, magic);
+    avail -= magic;
+    parser->junk = parser->offset;
+
+    if (avail < 6)
+        return AML_APE_NEED_DATA;
+    gst_adapter_copy(parser->adapter, head, 0, 6);
+    info->fileversion = ape_rl16(head + 4);
+    if (info->fileversion < APE_MIN_VERSION) {
+        GST_WARNING("unsupported APE version %u", info->fileversion);
+        return AML_APE_ERROR;
+    }
+
+    if (info->fileversion >= APE_NEW_VERSION) {
+        if (avail < APE_DESCRIPTOR_SIZE)
+            return AML_APE_NEED_DATA;
+        gst_adapter_copy(parser->adapter, head, 0, APE_DESCRIPTOR_SIZE);
+        descriptorlength = ape_rl32(head + 8);
+        headerlength = ape_rl32(head + 12);
+        seektablelength = ape_rl32(head + 16);
+        wavheaderlength = ape_rl32(head + 20);
+        if (descriptorlength < APE_DESCRIPTOR_SIZE || descriptorlength > APE_SCAN_MAX
+                || headerlength < APE_HEADER_SIZE || headerlength > APE_SCAN_MAX)
+            return AML_APE_ERROR;
+        if (avail < descriptorlength + APE_HEADER_SIZE)
+            return AML_APE_NEED_DATA;
+        gst_adapter_copy(parser->adapter, head, descriptorlength, APE_HEADER_SIZE);
+        info->compressiontype = ape_rl16(head);
+        info->formatflags = ape_rl16(head + 2);
+        info->blocksperframe = ape_rl32(head + 4);
+        info->finalframeblocks = ape_rl32(head + 8);
+        info->totalframes = ape_rl32(head + 12);
+        info->bps = ape_rl16(head + 16);
+        info->channels = ape_rl16(head + 18);
+        info->samplerate = ape_rl32(head + 20);
+        parser->seektable = parser->junk + descriptorlength + headerlength;
+        parser->firstframe = parser->seektable + seektablelength + wavheaderlength;
+    } else {
+        if (avail < APE_OLD_HEADER_SIZE + 8)
+            return AML_APE_NEED_DATA;
+        gst_adapter_copy(parser->adapter, head, 0, APE_OLD_HEADER_SIZE + 8);
+        headerlength = APE_OLD_HEADER_SIZE;
+        info->compressiontype = ape_rl16(head + 6);
+        info->formatflags = ape_rl16(head + 8);
+        info->channels = ape_rl16(head + 10);
+        info->samplerate = ape_rl32(head + 12);
+        wavheaderlength = ape_rl32(head + 16);
+        info->totalframes = ape_rl32(head + 24);
+        info->finalframeblocks = ape_rl32(head + 28);
+        if (info->formatflags & APE_FLAG_HAS_PEAK_LEVEL)
+            headerlength += 4;
+        if (info->formatflags & APE_FLAG_HAS_SEEK_ELEMENTS) {
+            seektablelength = ape_rl32(head + headerlength) * 4;
+            headerlength += 4;
+        } else {
+            seektablelength = info->totalframes * 4;
+        }
+        if (info->formatflags & APE_FLAG_8_BIT)
+            info->bps = 8;
+        else if (info->formatflags & APE_FLAG_24_BIT)
+            info->bps = 24;
+        else
+            info->bps = 16;
+        if (info->fileversion >= 3950)
+            info->blocksperframe = 73728 * 4;
+        else if (info->fileversion >= 3900 || info->compressiontype >= 4000)
+            info->blocksperframe = 73728;
+        else
+            info->blocksperframe = 9216;
+        if (info->formatflags & APE_FLAG_CREATE_WAV_HEADER)
+            wavheaderlength = 0;
+        parser->seektable = parser->junk + headerlength + wavheaderlength;
+        parser->firstframe = parser->seektable + seektablelength;
+    }
+
+    if (!info->totalframes || info->totalframes > APE_FRAMES_MAX
+            || seektablelength / 4 < info->totalframes
+            || !info->blocksperframe || info->finalframeblocks > info->blocksperframe
+            || !info->channels || info->channels > APE_CHANNELS_MAX
+            || !info->samplerate
+            || (info->bps != 8 && info->bps != 16 && info->bps != 24)) {
+        GST_WARNING("invalid APE header: %u frames of %u blocks, %u channels, %u Hz, %u bits",
+                info->totalframes, info->blocksperframe, info->channels,
+                info->samplerate, info->bps);
+        return AML_APE_ERROR;
+    }
+    /* a frame never compresses to much more than its PCM */
+    bytes = (guint64) info->blocksperframe * info->channels * (info->bps / 8);
+    parser->frame_max = bytes * 2 + 4096;
+
+    GST_DEBUG("APE %u: %u frames of %u blocks, %u channels, %u Hz, %u bits, first frame at %"
+            G_GUINT64_FORMAT, info->fileversion, info->totalframes, info->blocksperframe,
+            info->channels, info->samplerate, info->bps, parser->firstframe);
+    parser->state = APE_STATE_SEEKTABLE;
+    return AML_APE_NEED_DATA;
+}
+
+/* entries are kept as they stream in, the rest of the table is skipped
+ * with the bytes before the first frame */
+static AmlApeResult ape_parse_seektable(AmlApeParser *parser)
+{
+    guint8 entry[4];
+    guint32 pos;
+    gsize avail;
+
+    if (parser->offset < parser->seektable) {
+        avail = gst_adapter_available(parser->adapter);
+        ape_skip(parser, MIN(avail, parser->seektable - parser->offset));
+        if (parser->offset < parser->seektable)
+            return AML_APE_NEED_DATA;
+    }
+    while (parser->table->len < parser->info.totalframes) {
+        if (gst_adapter_available(parser->adapter) < 4)
+            return AML_APE_NEED_DATA;
+        gst_adapter_copy(parser->adapter, entry, 0, 4);
+        ape_skip(parser, 4);
+        pos = ape_rl32(entry);
+        if (parser->table->len > 0
+                && pos <= g_array_index(parser->table, guint32, parser->table->len - 1)) {
+            GST_WARNING("APE seek table ends at frame %u of %u",
+                    parser->table->len, parser->info.totalframes);
+            parser->info.totalframes = parser->table->len;
+            parser->info.finalframeblocks = parser->info.blocksperframe;
+            break;
+        }
+        g_array_append_val(parser->table, pos);
+    }
+    parser->frame = 0;
+    parser->state = APE_STATE_FRAMES;
+    return AML_APE_HEADER;
+}
+
+static AmlApeResult ape_next_frame(AmlApeParser *parser, gboolean drain, AmlApeFrame *frame)
+{
+    gsize avail = gst_adapter_available(parser->adapter);
+    gboolean last;
+    guint64 start;
+    gsize size;
+
+    /* after a seek into the middle of a frame */
+    while (parser->frame < parser->info.totalframes
+            && ape_frame_start(parser, parser->frame) < parser->offset)
+        parser->frame++;
+    if (parser->frame >= parser->info.totalframes) {
+        parser->state = APE_STATE_DONE;
+        gst_adapter_clear(parser->adapter);
+        return AML_APE_NEED_DATA;
+    }
+
+    start = ape_frame_start(parser, parser->frame);
+    if (parser->offset < start) {
+        ape_skip(parser, MIN(avail, start - parser->offset));
+        if (parser->offset < start)
+            return AML_APE_NEED_DATA;
+        avail = gst_adapter_available(parser->adapter);
+    }
+
+    last = parser->frame == parser->info.totalframes - 1;
+    if (last) {
+        /* runs to the end of the stream, tags included */
+        if (avail >= parser->frame_max)
+            size = parser->frame_max;
+        else if (drain)
+            size = avail;
+        else
+            return AML_APE_NEED_DATA;
+        size &= ~3;
+        if (!size)
+            return AML_APE_NEED_DATA;
+    } else {
+        size = (ape_frame_pos(parser, parser->frame + 1) - start + 3) & ~3;
+        if (size > parser->frame_max) {
+            GST_WARNING("APE frame %u of %" G_GSIZE_FORMAT " bytes", parser->frame, size);
+            return AML_APE_ERROR;
+        }
+        if (avail < size)
+            return AML_APE_NEED_DATA;
+    }
+
+    frame->data = gst_adapter_map(parser->adapter, size);
+    if (!frame->data)
+        return AML_APE_ERROR;
+    parser->mapped = TRUE;
+    frame->size = size;
+    frame->blocks = last ? parser->info.finalframeblocks : parser->info.blocksperframe;
+    frame->skip = ape_frame_skip(parser, parser->frame);
+    frame->index = parser->frame;
+    frame->pts = ape_frame_pts(parser, parser->frame);
+    return AML_APE_FRAME;
+}
+
+AmlApeResult amlApeParserNext(AmlApeParser *parser, gboolean drain, AmlApeFrame *frame)
+{
+    AmlApeResult res;
+
+    g_return_val_if_fail(!parser->mapped, AML_APE_ERROR);
+    switch (parser->state) {
+    case APE_STATE_HEADER:
+        res = ape_parse_header(parser);
+        if (res != AML_APE_NEED_DATA || parser->state == APE_STATE_HEADER)
+            return res;
+        /* fall through */
+    case APE_STATE_SEEKTABLE:
+        return ape_parse_seektable(parser);
+    case APE_STATE_FRAMES:
+        return ape_next_frame(parser, drain, frame);
+    default:
+        gst_adapter_clear(parser->adapter);
+        return AML_APE_NEED_DATA;
+    }
+}
+
+/* consecutive frames share the word the next one starts in */
+void amlApeParserRelease(AmlApeParser *parser, AmlApeFrame *frame)
+{
+    guint64 next;
+
+    if (!parser->mapped)
+        return;
+    gst_adapter_unmap(parser->adapter);
+    parser->mapped = FALSE;
+    if (frame->index + 1 < parser->info.totalframes) {
+        next = ape_frame_start(parser, frame->index + 1);
+        ape_skip(parser, next - parser->offset);
+    } else {
+        ape_skip(parser, gst_adapter_available(parser->adapter));
+        parser->state = APE_STATE_DONE;
+    }
+    parser->frame = frame->index + 1;
+}
+
+/* the data after a flush is wherever the seek lands: the header is read
+ * again from the start, frames resume at amlApeParserSeek() */
+void amlApeParserFlush(AmlApeParser *parser)
+{
+    if (!ape_indexed(parser)) {
+        amlApeParserReset(parser);
+        return;
+    }
+    gst_adapter_clear(parser->adapter);
+    parser->state = APE_STATE_LOST;
+}
+
+/* upstream's byte segment starts at offset: the PTS of the first frame
+ * starting there or after, GST_CLOCK_TIME_NONE before the seek table is
+ * known, in which case only the start of the stream is of any use */
+GstClockTime amlApeParserSeek(AmlApeParser *parser, guint64 offset)
+{
+    guint lo, hi, mid;
+
+    if (!ape_indexed(parser)) {
+        amlApeParserReset(parser);
+        if (offset != 0)
+            parser->state = APE_STATE_LOST;
+        return GST_CLOCK_TIME_NONE;
+    }
+    gst_adapter_clear(parser->adapter);
+    parser->offset = offset;
+    lo = 0;
+    hi = parser->info.totalframes;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ape_frame_start(parser, mid) < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    parser->frame = lo;
+    parser->state = lo < parser->info.totalframes ? APE_STATE_FRAMES : APE_STATE_DONE;
+    return ape_frame_pts(parser, lo);
+}
+
+/* byte offset of the frame holding time, for a seek upstream */
+gboolean amlApeParserFrameOffset(AmlApeParser *parser, GstClockTime time, guint64 *offset)
+{
+    guint64 index;
+
+    if (!ape_indexed(parser) || !GST_CLOCK_TIME_IS_VALID(time))
+        return FALSE;
+    index = gst_util_uint64_scale(time, parser->info.samplerate, GST_SECOND)
+            / parser->info.blocksperframe;
+    index = MIN(index, parser->info.totalframes - 1);
+    *offset = ape_frame_start(parser, index);
+    return TRUE;
+}
+
+/* the byte after the frame holding time, -1 for the last frame as that
+ * runs to the end of the stream */
+gboolean amlApeParserFrameEnd(AmlApeParser *parser, GstClockTime time, guint64 *offset)
+{
+    guint64 index, start;
+
+    if (!ape_indexed(parser) || !GST_CLOCK_TIME_IS_VALID(time))
+        return FALSE;
+    index = gst_util_uint64_scale(time, parser->info.samplerate, GST_SECOND)
+            / parser->info.blocksperframe;
+    if (index >= parser->info.totalframes - 1) {
+        *offset = (guint64) -1;
+        return TRUE;
+    }
+    start = ape_frame_start(parser, index);
+    *offset = start + ((ape_frame_pos(parser, index + 1) - start + 3) & ~3);
+    return TRUE;
+}
+
+GstClockTime amlApeParserDuration(AmlApeParser *parser)
+{
+    if (!ape_indexed(parser))
+        return GST_CLOCK_TIME_NONE;
+    return gst_util_uint64_scale((guint64) (parser->info.totalframes - 1)
+            * parser->info.blocksperframe + parser->info.finalframeblocks,
+            GST_SECOND, parser->info.samplerate);
+}
@@ -0,0 +1,63 @@
+/*
+ * amlapeparser.h
+ *
+ * Monkey's Audio (APE) header, seek table and frame splitter for the
+ * byte stream amladec gets after typefind. The seek table is read entry
+ * by entry as it streams in; frames are handed out one at a time straight
+ * from the adapter, so at most one compressed frame is held whatever the
+ * file size. Frame positions, skips and sizes follow libavformat's ape
+ * demuxer, which the amadec APE decoder is ported with.
+ */
+
+#ifndef __AML_APE_PARSER_H__
+#define __AML_APE_PARSER_H__
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _AmlApeParser AmlApeParser;
+
+typedef struct {
+    guint16 fileversion;
+    guint16 compressiontype;
+    guint16 formatflags;
+    guint16 bps;
+    guint16 channels;
+    guint32 samplerate;
+    guint32 blocksperframe;
+    guint32 finalframeblocks;
+    guint32 totalframes;
+} AmlApeInfo;
+
+typedef struct {
+    const guint8 *data;         /* 4-byte aligned frame, valid until amlApeParserRelease() */
+    gsize size;
+    guint32 blocks;             /* samples per channel */
+    guint32 skip;               /* bytes of data before the frame's first bit */
+    guint index;
+    GstClockTime pts;
+} AmlApeFrame;
+
+typedef enum {
+    AML_APE_NEED_DATA,
+    AML_APE_HEADER,             /* header and seek table read, see amlApeParserGetInfo() */
+    AML_APE_FRAME,
+    AML_APE_ERROR
+} AmlApeResult;
+
+AmlApeParser *amlApeParserNew(void);
+void amlApeParserFree(AmlApeParser *parser);
+void amlApeParserReset(AmlApeParser *parser);
+void amlApeParserPush(AmlApeParser *parser, GstBuffer *buf);
+AmlApeResult amlApeParserNext(AmlApeParser *parser, gboolean drain, AmlApeFrame *frame);
+void amlApeParserRelease(AmlApeParser *parser, AmlApeFrame *frame);
+const AmlApeInfo *amlApeParserGetInfo(AmlApeParser *parser);
+void amlApeParserFlush(AmlApeParser *parser);
+GstClockTime amlApeParserSeek(AmlApeParser *parser, guint64 offset);
+gboolean amlApeParserFrameOffset(AmlApeParser *parser, GstClockTime time, guint64 *offset);
+gboolean amlApeParserFrameEnd(AmlApeParser *parser, GstClockTime time, guint64 *offset);
+GstClockTime amlApeParserDuration(AmlApeParser *parser);
+
+G_END_DECLS
+
+#endif
@@ -234,65 +234,29 @@ int extract_adts_header_info(AmlStreamInfo *info,codec_para_t *pcodec, GstBuffer
 	return 0;
 }
 
-gint adts_add_startcode(AmlStreamInfo* info, codec_para_t *pcodec, GstBuffer *buffer)
-{
-    gint8 *buf ;
-    int i;
-    int size = ADTS_HEADER_SIZE + gst_buffer_get_size(buffer);   // 13bit valid
-    size &= 0x1fff;
-    guint8 *adts_header=NULL;
-    GstBuffer *buffer1;
-    GstMapInfo map;
-    if (!info->configdata) {
-    	return 0;
-    }
-//Some aac es stream already has adts header,need check the first ADTS_HEADER_SIZE bytes
-    while (buffer&&gst_buffer_get_size(buffer)>=ADTS_HEADER_SIZE) {
-        buffer1 = gst_buffer_new_and_alloc(ADTS_HEADER_SIZE);
-        if (buffer1) {
-            gst_buffer_copy_into(buffer1, buffer, GST_BUFFER_COPY_DEEP, 0, ADTS_HEADER_SIZE);
-            gst_buffer_map(buffer1, &map, GST_MAP_READ);
-            adts_header=map.data;
-            //gst_buffer_unmap(buffer1, &map);
-
-            if (((adts_header[0] << 4) | (adts_header[1] & 0xF0) >> 4) != 0xFFF)                    //sync code
-                break;
-            if ((((*(adts_header + 3) & 0x2) << 11) | ((*(adts_header + 4) & 0xFF) << 3)
-                    | ((*(adts_header + 5) & 0xE0) >> 5)) != gst_buffer_get_size(buffer))           //frame length
-                break;
-        } else {
-            break;
-        }
-        GST_WARNING(" AAC es has adts header,don't add again");
-        gst_buffer_unmap(buffer1, &map);
-        if(adts_header){
-            gst_buffer_unref(buffer1);
-             buffer1=NULL;
-        }
-        return 0; //T
-    }
-
+gint adts_prefix(AmlStreamInfo* info, GstBuffer *buffer, guint8 *prefix)
+{
+    AmlAinfoMpeg *audio = (AmlAinfoMpeg *) info;
+    guint8 header[ADTS_HEADER_SIZE];
+    gsize size = gst_buffer_get_size(buffer);
+    int length = (ADTS_HEADER_SIZE + size) & 0x1fff;   // 13bit valid
 
-    if(adts_header){
-        gst_buffer_unmap(buffer1, &map);
-        gst_buffer_unref(buffer1);
-        buffer1=NULL;
+    if (!audio->has_adts) {
+        return 0;
     }
-
-    gst_buffer_map(info->configdata, &map, GST_MAP_WRITE);
-	buf = map.data;
-    if (buf!=NULL) {
-        buf[3] = (buf[3] & 0xfc) | (size >> 11);
-        buf[4] = (size >> 3) & 0xff;
-        buf[5] = (buf[5] & 0x1f) | ((size & 0x7) << 5);
-        if ( gst_buffer_get_size(info->configdata) == ADTS_HEADER_SIZE) {
-            amlCodecWrite(pcodec,buf,gst_buffer_get_size(info->configdata));
-	 // buffer = gst_buffer_merge(info->configdata,buffer);
-        }
+//Some aac es stream already has adts header,need check the first ADTS_HEADER_SIZE bytes
+    if (gst_buffer_extract(buffer, 0, header, ADTS_HEADER_SIZE) == ADTS_HEADER_SIZE
+            && ((header[0] << 4) | (header[1] & 0xF0) >> 4) == 0xFFF                            //sync code
+            && (((header[3] & 0x3) << 11) | (header[4] << 3) | (header[5] >> 5)) == size) {      //frame length
+        GST_LOG(" AAC es has adts header,don't add again");
+        return 0;
     }
-	gst_buffer_unmap(info->configdata, &map);
 
-    return 0;
+    memcpy(prefix, audio->adts, ADTS_HEADER_SIZE);
+    prefix[3] = (prefix[3] & 0xfc) | (length >> 11);
+    prefix[4] = (length >> 3) & 0xff;
+    prefix[5] = (prefix[5] & 0x1f) | ((length & 0x7) << 5);
+    return ADTS_HEADER_SIZE;
 }
 void * aac_finalize(AmlStreamInfo* info)
 {
@@ -320,8 +284,11 @@ gint amlInitAmpeg(AmlStreamInfo* info, codec_para_t *pcodec, GstStructure  *stru
 		amlAudioInfoInit(info, pcodec, structure);
 		audio->headerbuf = gst_buffer_new_and_alloc(ADTS_HEADER_SIZE);
 		extract_adts_header_info(info, pcodec, audio->headerbuf);
+		audio->has_adts = info->configdata
+				&& gst_buffer_extract(info->configdata, 0, audio->adts, ADTS_HEADER_SIZE) == ADTS_HEADER_SIZE
+				&& gst_buffer_get_size(info->configdata) == ADTS_HEADER_SIZE;
 		info->writeheader = NULL;
-		info->add_startcode = adts_add_startcode;
+		info->prefix = adts_prefix;
 		info->finalize = aac_finalize;
 		break;
 	default:
@@ -457,16 +424,15 @@ AmlStreamInfo * newAmlAinfoAlac()
 	return info;
 }
 
-gint vorbis_startcode(AmlStreamInfo* info, codec_para_t *pcodec, GstBuffer *buffer)
+gint vorbis_prefix(AmlStreamInfo* info, GstBuffer *buffer, guint8 *prefix)
 {
 	gint32 buf_size;
-    char head[] = "HEAD";
 
-    amlCodecWrite(pcodec, head, 4);
+    memcpy(prefix, "HEAD", 4);
     buf_size = gst_buffer_get_size(buffer);
-    amlCodecWrite(pcodec, &buf_size, 4);
+    memcpy(prefix + 4, &buf_size, 4);
 
-    return 0;
+    return 8;
 
 }
 gint amlInitVorbis(AmlStreamInfo* info, codec_para_t *pcodec, GstStructure  *structure)
@@ -482,7 +448,8 @@ AmlStreamInfo * newAmlAinfoVorbis()
 	AmlStreamInfo *info = createAudioInfo(sizeof(AmlAinfoVorbis));
 	info->init = amlInitVorbis;
 	info->writeheader = audio_writeheader;
-	info->add_startcode = vorbis_startcode;
+	info->add_startcode = NULL;
+	info->prefix = vorbis_prefix;
 	return info;
 }
 
@@ -564,17 +531,9 @@ AmlStreamInfo * newAmlAinfoWma()
 
 gint amlInitPcm(AmlStreamInfo* info, codec_para_t *pcodec, GstStructure  *structure)
 {
-    AmlAudioInfo *audio = AML_AUDIOINFO_BASE(info);
-	gchar * format;
-	gint  channels,rate;
-	format = gst_structure_get_string(structure, "format");
-	if (!strcmp(format, "S16LE")) {
-		pcodec->audio_type = AFORMAT_PCM_S16LE;
-		pcodec->audio_info.codec_id = CODEC_ID_PCM_S16LE;
-	} else {
-		GST_ERROR("%s", format);
-	}
-
+    /* amladec converts the other formats to S16LE before the write */
+    pcodec->audio_type = AFORMAT_PCM_S16LE;
+    pcodec->audio_info.codec_id = CODEC_ID_PCM_S16LE;
     pcodec->audio_info.valid = 1;
     amlAudioInfoInit(info,pcodec,structure);
     return 0;
@@ -590,22 +549,21 @@ AmlStreamInfo * newAmlAinfoPcm()
 
 gint amlInitLPcm(AmlStreamInfo* info, codec_para_t *pcodec, GstStructure  *structure)
 {
-    AmlAudioInfo *audio = AML_AUDIOINFO_BASE(info);
-    gint endianness,depth;
-    gboolean getsigned;
-    gst_structure_get_int (structure, "endianness", &endianness);
-    gst_structure_get_int (structure, "depth", &depth);
-    gst_structure_get_boolean (structure, "signed", &getsigned);
-    GST_WARNING("heredepth=%d", depth);
-    amlAudioInfoInit(info,pcodec,structure);
+    gint width = 16;
+    gst_structure_get_int(structure, "width", &width);
+    GST_INFO("lpcm width=%d", width);
+    /* big endian DVD samples, amladec keeps their upper 16 bits as S16LE */
+    pcodec->audio_type = AFORMAT_PCM_S16LE;
+    pcodec->audio_info.codec_id = CODEC_ID_PCM_S16LE;
     pcodec->audio_info.valid = 1;
+    amlAudioInfoInit(info,pcodec,structure);
     return 0;
 }
 
 AmlStreamInfo * newAmlAinfoLPcm()
 {
     AmlStreamInfo *info = createAudioInfo(sizeof(AmlAinfoPcm));
-    info->init = amlInitPcm;
+    info->init = amlInitLPcm;
     info->writeheader = NULL;
     info->add_startcode = NULL;
     return info;
@@ -624,7 +582,8 @@ AmlStreamInfo * newAmlAinfoApe()
 {
     AmlStreamInfo *info = createAudioInfo(sizeof(AmlAinfoApe));
     info->init = amlInitApe;
-    info->writeheader = NULL;
+    /* codec_data: the header amladec's APE parser read */
+    info->writeheader = audio_writeheader;
     info->add_startcode = NULL;
 
     return info;
@@ -0,0 +1,286 @@
+/*
+ * amlpcmconv.c
+ *
+ * PCM to S16LE conversion for amladec, see amlpcmconv.h.
+ *
+ * Integer formats only pick two bytes out of each sample, so one kernel
+ * serves all of them. NEON deinterleaves the bytes of 16 samples into
+ * planes with vld2/vld3/vld4 and stores the kept pair interleaved again.
+ * SSE2 has no three way deinterleave; 32 bit samples are shifted and
+ * packed, 24 bit ones are left to the scalar loop. Floats are truncated
+ * towards zero, the same on every path.
+ */
+
+#include <string.h>
+#include "amlpcmconv.h"
+
+#if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && G_BYTE_ORDER == G_LITTLE_ENDIAN
+#include <arm_neon.h>
+#define AML_PCM_NEON    1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AML_PCM_SSE2    1
+#endif
+
+static const struct {
+    const gchar *format;
+    AmlPcmKind kind;
+    guint8 width, lo, hi;
+} aml_pcm_formats[] = {
+    { "S16BE",      AML_PCM_INT,    2, 1, 0 },
+    { "S24LE",      AML_PCM_INT,    3, 1, 2 },
+    { "S24BE",      AML_PCM_INT,    3, 1, 0 },
+    { "S24_32LE",   AML_PCM_INT,    4, 1, 2 },
+    { "S24_32BE",   AML_PCM_INT,    4, 2, 1 },
+    { "S32LE",      AML_PCM_INT,    4, 2, 3 },
+    { "S32BE",      AML_PCM_INT,    4, 1, 0 },
+    { "F32LE",      AML_PCM_F32LE,  4, 0, 0 },
+    { "F32BE",      AML_PCM_F32BE,  4, 0, 0 },
+};
+
+#if AML_PCM_SSE2
+static inline __m128i aml_swap16(__m128i x)
+{
+    return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+#endif
+
+/* n samples of width bytes to S16LE */
+static void aml_pcm_pick(guint8 *d, const guint8 *s, gsize n, guint width, guint lo, guint hi)
+{
+    gsize i = 0;
+
+#if AML_PCM_NEON
+    uint8x16x2_t o;
+
+    switch (width) {
+    case 2:
+        /* S16BE and DVD LPCM, lo and hi are 1 and 0 */
+        for (; i + 16 <= n; i += 16) {
+            vst1q_u8(d + 2 * i, vrev16q_u8(vld1q_u8(s + 2 * i)));
+            vst1q_u8(d + 2 * i + 16, vrev16q_u8(vld1q_u8(s + 2 * i + 16)));
+        }
+        break;
+    case 3:
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x3_t v = vld3q_u8(s + 3 * i);
+
+            o.val[0] = v.val[lo];
+            o.val[1] = v.val[hi];
+            vst2q_u8(d + 2 * i, o);
+        }
+        break;
+    case 4:
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x4_t v = vld4q_u8(s + 4 * i);
+
+            o.val[0] = v.val[lo];
+            o.val[1] = v.val[hi];
+            vst2q_u8(d + 2 * i, o);
+        }
+        break;
+    }
+#elif AML_PCM_SSE2
+    if (width == 2) {
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128((__m128i *) (d + 2 * i),
+                    aml_swap16(_mm_loadu_si128((const __m128i *) (s + 2 * i))));
+    } else if (width == 4) {
+        /* the kept bytes are neighbours: shift them to the bottom of
+         * each word, sign extend so the pack does not saturate */
+        __m128i shift = _mm_cvtsi32_si128(MIN(lo, hi) * 8);
+
+        for (; i + 8 <= n; i += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (s + 4 * i));
+            __m128i b = _mm_loadu_si128((const __m128i *) (s + 4 * i + 16));
+            __m128i x;
+
+            a = _mm_srai_epi32(_mm_slli_epi32(_mm_srl_epi32(a, shift), 16), 16);
+            b = _mm_srai_epi32(_mm_slli_epi32(_mm_srl_epi32(b, shift), 16), 16);
+            x = _mm_packs_epi32(a, b);
+            if (hi < lo)
+                x = aml_swap16(x);
+            _mm_storeu_si128((__m128i *) (d + 2 * i), x);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        d[2 * i] = s[width * i + lo];
+        d[2 * i + 1] = s[width * i + hi];
+    }
+}
+
+/* n floats in [-1.0, 1.0) to S16LE, out of range values are clamped */
+static void aml_pcm_f32(guint8 *d, const guint8 *s, gsize n, gboolean be)
+{
+    gsize i = 0;
+
+#if AML_PCM_NEON
+    float32x4_t scale = vdupq_n_f32(32768.0f);
+    float32x4_t max = vdupq_n_f32(32767.0f);
+    float32x4_t min = vdupq_n_f32(-32768.0f);
+
+    for (; i + 8 <= n; i += 8) {
+        uint8x16_t a = vld1q_u8(s + 4 * i);
+        uint8x16_t b = vld1q_u8(s + 4 * i + 16);
+        float32x4_t fa, fb;
+
+        if (be) {
+            a = vrev32q_u8(a);
+            b = vrev32q_u8(b);
+        }
+        fa = vminq_f32(vmaxq_f32(vmulq_f32(vreinterpretq_f32_u8(a), scale), min), max);
+        fb = vminq_f32(vmaxq_f32(vmulq_f32(vreinterpretq_f32_u8(b), scale), min), max);
+        vst1q_u8(d + 2 * i, vreinterpretq_u8_s16(vcombine_s16(vmovn_s32(vcvtq_s32_f32(fa)),
+                vmovn_s32(vcvtq_s32_f32(fb)))));
+    }
+#elif AML_PCM_SSE2
+    __m128 scale = _mm_set1_ps(32768.0f);
+    __m128 max = _mm_set1_ps(32767.0f);
+    __m128 min = _mm_set1_ps(-32768.0f);
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (s + 4 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (s + 4 * i + 16));
+        __m128 fa, fb;
+
+        if (be) {
+            a = aml_swap16(a);
+            a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, _MM_SHUFFLE(2, 3, 0, 1)),
+                    _MM_SHUFFLE(2, 3, 0, 1));
+            b = aml_swap16(b);
+            b = _mm_shufflehi_epi16(_mm_shufflelo_epi16(b, _MM_SHUFFLE(2, 3, 0, 1)),
+                    _MM_SHUFFLE(2, 3, 0, 1));
+        }
+        fa = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_castsi128_ps(a), scale), min), max);
+        fb = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_castsi128_ps(b), scale), min), max);
+        _mm_storeu_si128((__m128i *) (d + 2 * i),
+                _mm_packs_epi32(_mm_cvttps_epi32(fa), _mm_cvttps_epi32(fb)));
+    }
+#endif
+    for (; i < n; i++) {
+        guint32 u;
+        gfloat f;
+        gint v;
+
+        memcpy(&u, s + 4 * i, 4);
+        u = be ? GUINT32_FROM_BE(u) : GUINT32_FROM_LE(u);
+        memcpy(&f, &u, 4);
+        f *= 32768.0f;
+        if (f >= 32767.0f)
+            v = 32767;
+        else if (f > -32768.0f)
+            v = (gint) f;
+        else
+            v = -32768;
+        d[2 * i] = v & 0xff;
+        d[2 * i + 1] = (v >> 8) & 0xff;
+    }
+}
+
+static void aml_pcm_units(AmlPcmConv *conv, guint8 *dst, const guint8 *src, gsize units)
+{
+    gsize i;
+
+    if (conv->kind != AML_PCM_INT) {
+        aml_pcm_f32(dst, src, units * conv->samples, conv->kind == AML_PCM_F32BE);
+    } else if (conv->unit == conv->samples * conv->width) {
+        aml_pcm_pick(dst, src, units * conv->samples, conv->width, conv->lo, conv->hi);
+    } else {
+        /* DVD groups end in the low bits, skipped */
+        for (i = 0; i < units; i++)
+            aml_pcm_pick(dst + i * conv->samples * 2, src + i * conv->unit, conv->samples,
+                    conv->width, conv->lo, conv->hi);
+    }
+}
+
+gboolean amlPcmConvInit(AmlPcmConv *conv, const GstStructure *structure)
+{
+    const gchar *format;
+    gint channels = 0, width = 16;
+    guint i;
+
+    memset(conv, 0, sizeof(*conv));
+    gst_structure_get_int(structure, "channels", &channels);
+    if (gst_structure_has_name(structure, "audio/x-raw")) {
+        format = gst_structure_get_string(structure, "format");
+        if (!format || !strcmp(format, "S16LE"))
+            return TRUE;
+        for (i = 0; i < G_N_ELEMENTS(aml_pcm_formats); i++) {
+            if (!strcmp(format, aml_pcm_formats[i].format))
+                break;
+        }
+        if (i == G_N_ELEMENTS(aml_pcm_formats) || channels < 1 || channels > AML_PCM_MAX_CHANNELS)
+            return FALSE;
+        conv->kind = aml_pcm_formats[i].kind;
+        conv->width = aml_pcm_formats[i].width;
+        conv->lo = aml_pcm_formats[i].lo;
+        conv->hi = aml_pcm_formats[i].hi;
+        conv->unit = conv->width * channels;
+        conv->samples = channels;
+    } else if (gst_structure_has_name(structure, "audio/x-lpcm")) {
+        gst_structure_get_int(structure, "width", &width);
+        if (channels < 1 || channels > AML_PCM_MAX_CHANNELS)
+            return FALSE;
+        /* the upper 16 bits of each sample come first, as S16BE */
+        conv->kind = AML_PCM_INT;
+        conv->width = 2;
+        conv->lo = 1;
+        conv->hi = 0;
+        switch (width) {
+        case 16:
+            conv->unit = 2 * channels;
+            conv->samples = channels;
+            break;
+        case 20:
+            conv->unit = 5 * channels;
+            conv->samples = 2 * channels;
+            break;
+        case 24:
+            conv->unit = 6 * channels;
+            conv->samples = 2 * channels;
+            break;
+        default:
+            return FALSE;
+        }
+    } else {
+        return TRUE;
+    }
+    conv->convert = TRUE;
+    return TRUE;
+}
+
+void amlPcmConvReset(AmlPcmConv *conv)
+{
+    conv->rest_size = 0;
+}
+
+gsize amlPcmConvOutSize(const AmlPcmConv *conv, gsize size)
+{
+    return (conv->rest_size + size) / conv->unit * conv->samples * 2;
+}
+
+gsize amlPcmConvert(AmlPcmConv *conv, guint8 *dst, const guint8 *src, gsize size)
+{
+    gsize n, units, out = 0;
+
+    if (conv->rest_size) {
+        n = MIN(conv->unit - conv->rest_size, size);
+        memcpy(conv->rest + conv->rest_size, src, n);
+        conv->rest_size += n;
+        src += n;
+        size -= n;
+        if (conv->rest_size < conv->unit)
+            return 0;
+        aml_pcm_units(conv, dst, conv->rest, 1);
+        out = conv->samples * 2;
+        dst += out;
+        conv->rest_size = 0;
+    }
+    units = size / conv->unit;
+    aml_pcm_units(conv, dst, src, units);
+    out += units * conv->samples * 2;
+    conv->rest_size = size - units * conv->unit;
+    memcpy(conv->rest, src + units * conv->unit, conv->rest_size);
+    return out;
+}
@@ -0,0 +1,50 @@
+/*
+ * amlpcmconv.h
+ *
+ * Conversion of the raw audio amladec accepts into interleaved S16LE,
+ * the one PCM layout the audio DSP is set up with. It is done in the copy
+ * into the buffer handed to codec_write: big endian samples are byte
+ * swapped, 24 and 32 bit integers keep their upper 16 bits and floats
+ * are scaled and clamped. DVD LPCM (audio/x-lpcm) is big endian, 20 and
+ * 24 bit streams carry two frames per group with the low bits of all
+ * samples at its end, those are dropped.
+ *
+ * Input may split a frame between buffers, the partial frame is kept
+ * until the next call.
+ */
+
+#ifndef __AML_PCM_CONV_H__
+#define __AML_PCM_CONV_H__
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define AML_PCM_MAX_CHANNELS    8
+/* bytes of the largest unit, a DVD 24 bit group */
+#define AML_PCM_UNIT_MAX        (6 * AML_PCM_MAX_CHANNELS)
+
+typedef enum {
+    AML_PCM_INT,                /* the two bytes lo, hi of each sample */
+    AML_PCM_F32LE,
+    AML_PCM_F32BE,
+} AmlPcmKind;
+
+typedef struct {
+    gboolean convert;           /* FALSE: the stream is written as it comes */
+    AmlPcmKind kind;
+    guint width;                /* bytes per sample */
+    guint lo, hi;               /* AML_PCM_INT: bytes of the sample kept */
+    guint unit;                 /* bytes converted as one: a frame, a DVD group */
+    guint samples;              /* samples written per unit */
+    guint8 rest[AML_PCM_UNIT_MAX];
+    guint rest_size;
+} AmlPcmConv;
+
+gboolean amlPcmConvInit(AmlPcmConv *conv, const GstStructure *structure);
+void amlPcmConvReset(AmlPcmConv *conv);
+gsize amlPcmConvOutSize(const AmlPcmConv *conv, gsize size);
+gsize amlPcmConvert(AmlPcmConv *conv, guint8 *dst, const guint8 *src, gsize size);
+
+G_END_DECLS
+
+#endif
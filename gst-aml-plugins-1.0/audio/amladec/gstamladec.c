@@ -74,9 +74,25 @@ enum
 {
   PROP_0,
   PROP_PASSTHROUGH,
-  PROP_SILENT
+  PROP_SILENT,
+  PROP_HW_STATS,
+  PROP_CAPTURE_LOCATION,
+  PROP_DUMP_SIZE,
+  PROP_DUMP_LOCATION,
+  PROP_TARGET_LATENCY,
+  PROP_LOW_POWER,
+  PROP_BATCH_DURATION
 };
 
+#define AML_TARGET_LATENCY_MAX	10000	/* ms */
+/* PTS span the ES bitrate is measured over */
+#define AML_RATE_SPAN	(2 * GST_SECOND)
+/* abuf waits before the bitrate is known, and bounds of the predicted ones */
+#define AML_ABUF_POLL	40000
+#define AML_ABUF_WAIT_MIN	2000
+#define AML_ABUF_WAIT_MAX	500000
+#define AML_BATCH_DURATION_MAX	5000	/* ms */
+
 #define COMMON_AUDIO_CAPS \
   "channels = (int) [ 1, MAX ], " \
   "rate = (int) [ 1, MAX ]"
@@ -118,11 +134,12 @@ static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink",
 	//		"audio/x-speex, "
 	//		COMMON_AUDIO_CAPS "; "
 			"audio/x-raw, "
-			"format = (string) { S16BE, S16LE}, "
+			"format = (string) { S16LE, S16BE, S24LE, S24BE, S24_32LE, S24_32BE, "
+			"S32LE, S32BE, F32LE, F32BE }, "
 			"layout = (string) interleaved, "
 			COMMON_AUDIO_CAPS ";"
 			"audio/x-lpcm, "
-//			"width = (int) { 16, 20, 24 }, "
+			"width = (int) { 16, 20, 24 }, "
 			COMMON_AUDIO_CAPS ";"
 	//		"audio/x-tta, "
 	//		"width = (int) { 8, 16, 24 }, "
@@ -161,6 +178,7 @@ static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
 
 static void 					gst_aml_adec_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
 static void 					gst_aml_adec_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
+static void 					gst_aml_adec_finalize (GObject * object);
 
 static gboolean 				gst_aml_adec_open(GstAudioDecoder * dec);
 static gboolean 				gst_aml_adec_close(GstAudioDecoder * dec);
@@ -172,14 +190,42 @@ static void 					gst_aml_adec_flush(GstAudioDecoder * dec, gboolean hard);
 
 static gboolean 				gst_set_astream_info(GstAmlAdec *amladec, GstCaps * caps);
 static gboolean					gst_amladec_sink_event  (GstAudioDecoder * dec, GstEvent * event);
+static gboolean					gst_aml_adec_src_event(GstAudioDecoder * dec, GstEvent * event);
 static gboolean 				aml_decode_init(GstAmlAdec *amladec);
 static GstFlowReturn 			gst_aml_adec_decode (GstAmlAdec *amladec, GstBuffer * buf);
+static GstFlowReturn			gst_aml_adec_decode_pcm(GstAmlAdec *amladec, GstBuffer *buf);
+static GstFlowReturn 			gst_aml_adec_batch_flush(GstAmlAdec *amladec);
+static void 					gst_aml_adec_batch_drop(GstAmlAdec *amladec);
+static GstFlowReturn 			gst_aml_adec_ape_write(GstAmlAdec *amladec, gboolean drain);
+static GstEvent *				gst_aml_adec_ape_segment(GstAmlAdec *amladec, GstEvent *event);
+static void 					gst_aml_adec_codec_close(GstAmlAdec *amladec);
+static gboolean 				gst_aml_adec_claim(GstAmlAdec *amladec);
+static void 					gst_aml_adec_unclaim(GstAmlAdec *amladec);
+static void 					gst_aml_adec_standby_clear(GstAmlAdec *amladec);
+static void 					gst_aml_adec_switch(GstAmlAdec *amladec, gpointer unused);
 static GstStateChangeReturn 	gst_aml_adec_change_state (GstElement * element, GstStateChange transition);
 
 struct AmlControl *amlcontrol = NULL;
 #define gst_aml_adec_parent_class parent_class
 G_DEFINE_TYPE (GstAmlAdec, gst_aml_adec, GST_TYPE_AUDIO_DECODER);
 
+/* elements may be created from several threads at once */
+static void
+aml_control_init(void)
+{
+	static gsize once = 0;
+	struct AmlControl *control;
+
+	if (g_once_init_enter(&once)) {
+		control = g_malloc0(sizeof(struct AmlControl));
+		g_mutex_init(&control->lock);
+		control->switch_pts = GST_CLOCK_TIME_NONE;
+		control->switcher = g_thread_pool_new((GFunc) gst_aml_adec_switch, NULL, 1, FALSE, NULL);
+		amlcontrol = control;
+		g_once_init_leave(&once, 1);
+	}
+}
+
 /* GObject vmethod implementations */
 
 /* initialize the amladec's class */
@@ -192,11 +238,42 @@ gst_aml_adec_class_init (GstAmlAdecClass * klass)
 
 	gobject_class->set_property = gst_aml_adec_set_property;
 	gobject_class->get_property = gst_aml_adec_get_property;
+	gobject_class->finalize = gst_aml_adec_finalize;
      element_class->change_state = GST_DEBUG_FUNCPTR (gst_aml_adec_change_state);
 	g_object_class_install_property(gobject_class, PROP_SILENT,
 			g_param_spec_boolean("silent", "Silent", "Produce verbose output ?", FALSE, G_PARAM_READWRITE));
-     g_object_class_install_property (gobject_class, PROP_PASSTHROUGH, g_param_spec_boolean ("pass-through", "Pass-through", "pass-through this track or not ?",
+     g_object_class_install_property (gobject_class, PROP_PASSTHROUGH, g_param_spec_boolean ("pass-through", "Pass-through",
+            "pass-through this track or not ? FALSE takes the hardware over from the playing track in the background, at its current PTS",
             FALSE, G_PARAM_READWRITE));
+	g_object_class_install_property(gobject_class, PROP_HW_STATS,
+			g_param_spec_boxed("hw-stats", "Hardware stats",
+					"abuf level, checked-in/current PTS and write stall time, sampled by the amlhw tracer",
+					GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_CAPTURE_LOCATION,
+			g_param_spec_string("capture-location", "Capture location",
+					"Record everything written to the decoder to this file for replay with amlesrc",
+					NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_DUMP_SIZE,
+			g_param_spec_uint("dump-size", "Dump size",
+					"Keep the last N MB written to the decoder in memory for dump-location, 0: off",
+					0, AML_DUMP_SIZE_MAX, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_DUMP_LOCATION,
+			g_param_spec_string("dump-location", "Dump location",
+					"Setting it writes the kept data to this file in the background, in the capture-location format",
+					NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_TARGET_LATENCY,
+			g_param_spec_uint("target-latency", "Target latency",
+					"Milliseconds of audio let into abuf ahead of the decoder, from the measured bitrate, 0: up to 80% of abuf",
+					0, AML_TARGET_LATENCY_MAX, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_LOW_POWER,
+			g_param_spec_boolean("low-power", "Low power",
+					"Write input in batches of batch-duration with one PTS check-in each, for audio only playback",
+					FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_BATCH_DURATION,
+			g_param_spec_uint("batch-duration", "Batch duration",
+					"Milliseconds of input written at once in low-power mode",
+					1, AML_BATCH_DURATION_MAX, AML_ADEC_BATCH_DURATION,
+					G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&sink_factory));
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&src_factory));
 
@@ -214,10 +291,21 @@ gst_aml_adec_class_init (GstAmlAdecClass * klass)
 	base_class->handle_frame = GST_DEBUG_FUNCPTR(gst_aml_adec_handle_frame);
 	base_class->flush = GST_DEBUG_FUNCPTR(gst_aml_adec_flush);
 	base_class->sink_event =  GST_DEBUG_FUNCPTR(gst_amladec_sink_event);
+	base_class->src_event = GST_DEBUG_FUNCPTR(gst_aml_adec_src_event);
 
 
 }
 
+/* abuf does not drain while paused, and the switcher releasing the codec
+ * waits for the stream lock: a blocked write gives up rather than hold it */
+static gboolean
+gst_aml_adec_write_cancelled(gpointer user_data)
+{
+	GstAmlAdec *amladec = user_data;
+
+	return amladec->is_paused || amladec->releasing;
+}
+
 /* initialize the new element
  * instantiate pads and add them to element
  * set pad calback functions
@@ -228,11 +316,14 @@ gst_aml_adec_init (GstAmlAdec * amladec)
 {
 	GstAudioDecoder *dec = GST_AUDIO_DECODER (amladec);
 	codec_audio_basic_init();
-	if (!amlcontrol) {
-		amlcontrol = g_malloc(sizeof(struct AmlControl));
-		memset(amlcontrol, 0, sizeof(struct AmlControl));
-		amlcontrol->passthrough = FALSE;
-	}
+	aml_control_init();
+	amlWaitInit(&amladec->wait);
+	amlWaitSetCancel(&amladec->wait, gst_aml_adec_write_cancelled, amladec);
+	amlWaitInit(&amladec->eos_wait);
+	g_mutex_init(&amladec->switch_lock);
+	g_mutex_init(&amladec->stats_lock);
+	g_queue_init(&amladec->standby);
+	amladec->batch_duration = AML_ADEC_BATCH_DURATION;
 }
 
 static void
@@ -246,16 +337,43 @@ gst_aml_adec_set_property (GObject * object, guint prop_id,
 		amladec->silent = g_value_get_boolean(value);
 		break;
 	case PROP_PASSTHROUGH:
+		/* codec_close/codec_init block for a while and race the streaming
+		 * threads, the switcher does them one request at a time */
+		GST_OBJECT_LOCK(amladec);
 		amladec->passthrough = g_value_get_boolean(value);
-		if (amladec->passthrough) {
-			if (amladec->codec_init_ok) {
-				amladec->codec_init_ok = 0;
-				codec_close(amladec->pcodec);
-			}
-			amlcontrol->passthrough = FALSE;
-		} else if (!amladec->codec_init_ok && !amladec->adecomit) {
-			aml_decode_init(amladec);
-		}
+		GST_OBJECT_UNLOCK(amladec);
+		g_thread_pool_push(amlcontrol->switcher, gst_object_ref(amladec), NULL);
+		break;
+	case PROP_CAPTURE_LOCATION:
+		GST_OBJECT_LOCK(amladec);
+		g_free(amladec->capture_location);
+		amladec->capture_location = g_value_dup_string(value);
+		GST_OBJECT_UNLOCK(amladec);
+		break;
+	case PROP_DUMP_SIZE:
+		GST_OBJECT_LOCK(amladec);
+		amladec->dump_size = g_value_get_uint(value);
+		GST_OBJECT_UNLOCK(amladec);
+		break;
+	case PROP_DUMP_LOCATION:
+		GST_OBJECT_LOCK(amladec);
+		g_free(amladec->dump_location);
+		amladec->dump_location = g_value_dup_string(value);
+		/* the ring only exists while the decoder is open */
+		if (amladec->dump_location)
+			amlEsCaptureDump(amladec->capture, amladec->dump_location);
+		GST_OBJECT_UNLOCK(amladec);
+		break;
+	case PROP_TARGET_LATENCY:
+		amladec->target_latency = g_value_get_uint(value);
+		/* a sleeper re-checks against the new watermark */
+		amlWaitWake(&amladec->wait);
+		break;
+	case PROP_LOW_POWER:
+		amladec->low_power = g_value_get_boolean(value);
+		break;
+	case PROP_BATCH_DURATION:
+		amladec->batch_duration = g_value_get_uint(value);
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -263,6 +381,65 @@ gst_aml_adec_set_property (GObject * object, guint prop_id,
 	}
 }
 
+static void
+gst_aml_adec_finalize (GObject * object)
+{
+	GstAmlAdec *amladec = GST_AMLADEC(object);
+
+	g_free(amladec->capture_location);
+	g_free(amladec->dump_location);
+	amlWaitClear(&amladec->wait);
+	amlWaitClear(&amladec->eos_wait);
+	g_mutex_clear(&amladec->switch_lock);
+	g_mutex_clear(&amladec->stats_lock);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* any thread, the tracer polls it from the system clock's */
+static GstStructure *
+gst_aml_adec_get_hw_stats (GstAmlAdec *amladec)
+{
+	struct buf_status abuf;
+	guint data_len = 0, size = 0;
+	guint64 checkin_pts = 0, current_pts = 0;
+	GstStructure *stats;
+
+	g_mutex_lock(&amladec->stats_lock);
+	if (amladec->pcodec && amladec->codec_init_ok) {
+		if (codec_get_abuf_state(amladec->pcodec, &abuf) == 0) {
+			data_len = abuf.data_len;
+			size = abuf.size;
+		}
+		current_pts = codec_get_apts(amladec->pcodec);
+		if (amladec->last_checkin_pts != -1L)
+			checkin_pts = amladec->last_checkin_pts;
+	}
+
+	stats = gst_structure_new("amlhw-stats",
+			"stream", G_TYPE_STRING, "audio",
+			"buf-data-len", G_TYPE_UINT, data_len,
+			"buf-size", G_TYPE_UINT, size,
+			"checkin-pts", G_TYPE_UINT64, checkin_pts,
+			"current-pts", G_TYPE_UINT64, current_pts,
+			"stall-time", G_TYPE_UINT64, amladec->stall_time,
+			"byte-rate", G_TYPE_UINT64, amladec->byte_rate,
+			"wakeups", G_TYPE_UINT, (guint) g_atomic_int_get(&amladec->wakeups),
+			"switches", G_TYPE_UINT, amladec->switches,
+			"switch-time", G_TYPE_UINT64, amladec->switch_time,
+			"switch-gap", G_TYPE_INT64, amladec->switch_gap,
+			NULL);
+	g_mutex_unlock(&amladec->stats_lock);
+	return stats;
+}
+
+static void
+gst_aml_adec_add_stall (GstAmlAdec *amladec, gint64 usec)
+{
+	g_mutex_lock(&amladec->stats_lock);
+	amladec->stall_time += usec * GST_USECOND;
+	g_mutex_unlock(&amladec->stats_lock);
+}
+
 static void
 gst_aml_adec_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
@@ -275,7 +452,43 @@ gst_aml_adec_get_property (GObject * object, guint prop_id,
 		break;
 
 	case PROP_PASSTHROUGH:
+		GST_OBJECT_LOCK(amladec);
 		g_value_set_boolean(value, amladec->passthrough);
+		GST_OBJECT_UNLOCK(amladec);
+		break;
+
+	case PROP_HW_STATS:
+		g_value_take_boxed(value, gst_aml_adec_get_hw_stats(amladec));
+		break;
+
+	case PROP_CAPTURE_LOCATION:
+		GST_OBJECT_LOCK(amladec);
+		g_value_set_string(value, amladec->capture_location);
+		GST_OBJECT_UNLOCK(amladec);
+		break;
+
+	case PROP_DUMP_SIZE:
+		GST_OBJECT_LOCK(amladec);
+		g_value_set_uint(value, amladec->dump_size);
+		GST_OBJECT_UNLOCK(amladec);
+		break;
+
+	case PROP_DUMP_LOCATION:
+		GST_OBJECT_LOCK(amladec);
+		g_value_set_string(value, amladec->dump_location);
+		GST_OBJECT_UNLOCK(amladec);
+		break;
+
+	case PROP_TARGET_LATENCY:
+		g_value_set_uint(value, amladec->target_latency);
+		break;
+
+	case PROP_LOW_POWER:
+		g_value_set_boolean(value, amladec->low_power);
+		break;
+
+	case PROP_BATCH_DURATION:
+		g_value_set_uint(value, amladec->batch_duration);
 		break;
 
 	default:
@@ -288,11 +501,16 @@ static gboolean
 gst_aml_adec_open(GstAudioDecoder * dec)
 {
 	GstAmlAdec *amladec = GST_AMLADEC(dec);
+	codec_para_t *pcodec;
 
 	amladec->silent = FALSE;
-	amladec->pcodec = g_malloc(sizeof(codec_para_t));
-	memset(amladec->pcodec, 0, sizeof(codec_para_t));
-	amladec->pcodec->adec_priv = NULL;
+	pcodec = g_malloc(sizeof(codec_para_t));
+	memset(pcodec, 0, sizeof(codec_para_t));
+	pcodec->adec_priv = NULL;
+	amlCodecSetWait(pcodec, &amladec->wait);
+	g_mutex_lock(&amladec->stats_lock);
+	amladec->pcodec = pcodec;
+	g_mutex_unlock(&amladec->stats_lock);
 
 	set_tsync_enable(0);
 	set_tsync_mode(TSYNC_MODE_PCRSCR);
@@ -307,7 +525,15 @@ gst_amladec_polling_eos (GstAmlAdec *amladec)
 	static int stop_count = 5;
 	static int delay = 0;
 	unsigned long pts;
-	usleep(1000 * 100);
+	/* before EOS only the start delay is tracked, low-power does that
+	 * once per batch; stop_eos_task cuts the sleep short */
+	if (amladec->low_power && !amladec->is_eos) {
+		if (!amlWaitSleep(&amladec->eos_wait, amladec->batch_duration * 1000LL))
+			return;
+	} else {
+		usleep(1000 * 100);
+	}
+	g_atomic_int_inc(&amladec->wakeups);
 	pts = codec_get_apts(amladec->pcodec);
 	if (amladec->last_checkin_pts != -1L && pts != -1L && pts != 1) {
 		if (last_pts != pts) {
@@ -338,6 +564,7 @@ start_eos_task (GstAmlAdec *amladec)
 			(GstTaskFunction) gst_amladec_polling_eos, amladec, NULL);
 		gst_task_set_lock(amladec->eos_task, &amladec->eos_lock);
 	}
+	amlWaitSetFlushing(&amladec->eos_wait, FALSE);
 	gst_task_start(amladec->eos_task);
 }
 
@@ -347,6 +574,8 @@ stop_eos_task (GstAmlAdec *amladec)
 	if (!amladec->eos_task)
 		return;
 	gst_task_stop(amladec->eos_task);
+	/* after the stop, so a low-power sleep that starts late returns at once */
+	amlWaitSetFlushing(&amladec->eos_wait, TRUE);
 	gst_task_join(amladec->eos_task);
 	gst_object_unref(amladec->eos_task);
 	amladec->eos_task = NULL;
@@ -382,34 +611,41 @@ static gboolean
 gst_aml_adec_close(GstAudioDecoder * dec)
 {
 	GstAmlAdec *amladec = GST_AMLADEC(dec);
-	gint ret = -1 ;
+
+	/* the switcher thread may be releasing or opening this codec */
+	g_mutex_lock(&amladec->switch_lock);
 	stop_eos_task (amladec);
-	if (amladec->codec_init_ok) {
-		amladec->codec_init_ok = 0;
-		if (amladec->is_paused == TRUE) {
-			ret = codec_resume(amladec->pcodec);
-			if (ret != 0) {
-				GST_ERROR_OBJECT(amladec, "resume failed!ret=%d", ret);
-			} else {
-				amladec->is_paused = FALSE;
-			}
-		}
-		codec_close(amladec->pcodec);
-	}
+	GST_AUDIO_DECODER_STREAM_LOCK(amladec);
+	gst_aml_adec_codec_close(amladec);
 
 	if (amladec->info) {
 		amladec->info->finalize(amladec->info);
 		amladec->info = NULL;
 	}
 	if (amladec->pcodec) {
+		amlCodecSetWait(amladec->pcodec, NULL);
+		g_mutex_lock(&amladec->stats_lock);
 		g_free(amladec->pcodec);
 		amladec->pcodec = NULL;
+		g_mutex_unlock(&amladec->stats_lock);
 	}
 
-	if (amlcontrol) {
-		g_free(amlcontrol);
-		amlcontrol = NULL;
+	gst_caps_replace(&amladec->capture_caps, NULL);
+	gst_aml_adec_batch_drop(amladec);
+	amlApeParserFree(amladec->apeparser);
+	amladec->apeparser = NULL;
+	if (amladec->pcm_buf) {
+		gst_buffer_unref(amladec->pcm_buf);
+		amladec->pcm_buf = NULL;
 	}
+	if (amladec->token) {
+		gst_memory_unref(amladec->token);
+		amladec->token = NULL;
+	}
+	gst_aml_adec_standby_clear(amladec);
+	GST_AUDIO_DECODER_STREAM_UNLOCK(amladec);
+	g_mutex_unlock(&amladec->switch_lock);
+	gst_aml_adec_unclaim(amladec);
 	GST_DEBUG_OBJECT(amladec, "close done");
 	return TRUE;
 }
@@ -442,12 +678,17 @@ gst_aml_adec_start(GstAudioDecoder * dec)
 	amladec->codec_init_ok = 0;
 //	amladec->passthrough = 1;
 //	amladec->bpass = TRUE;
-//	amladec->apeparser->ape_head.bhead = FALSE;
-//	amladec->apeparser->accusize = 0;
-//	amladec->apeparser->currentframe = 0;
 	amladec->is_ape = FALSE;
 	amladec->eos_task = NULL;
+	g_mutex_lock(&amladec->stats_lock);
 	amladec->last_checkin_pts = -1L;
+	amladec->stall_time = 0;
+	amladec->byte_rate = 0;
+	g_mutex_unlock(&amladec->stats_lock);
+	amladec->rate_start = GST_CLOCK_TIME_NONE;
+	amladec->rate_bytes = 0;
+	amladec->frame_size = 0;
+	amladec->replay = FALSE;
 //	amlcontrol->adecnumber++;
 	amladec->adecomit = FALSE;
 	amladec->segment.rate = 1.0;
@@ -471,14 +712,32 @@ gst_aml_adec_stop(GstAudioDecoder * dec)
 	return ret;
 }
 
-static gboolean
-gst_aml_adec_set_format(GstAudioDecoder *dec, GstCaps *caps)
+/* amlasink plays nothing, finish_frame only needs something to carry the
+ * timestamps: every frame shares one silent read-only block instead of
+ * allocating its own */
+static void
+gst_aml_adec_token_alloc(GstAmlAdec *amladec, gsize size)
+{
+	GstMapInfo map;
+
+	if (amladec->token && gst_memory_get_sizes(amladec->token, NULL, NULL) == size)
+		return;
+	if (amladec->token)
+		gst_memory_unref(amladec->token);
+	amladec->token = gst_allocator_alloc(NULL, size, NULL);
+	if (gst_memory_map(amladec->token, &map, GST_MAP_WRITE)) {
+		memset(map.data, 0, map.size);
+		gst_memory_unmap(amladec->token, &map);
+	}
+	GST_MINI_OBJECT_FLAG_SET(amladec->token, GST_MEMORY_FLAG_READONLY);
+}
+
+/* once the stream's rate and channels are known */
+static void
+gst_aml_adec_set_output_format(GstAmlAdec *amladec)
 {
-	gboolean ret = TRUE;
-	GstStructure *structure;
-	GstAmlAdec *amladec = GST_AMLADEC(dec);
-	const char *name;
 	GstAudioInfo gstinfo;
+	gint channels = amladec->pcodec->audio_info.channels;
 	const GstAudioChannelPosition chan_pos[][8] = {
 	  {                             /* Mono */
 	      GST_AUDIO_CHANNEL_POSITION_MONO},
@@ -530,23 +789,49 @@ gst_aml_adec_set_format(GstAudioDecoder *dec, GstCaps *caps)
 	        GST_AUDIO_CHANNEL_POSITION_SIDE_RIGHT,
 	      },
 	};
+
+	if (channels <= 0)
+		return;
+	gst_audio_info_init(&gstinfo);
+	gst_audio_info_set_format(&gstinfo, GST_AUDIO_FORMAT_S32,
+			amladec->pcodec->audio_info.sample_rate, channels,
+			channels <= 8 ? chan_pos[channels - 1] : NULL);
+	gst_audio_decoder_set_output_format(GST_AUDIO_DECODER(amladec), &gstinfo);
+	gst_aml_adec_token_alloc(amladec, GST_AUDIO_INFO_BPF(&gstinfo) * 2);
+}
+
+static gboolean
+gst_aml_adec_set_format(GstAudioDecoder *dec, GstCaps *caps)
+{
+	gboolean ret = TRUE;
+	GstStructure *structure;
+	GstAmlAdec *amladec = GST_AMLADEC(dec);
+	const char *name;
 	g_return_val_if_fail(caps != NULL, FALSE);
 
 	structure = gst_caps_get_structure(caps, 0);
 	name = gst_structure_get_name(structure);
 	GST_INFO_OBJECT(amladec, "format = %s",  name);
-	if (gst_structure_has_name(structure, "application/x-ape")) {
+	amladec->replay = gst_structure_has_field(structure, "aml-es-replay");
+	gst_caps_replace(&amladec->capture_caps, caps);
+	/* the codec is set up once the parser has read the APE header;
+	 * replayed captures carry it in their caps */
+	if (gst_structure_has_name(structure, "application/x-ape") && !amladec->replay) {
 		amladec->is_ape = TRUE;
-//		amladec->apeparser->ape_head.bhead = TRUE;
-	} else {
-		ret = gst_set_astream_info(amladec, caps);
+		if (!amladec->apeparser)
+			amladec->apeparser = amlApeParserNew();
+		amlApeParserReset(amladec->apeparser);
+		return TRUE;
 	}
-	gst_audio_info_init(&gstinfo);
-	gst_audio_info_set_format(&gstinfo, GST_AUDIO_FORMAT_S32,
-			amladec->pcodec->audio_info.sample_rate,
-			amladec->pcodec->audio_info.channels,
-			chan_pos[amladec->pcodec->audio_info.channels - 1]);
-	gst_audio_decoder_set_output_format(GST_AUDIO_DECODER(amladec), &gstinfo);
+	/* replayed captures hold what was written, already S16LE */
+	if (amladec->replay) {
+		amladec->pcm.convert = FALSE;
+	} else if (!amlPcmConvInit(&amladec->pcm, structure)) {
+		GST_ERROR_OBJECT(amladec, "unsupported PCM caps %" GST_PTR_FORMAT, caps);
+		return FALSE;
+	}
+	ret = gst_set_astream_info(amladec, caps);
+	gst_aml_adec_set_output_format(amladec);
 
 	return ret;
 }
@@ -558,14 +843,31 @@ gst_aml_adec_handle_frame(GstAudioDecoder * dec, GstBuffer * buffer)
 	GstAmlAdec *amladec = GST_AMLADEC(dec);
 	GstBuffer *outbuffer;
 
-	if (G_UNLIKELY(!buffer))
-		return GST_FLOW_OK;
+	/* drain */
+	if (G_UNLIKELY(!buffer)) {
+		if (amladec->is_ape) {
+			ret = gst_aml_adec_ape_write(amladec, TRUE);
+			if (ret != GST_FLOW_OK)
+				return ret;
+		}
+		return gst_aml_adec_batch_flush(amladec);
+	}
 
 	if (amladec->silent == FALSE) {
-		gst_aml_adec_decode(amladec, buffer);
+		if (amladec->pcm.convert)
+			ret = gst_aml_adec_decode_pcm(amladec, buffer);
+		else
+			ret = gst_aml_adec_decode(amladec, buffer);
+		if (ret == GST_FLOW_FLUSHING)
+			return ret;
 	}
 	//return gst_pad_push (amladec->src_factory, buffer);
-	outbuffer = gst_buffer_new_and_alloc(8 * amladec->pcodec->audio_info.channels);
+	/* nothing to stamp until the output format is known, APE header */
+	outbuffer = NULL;
+	if (amladec->token) {
+		outbuffer = gst_buffer_new();
+		gst_buffer_append_memory(outbuffer, gst_memory_ref(amladec->token));
+	}
 	ret = gst_audio_decoder_finish_frame(dec, outbuffer, 1);
 	return ret;
 }
@@ -579,12 +881,24 @@ gst_amladec_sink_event  (GstAudioDecoder * dec, GstEvent * event)
 			GST_EVENT_TYPE_NAME(event));
 	switch (GST_EVENT_TYPE(event)) {
 	case GST_EVENT_SEGMENT: {
+		if (amladec->is_ape)
+			event = gst_aml_adec_ape_segment(amladec, event);
 		gst_event_copy_segment(event, &amladec->segment);
 		GST_INFO_OBJECT(amladec, "rat = %f\n", amladec->segment.rate);
 		ret = GST_AUDIO_DECODER_CLASS (parent_class)->sink_event(amladec,
 				event);
 		break;
 	}
+	/* FLUSH_START is not serialized, it arrives while the streaming
+	 * thread may be sleeping on a full abuf */
+	case GST_EVENT_FLUSH_START:
+		amlWaitSetFlushing(&amladec->wait, TRUE);
+		ret = GST_AUDIO_DECODER_CLASS(parent_class)->sink_event(amladec, event);
+		break;
+	case GST_EVENT_FLUSH_STOP:
+		amlWaitSetFlushing(&amladec->wait, FALSE);
+		ret = GST_AUDIO_DECODER_CLASS(parent_class)->sink_event(amladec, event);
+		break;
 #if 0
 	case GST_EVENT_FLUSH_START:
 		if (amladec->codec_init_ok) {
@@ -611,7 +925,12 @@ gst_amladec_sink_event  (GstAudioDecoder * dec, GstEvent * event)
 		GST_WARNING("get GST_EVENT_EOS,check for audio end\n");
 		if (amladec->codec_init_ok) {
 			ret = FALSE;
+			if (amladec->is_ape)
+				gst_aml_adec_ape_write(amladec, TRUE);
+			gst_aml_adec_batch_flush(amladec);
 			amladec->is_eos = TRUE;
+			/* low-power EOS polling may be mid sleep */
+			amlWaitWake(&amladec->eos_wait);
 		} else {
 			ret = GST_AUDIO_DECODER_CLASS(parent_class)->sink_event(amladec,
 					event);
@@ -654,6 +973,15 @@ gst_aml_adec_change_state (GstElement * element, GstStateChange transition)
 		}
 		break;
 
+	case GST_STATE_CHANGE_READY_TO_PAUSED:
+		amlWaitSetFlushing(&amladec->wait, FALSE);
+		break;
+
+	/* the sink pad deactivation below waits for the streaming thread */
+	case GST_STATE_CHANGE_PAUSED_TO_READY:
+		amlWaitSetFlushing(&amladec->wait, TRUE);
+		break;
+
 	default:
 		break;
 	}
@@ -669,6 +997,8 @@ gst_aml_adec_change_state (GstElement * element, GstStateChange transition)
 				GST_ERROR_OBJECT(amladec, "pause failed!ret=%d", ret);
 			} else {
 				amladec->is_paused = TRUE;
+				amlWaitWake(&amladec->wait);
+				amlWaitWake(&amladec->eos_wait);
 			}
 		}
 		break;
@@ -693,8 +1023,17 @@ gst_aml_adec_flush(GstAudioDecoder * dec, gboolean hard)
 {
 	int ret;
 	GstAmlAdec *amladec = GST_AMLADEC(dec);
+	if (hard) {
+		gst_aml_adec_batch_drop(amladec);
+		gst_aml_adec_standby_clear(amladec);
+	}
+	if (hard && amladec->is_ape)
+		amlApeParserFlush(amladec->apeparser);
+	if (hard && amladec->pcm.convert)
+		amlPcmConvReset(&amladec->pcm);
+	/* a switch away from this decoder is stopping its EOS task */
 	if (hard && amladec->codec_init_ok && !amladec->is_paused
-			&& amladec->segment.rate > 0.0) {
+			&& !amladec->releasing && amladec->segment.rate > 0.0) {
 		gst_task_pause(amladec->eos_task);
 		ret = codec_reset(amladec->pcodec);
 		if (ret < 0) {
@@ -702,8 +1041,13 @@ gst_aml_adec_flush(GstAudioDecoder * dec, gboolean hard)
 		} else {
 			amladec->is_headerfeed = FALSE;
 		}
+		amlEsCaptureFlush(amladec->capture);
 		amladec->is_eos = FALSE;
+		g_mutex_lock(&amladec->stats_lock);
 		amladec->last_checkin_pts = -1L;
+		g_mutex_unlock(&amladec->stats_lock);
+		/* the span restarts, the bitrate is still the stream's */
+		amladec->rate_start = GST_CLOCK_TIME_NONE;
 		gst_task_start(amladec->eos_task);
 	}
 }
@@ -725,21 +1069,20 @@ gst_set_astream_info(GstAmlAdec *amladec, GstCaps * caps)
 		GST_ERROR("unsupport audio format name=%s", name);
 		return FALSE;
 	}
+	/* the APE header is read again after a flush that lost the stream */
+	if (amladec->info)
+		amladec->info->finalize(amladec->info);
 	amladec->info = info;
 	info->init(info, amladec->pcodec, structure);
 	if (amladec->pcodec
 			&& amladec->pcodec->stream_type == STREAM_TYPE_ES_AUDIO) {
 		if (info->writeheader)
 			info->writeheader(info, amladec->pcodec);
-		GST_DEBUG_OBJECT(amladec, "passthrough=%d\n",
-				amlcontrol->passthrough);
-		if (!amladec->codec_init_ok && !amlcontrol->passthrough
-				&& !amladec->adecomit) {
-			amlcontrol->passthrough = TRUE;
-			GST_DEBUG_OBJECT(amladec, "passthrough=%d\n",
-					amlcontrol->passthrough);
+		/* the first track to get here takes the hardware */
+		if (!amladec->codec_init_ok && !amladec->adecomit && !amladec->passthrough
+				&& gst_aml_adec_claim(amladec)) {
 			if (!aml_decode_init(amladec)) {
-				amlcontrol->passthrough = FALSE;
+				gst_aml_adec_unclaim(amladec);
 				return FALSE;
 			}
 		}
@@ -754,7 +1097,6 @@ aml_decode_init(GstAmlAdec *amladec)
 	int ret;
 	int tsync_mode;
 	//amladec->pcodec->abuf_size =  0xc0000;
-	GST_DEBUG_OBJECT(amladec, "passthrough=%d\n", amlcontrol->passthrough);
 	ret = codec_init(amladec->pcodec);
 	if (ret != CODEC_ERROR_NONE) {
 		GST_ERROR_OBJECT(amladec, "codec init failed, ret=-0x%x", -ret);
@@ -767,13 +1109,675 @@ aml_decode_init(GstAmlAdec *amladec)
 	}
 	set_tsync_mode(TSYNC_MODE_AUDIO);
 
+	g_mutex_lock(&amladec->stats_lock);
 	amladec->codec_init_ok = 1;
-	amlcontrol->passthrough = TRUE;
+	g_mutex_unlock(&amladec->stats_lock);
+	GST_OBJECT_LOCK(amladec);
+	if (amladec->capture_location || amladec->dump_size) {
+		amladec->capture = amlEsCaptureNew(amladec->capture_location,
+				(gsize) amladec->dump_size << 20, AML_ES_STREAM_AUDIO, amladec->capture_caps);
+		amlCodecSetCapture(amladec->pcodec, amladec->capture);
+	}
+	GST_OBJECT_UNLOCK(amladec);
 	codec_set_pcrscr(amladec->pcodec, 0);
 	start_eos_task(amladec);
 	return TRUE;
 }
 
+/* ES bytes per second over AML_RATE_SPAN of PTS, smoothed across spans.
+ * A buffer's bytes belong to the span its PTS starts in. */
+static void
+gst_aml_adec_update_rate(GstAmlAdec *amladec, GstClockTime timestamp, gsize size)
+{
+	GstClockTime span;
+	guint64 rate;
+
+	amladec->frame_size = size;
+	if (!GST_CLOCK_TIME_IS_VALID(timestamp)) {
+		amladec->rate_bytes += size;
+		return;
+	}
+	if (!GST_CLOCK_TIME_IS_VALID(amladec->rate_start)
+			|| timestamp < amladec->rate_start) {
+		amladec->rate_start = timestamp;
+		amladec->rate_bytes = 0;
+	}
+	span = timestamp - amladec->rate_start;
+	if (span >= AML_RATE_SPAN) {
+		rate = gst_util_uint64_scale(amladec->rate_bytes, GST_SECOND, span);
+		g_mutex_lock(&amladec->stats_lock);
+		amladec->byte_rate = amladec->byte_rate ? (amladec->byte_rate * 3 + rate) / 4 : rate;
+		g_mutex_unlock(&amladec->stats_lock);
+		GST_LOG_OBJECT(amladec, "%" G_GUINT64_FORMAT " bytes/s", amladec->byte_rate);
+		amladec->rate_start = timestamp;
+		amladec->rate_bytes = 0;
+	}
+	amladec->rate_bytes += size;
+}
+
+/* abuf level below which the next buffer is written: target-latency worth
+ * of the measured bitrate, never more than the former 80% of abuf and
+ * never less than two buffers */
+static guint
+gst_aml_adec_watermark(GstAmlAdec *amladec, guint size)
+{
+	guint64 level = (guint64) size * 8 / 10;
+	guint64 target;
+
+	if (amladec->target_latency && amladec->byte_rate) {
+		target = gst_util_uint64_scale(amladec->byte_rate, amladec->target_latency, 1000);
+		target = MAX(target, amladec->frame_size * 2);
+		level = MIN(level, target);
+	}
+	return level;
+}
+
+/* how long until the decoder has drained abuf below the watermark, at the
+ * measured bitrate; a plain poll until that is known */
+static gint64
+gst_aml_adec_abuf_wait(GstAmlAdec *amladec, guint data_len, guint watermark)
+{
+	gint64 usec;
+
+	if (!amladec->byte_rate)
+		return AML_ABUF_POLL;
+	usec = gst_util_uint64_scale(data_len - watermark, G_USEC_PER_SEC, amladec->byte_rate);
+	return CLAMP(usec, AML_ABUF_WAIT_MIN, AML_ABUF_WAIT_MAX);
+}
+
+static GstClockTime
+gst_aml_adec_buffer_time(GstBuffer *buf)
+{
+	if (GST_BUFFER_PTS_IS_VALID(buf))
+		return GST_BUFFER_PTS(buf);
+	return GST_BUFFER_DTS(buf);
+}
+
+/* blocks until need more bytes fit under the watermark; more than the
+ * watermark at once waits for the decoder to drain abuf */
+static GstFlowReturn
+gst_aml_adec_wait_abuf(GstAmlAdec *amladec, gsize need)
+{
+	GstFlowReturn ret = GST_FLOW_OK;
+	struct buf_status abuf;
+	guint level;
+	gint64 stall_start = 0;
+
+	while (codec_get_abuf_state(amladec->pcodec, &abuf) == 0) {
+		/* the switcher is waiting for the stream lock */
+		if (amladec->releasing)
+			break;
+		level = gst_aml_adec_watermark(amladec, abuf.size);
+		level = level > need ? level - need : 1;
+		if (abuf.data_len < level) {
+			break;
+		}
+		if (amladec->is_paused) {
+			break;
+		}
+		if (!stall_start)
+			stall_start = g_get_monotonic_time();
+		g_atomic_int_inc(&amladec->wakeups);
+		if (!amlWaitSleep(&amladec->wait,
+				gst_aml_adec_abuf_wait(amladec, abuf.data_len, level))) {
+			ret = GST_FLOW_FLUSHING;
+			break;
+		}
+	}
+	if (stall_start)
+		gst_aml_adec_add_stall(amladec, g_get_monotonic_time() - stall_start);
+	return ret;
+}
+
+static void
+gst_aml_adec_checkin(GstAmlAdec *amladec, GstClockTime timestamp)
+{
+	GstClockTime pts;
+
+	codec_set_av_threshold(amladec->pcodec, 100);
+	if (timestamp == GST_CLOCK_TIME_NONE)
+		return;
+	pts = timestamp * 9LL / 100000LL + 1L;
+	if (amladec->segment.rate < 0.0) {
+	    pts = ~pts;
+	}
+	GST_DEBUG_OBJECT(amladec, "audio pts = %x", (unsigned long) pts);
+	g_atomic_int_inc(&amladec->wakeups);
+	if (codec_checkin_pts(amladec->pcodec, (unsigned long) pts) != 0) {
+		GST_WARNING_OBJECT(amladec, "pts checkin flied maybe lose sync");
+	} else {
+	    g_mutex_lock(&amladec->stats_lock);
+	    amladec->last_checkin_pts = pts;
+	    g_mutex_unlock(&amladec->stats_lock);
+	    amlEsCapturePts(amladec->capture, pts, timestamp);
+	}
+}
+
+static void
+gst_aml_adec_batch_drop(GstAmlAdec *amladec)
+{
+	guint i;
+
+	for (i = 0; i < amladec->batch_len; i++)
+		gst_buffer_unref(amladec->batch[i]);
+	amladec->batch_len = 0;
+	amladec->batch_bytes = 0;
+}
+
+/* the stream info's framing of buf, none for replayed captures that
+ * already contain it */
+static gint
+gst_aml_adec_prefix(GstAmlAdec *amladec, GstBuffer *buf, guint8 *prefix)
+{
+	if (!amladec->info->prefix || amladec->replay)
+		return 0;
+	return amladec->info->prefix(amladec->info, buf, prefix);
+}
+
+/* amlCodecWritev, its wait for abuf room counted as stall time */
+static gint
+gst_aml_adec_writev(GstAmlAdec *amladec, struct iovec *iov, gint iovcnt, const AmlEsRecordType *types)
+{
+	gint64 stall = 0;
+	gint written;
+
+	written = amlCodecWritev(amladec->pcodec, iov, iovcnt, types, &stall);
+	g_atomic_int_inc(&amladec->wakeups);
+	if (stall)
+		gst_aml_adec_add_stall(amladec, stall);
+	return written;
+}
+
+/* the batch as one write behind a single check-in of its first PTS, the
+ * decoder thread then sleeps until abuf has room for the next one */
+static GstFlowReturn
+gst_aml_adec_batch_flush(GstAmlAdec *amladec)
+{
+	GstFlowReturn ret;
+	struct iovec iov[AML_ADEC_BATCH_MAX * 2];
+	AmlEsRecordType types[AML_ADEC_BATCH_MAX * 2];
+	GstMapInfo map[AML_ADEC_BATCH_MAX];
+	gboolean mapped[AML_ADEC_BATCH_MAX];
+	guint i;
+	gint written;
+
+	if (!amladec->batch_len)
+		return GST_FLOW_OK;
+	if (!amladec->codec_init_ok) {
+		gst_aml_adec_batch_drop(amladec);
+		return GST_FLOW_OK;
+	}
+
+	ret = gst_aml_adec_wait_abuf(amladec, amladec->batch_bytes);
+	if (ret == GST_FLOW_FLUSHING) {
+		GST_DEBUG_OBJECT(amladec, "flushing, dropping %u buffers", amladec->batch_len);
+		gst_aml_adec_batch_drop(amladec);
+		return ret;
+	}
+
+	gst_aml_adec_checkin(amladec, amladec->batch_start);
+	for (i = 0; i < amladec->batch_len; i++) {
+		mapped[i] = gst_buffer_map(amladec->batch[i], &map[i], GST_MAP_READ);
+		iov[i * 2].iov_base = amladec->batch_prefix[i];
+		iov[i * 2].iov_len = amladec->batch_prefix_size[i];
+		types[i * 2] = AML_ES_RECORD_HEADER;
+		iov[i * 2 + 1].iov_base = mapped[i] ? map[i].data : NULL;
+		iov[i * 2 + 1].iov_len = mapped[i] ? map[i].size : 0;
+		types[i * 2 + 1] = AML_ES_RECORD_DATA;
+	}
+	written = gst_aml_adec_writev(amladec, iov, amladec->batch_len * 2, types);
+	GST_LOG_OBJECT(amladec, "%u buffers, %d of %" G_GSIZE_FORMAT " bytes written",
+			amladec->batch_len, written, amladec->batch_bytes);
+	if ((gsize) written < amladec->batch_bytes) {
+		if (amlWaitIsFlushing(&amladec->wait))
+			ret = GST_FLOW_FLUSHING;
+		else if (amlWaitIsCancelled(&amladec->wait))
+			GST_WARNING_OBJECT(amladec, "codec_write busy, batch cut short");
+		else
+			GST_ERROR_OBJECT(amladec, "codec_write failed");
+	}
+
+	for (i = 0; i < amladec->batch_len; i++) {
+		if (mapped[i])
+			gst_buffer_unmap(amladec->batch[i], &map[i]);
+	}
+	gst_aml_adec_batch_drop(amladec);
+	return ret;
+}
+
+static GstFlowReturn
+gst_aml_adec_batch_add(GstAmlAdec *amladec, GstBuffer *buf)
+{
+	GstClockTime timestamp = gst_aml_adec_buffer_time(buf);
+	gsize size = gst_buffer_get_size(buf);
+	guint8 sync;
+	gint prefix_size;
+
+	if (amladec->pcodec->audio_type == AFORMAT_FLAC
+			&& (gst_buffer_extract(buf, 0, &sync, 1) != 1 || sync != 0xFF))
+		return GST_FLOW_OK;
+
+	gst_aml_adec_update_rate(amladec, timestamp, size);
+	if (!amladec->batch_len)
+		amladec->batch_start = timestamp;
+	prefix_size = gst_aml_adec_prefix(amladec, buf,
+			amladec->batch_prefix[amladec->batch_len]);
+	amladec->batch_prefix_size[amladec->batch_len] = prefix_size;
+	amladec->batch[amladec->batch_len++] = gst_buffer_ref(buf);
+	amladec->batch_bytes += prefix_size + size;
+
+	if (amladec->batch_len == AML_ADEC_BATCH_MAX
+			|| (GST_CLOCK_TIME_IS_VALID(amladec->batch_start)
+				&& GST_CLOCK_TIME_IS_VALID(timestamp)
+				&& ABS(GST_CLOCK_DIFF(amladec->batch_start, timestamp))
+					>= (GstClockTimeDiff) amladec->batch_duration * GST_MSECOND))
+		return gst_aml_adec_batch_flush(amladec);
+	return GST_FLOW_OK;
+}
+
+static gboolean
+gst_aml_adec_claim(GstAmlAdec *amladec)
+{
+	gboolean claimed;
+
+	g_mutex_lock(&amlcontrol->lock);
+	claimed = !amlcontrol->owner || amlcontrol->owner == amladec;
+	if (claimed)
+		amlcontrol->owner = amladec;
+	g_mutex_unlock(&amlcontrol->lock);
+	return claimed;
+}
+
+static void
+gst_aml_adec_unclaim(GstAmlAdec *amladec)
+{
+	g_mutex_lock(&amlcontrol->lock);
+	if (amlcontrol->owner == amladec)
+		amlcontrol->owner = NULL;
+	g_mutex_unlock(&amlcontrol->lock);
+}
+
+/* gives the hardware back; stream lock held, EOS task stopped */
+static void
+gst_aml_adec_codec_close(GstAmlAdec *amladec)
+{
+	gint ret;
+
+	if (!amladec->codec_init_ok)
+		return;
+	g_mutex_lock(&amladec->stats_lock);
+	amladec->codec_init_ok = 0;
+	g_mutex_unlock(&amladec->stats_lock);
+	if (amladec->is_paused == TRUE) {
+		ret = codec_resume(amladec->pcodec);
+		if (ret != 0) {
+			GST_ERROR_OBJECT(amladec, "resume failed!ret=%d", ret);
+		} else {
+			amladec->is_paused = FALSE;
+		}
+	}
+	amlCodecSetCapture(amladec->pcodec, NULL);
+	GST_OBJECT_LOCK(amladec);
+	amlEsCaptureClose(amladec->capture);
+	amladec->capture = NULL;
+	GST_OBJECT_UNLOCK(amladec);
+	g_mutex_lock(&amladec->stats_lock);
+	codec_close(amladec->pcodec);
+	g_mutex_unlock(&amladec->stats_lock);
+	gst_aml_adec_unclaim(amladec);
+}
+
+static void
+gst_aml_adec_standby_clear(GstAmlAdec *amladec)
+{
+	GstBuffer *buf;
+
+	while ((buf = g_queue_pop_head(&amladec->standby)))
+		gst_buffer_unref(buf);
+}
+
+/* the last AML_ADEC_STANDBY_SPAN of input, streaming thread */
+static void
+gst_aml_adec_standby_add(GstAmlAdec *amladec, GstBuffer *buf)
+{
+	GstClockTime timestamp = gst_aml_adec_buffer_time(buf);
+	GstClockTime head_time;
+	GstBuffer *head;
+
+	g_queue_push_tail(&amladec->standby, gst_buffer_ref(buf));
+	while ((head = g_queue_peek_head(&amladec->standby))) {
+		head_time = gst_aml_adec_buffer_time(head);
+		if (g_queue_get_length(&amladec->standby) <= AML_ADEC_STANDBY_MAX
+				&& (!GST_CLOCK_TIME_IS_VALID(timestamp) || !GST_CLOCK_TIME_IS_VALID(head_time)
+					|| timestamp < head_time + AML_ADEC_STANDBY_SPAN))
+			break;
+		gst_buffer_unref(g_queue_pop_head(&amladec->standby));
+	}
+}
+
+/* the new owner restarts with the buffer holding the cut, what played
+ * before it is dropped; the gap is timed up to that first write */
+static void
+gst_aml_adec_standby_write(GstAmlAdec *amladec, GstClockTime cut, gint64 start)
+{
+	GstFlowReturn ret = GST_FLOW_OK;
+	GstClockTime first = GST_CLOCK_TIME_NONE;
+	GstClockTime next_time;
+	GstBuffer *buf;
+
+	while (GST_CLOCK_TIME_IS_VALID(cut) && g_queue_get_length(&amladec->standby) > 1) {
+		next_time = gst_aml_adec_buffer_time(g_queue_peek_nth(&amladec->standby, 1));
+		if (!GST_CLOCK_TIME_IS_VALID(next_time) || next_time > cut)
+			break;
+		gst_buffer_unref(g_queue_pop_head(&amladec->standby));
+	}
+
+	g_mutex_lock(&amladec->stats_lock);
+	amladec->switches++;
+	g_mutex_unlock(&amladec->stats_lock);
+	while ((buf = g_queue_pop_head(&amladec->standby))) {
+		if (ret == GST_FLOW_OK && !GST_CLOCK_TIME_IS_VALID(first)) {
+			first = gst_aml_adec_buffer_time(buf);
+			ret = gst_aml_adec_decode(amladec, buf);
+			if (ret == GST_FLOW_OK)
+				ret = gst_aml_adec_batch_flush(amladec);
+			if (start) {
+				g_mutex_lock(&amladec->stats_lock);
+				amladec->switch_time = (g_get_monotonic_time() - start) * GST_USECOND;
+				amladec->switch_gap = GST_CLOCK_TIME_IS_VALID(cut) && GST_CLOCK_TIME_IS_VALID(first)
+						? GST_CLOCK_DIFF(cut, first) : 0;
+				g_mutex_unlock(&amladec->stats_lock);
+			}
+		} else if (ret == GST_FLOW_OK) {
+			ret = gst_aml_adec_decode(amladec, buf);
+		}
+		gst_buffer_unref(buf);
+	}
+	if (!start)
+		return;
+
+	GST_INFO_OBJECT(amladec, "switched at %" GST_TIME_FORMAT ", first PTS %" GST_TIME_FORMAT
+			", %" G_GINT64_FORMAT " ns gap after %" GST_TIME_FORMAT,
+			GST_TIME_ARGS(cut), GST_TIME_ARGS(first), amladec->switch_gap,
+			GST_TIME_ARGS(amladec->switch_time));
+	gst_element_post_message(GST_ELEMENT(amladec),
+			gst_message_new_element(GST_OBJECT(amladec),
+				gst_structure_new("aml-audio-switch",
+					"switch-pts", G_TYPE_UINT64, cut,
+					"first-pts", G_TYPE_UINT64, first,
+					"switch-gap", G_TYPE_INT64, amladec->switch_gap,
+					"switch-time", G_TYPE_UINT64, amladec->switch_time,
+					NULL)));
+}
+
+/* stops the streaming thread writing, notes the PTS being played and
+ * closes the codec; the next owner restarts there */
+static void
+gst_aml_adec_release(GstAmlAdec *amladec)
+{
+	GstClockTime cut = GST_CLOCK_TIME_NONE;
+	unsigned long apts;
+	gboolean open;
+
+	g_mutex_lock(&amladec->switch_lock);
+	amladec->releasing = TRUE;
+	/* every write path gives up on releasing, see gst_aml_adec_write_cancelled */
+	amlWaitWake(&amladec->wait);
+	GST_AUDIO_DECODER_STREAM_LOCK(amladec);
+	open = amladec->codec_init_ok;
+	if (open) {
+		apts = codec_get_apts(amladec->pcodec);
+		if (apts != -1L && apts > 1 && amladec->segment.rate > 0.0)
+			cut = gst_util_uint64_scale(apts - 1, 100000, 9);
+	}
+	GST_AUDIO_DECODER_STREAM_UNLOCK(amladec);
+
+	if (open) {
+		/* its EOS path takes the stream lock */
+		stop_eos_task(amladec);
+		GST_AUDIO_DECODER_STREAM_LOCK(amladec);
+		gst_aml_adec_batch_drop(amladec);
+		gst_aml_adec_codec_close(amladec);
+		GST_AUDIO_DECODER_STREAM_UNLOCK(amladec);
+		g_mutex_lock(&amlcontrol->lock);
+		amlcontrol->switch_pts = cut;
+		amlcontrol->switch_start = g_get_monotonic_time();
+		g_mutex_unlock(&amlcontrol->lock);
+		GST_INFO_OBJECT(amladec, "released the codec at %" GST_TIME_FORMAT, GST_TIME_ARGS(cut));
+	}
+	amladec->releasing = FALSE;
+	g_mutex_unlock(&amladec->switch_lock);
+}
+
+/* closes the current owner's codec and opens this one's right after,
+ * fed from the standby backlog; the stream info was set up by caps */
+static void
+gst_aml_adec_acquire(GstAmlAdec *amladec)
+{
+	GstAmlAdec *owner;
+	GstClockTime cut;
+	gint64 start;
+
+	g_mutex_lock(&amlcontrol->lock);
+	owner = amlcontrol->owner ? gst_object_ref(amlcontrol->owner) : NULL;
+	g_mutex_unlock(&amlcontrol->lock);
+	if (owner && owner != amladec) {
+		gst_aml_adec_release(owner);
+		GST_OBJECT_LOCK(owner);
+		owner->passthrough = TRUE;
+		GST_OBJECT_UNLOCK(owner);
+	}
+	if (owner)
+		gst_object_unref(owner);
+
+	g_mutex_lock(&amladec->switch_lock);
+	GST_AUDIO_DECODER_STREAM_LOCK(amladec);
+	if (amladec->pcodec && amladec->info && !amladec->codec_init_ok && !amladec->adecomit
+			&& !amladec->passthrough && gst_aml_adec_claim(amladec)) {
+		g_mutex_lock(&amlcontrol->lock);
+		cut = amlcontrol->switch_pts;
+		start = amlcontrol->switch_start;
+		amlcontrol->switch_pts = GST_CLOCK_TIME_NONE;
+		amlcontrol->switch_start = 0;
+		g_mutex_unlock(&amlcontrol->lock);
+		if (aml_decode_init(amladec))
+			gst_aml_adec_standby_write(amladec, cut, start);
+		else
+			gst_aml_adec_unclaim(amladec);
+	}
+	GST_AUDIO_DECODER_STREAM_UNLOCK(amladec);
+	g_mutex_unlock(&amladec->switch_lock);
+}
+
+/* amlcontrol->switcher, one pass-through change at a time */
+static void
+gst_aml_adec_switch(GstAmlAdec *amladec, gpointer unused)
+{
+	gboolean passthrough;
+
+	GST_OBJECT_LOCK(amladec);
+	passthrough = amladec->passthrough;
+	GST_OBJECT_UNLOCK(amladec);
+	if (passthrough)
+		gst_aml_adec_release(amladec);
+	else
+		gst_aml_adec_acquire(amladec);
+	gst_object_unref(amladec);
+}
+
+/* the parser has read the header: the codec gets the stream's format and
+ * ffmpeg's 6 byte APE extradata as codec_data, which also goes into the
+ * capture header so a replay needs no parser */
+static gboolean
+gst_aml_adec_ape_init(GstAmlAdec *amladec)
+{
+	const AmlApeInfo *ape = amlApeParserGetInfo(amladec->apeparser);
+	guint8 extradata[6];
+	GstBuffer *codec_data;
+	GstCaps *caps;
+	gboolean ret;
+
+	GST_WRITE_UINT16_LE(extradata, ape->fileversion);
+	GST_WRITE_UINT16_LE(extradata + 2, ape->compressiontype);
+	GST_WRITE_UINT16_LE(extradata + 4, ape->formatflags);
+	codec_data = gst_buffer_new_and_alloc(sizeof(extradata));
+	gst_buffer_fill(codec_data, 0, extradata, sizeof(extradata));
+
+	caps = gst_caps_copy(amladec->capture_caps);
+	gst_caps_set_simple(caps,
+			"rate", G_TYPE_INT, (gint) ape->samplerate,
+			"channels", G_TYPE_INT, (gint) ape->channels,
+			"codec_data", GST_TYPE_BUFFER, codec_data, NULL);
+	gst_buffer_unref(codec_data);
+	gst_caps_replace(&amladec->capture_caps, caps);
+	GST_INFO_OBJECT(amladec, "APE %u: %u Hz, %u channels, %u bits, %u frames",
+			ape->fileversion, ape->samplerate, ape->channels, ape->bps, ape->totalframes);
+
+	ret = gst_set_astream_info(amladec, caps);
+	gst_caps_unref(caps);
+	gst_aml_adec_set_output_format(amladec);
+	return ret;
+}
+
+/* "APTS", the packet size, then libavformat's APE packet: block count and
+ * skip ahead of the frame */
+static GstFlowReturn
+gst_aml_adec_ape_write_frame(GstAmlAdec *amladec, AmlApeFrame *frame)
+{
+	static const AmlEsRecordType types[2] = { AML_ES_RECORD_HEADER, AML_ES_RECORD_DATA };
+	GstFlowReturn ret;
+	guint8 prefix[16];
+	struct iovec iov[2];
+	gint written;
+
+	if (!amladec->codec_init_ok)
+		return GST_FLOW_OK;
+	ret = gst_aml_adec_wait_abuf(amladec, frame->size + sizeof(prefix));
+	if (ret != GST_FLOW_OK)
+		return ret;
+	gst_aml_adec_update_rate(amladec, frame->pts, frame->size);
+	gst_aml_adec_checkin(amladec, frame->pts);
+
+	memcpy(prefix, "APTS", 4);
+	GST_WRITE_UINT32_BE(prefix + 4, frame->size + 8);
+	GST_WRITE_UINT32_LE(prefix + 8, frame->blocks);
+	GST_WRITE_UINT32_LE(prefix + 12, frame->skip);
+	iov[0].iov_base = prefix;
+	iov[0].iov_len = sizeof(prefix);
+	iov[1].iov_base = (void *) frame->data;
+	iov[1].iov_len = frame->size;
+	written = gst_aml_adec_writev(amladec, iov, 2, types);
+	GST_LOG_OBJECT(amladec, "APE frame %u, %" G_GSIZE_FORMAT " bytes, skip %u",
+			frame->index, frame->size, frame->skip);
+	if ((gsize) written < sizeof(prefix) + frame->size) {
+		if (amlWaitIsFlushing(&amladec->wait))
+			return GST_FLOW_FLUSHING;
+		if (amlWaitIsCancelled(&amladec->wait))
+			GST_WARNING_OBJECT(amladec, "codec_write busy, frame cut short");
+		else
+			GST_ERROR_OBJECT(amladec, "codec_write failed");
+	}
+	return GST_FLOW_OK;
+}
+
+/* every complete frame in the parser, drain also writes a last frame cut
+ * short by EOS */
+static GstFlowReturn
+gst_aml_adec_ape_write(GstAmlAdec *amladec, gboolean drain)
+{
+	GstFlowReturn ret = GST_FLOW_OK;
+	AmlApeFrame frame;
+
+	while (ret == GST_FLOW_OK) {
+		switch (amlApeParserNext(amladec->apeparser, drain, &frame)) {
+		case AML_APE_NEED_DATA:
+			return GST_FLOW_OK;
+		case AML_APE_HEADER:
+			if (!gst_aml_adec_ape_init(amladec))
+				ret = GST_FLOW_NOT_NEGOTIATED;
+			break;
+		case AML_APE_FRAME:
+			ret = gst_aml_adec_ape_write_frame(amladec, &frame);
+			amlApeParserRelease(amladec->apeparser, &frame);
+			break;
+		default:
+			GST_ELEMENT_ERROR(amladec, STREAM, DECODE, (NULL),
+					("invalid or unsupported APE stream"));
+			ret = GST_FLOW_ERROR;
+			break;
+		}
+	}
+	return ret;
+}
+
+/* typefind hands APE over as bytes: the byte segment of a seek lands on a
+ * frame start, downstream gets the time of that frame */
+static GstEvent *
+gst_aml_adec_ape_segment(GstAmlAdec *amladec, GstEvent *event)
+{
+	GstSegment segment;
+	GstClockTime start;
+	GstEvent *time_event;
+
+	gst_event_copy_segment(event, &segment);
+	if (segment.format != GST_FORMAT_BYTES)
+		return event;
+	start = amlApeParserSeek(amladec->apeparser, segment.start);
+	GST_DEBUG_OBJECT(amladec, "byte segment at %" G_GUINT64_FORMAT ", frame at %"
+			GST_TIME_FORMAT, segment.start, GST_TIME_ARGS(start));
+	if (!GST_CLOCK_TIME_IS_VALID(start))
+		start = 0;
+	gst_segment_init(&segment, GST_FORMAT_TIME);
+	segment.start = start;
+	segment.time = start;
+	segment.position = start;
+	segment.duration = amlApeParserDuration(amladec->apeparser);
+	time_event = gst_event_new_segment(&segment);
+	gst_event_set_seqnum(time_event, gst_event_get_seqnum(event));
+	gst_event_unref(event);
+	return time_event;
+}
+
+/* time seeks go upstream as the byte offset of the frame holding the
+ * target, from the seek table; a stop becomes the end of the frame
+ * holding it */
+static gboolean
+gst_aml_adec_src_event(GstAudioDecoder * dec, GstEvent * event)
+{
+	GstAmlAdec *amladec = GST_AMLADEC(dec);
+	GstFormat format;
+	GstSeekFlags flags;
+	GstSeekType start_type, stop_type;
+	gint64 start, stop;
+	gdouble rate;
+	guint64 offset, stop_offset = (guint64) -1;
+	GstEvent *seek;
+
+	if (GST_EVENT_TYPE(event) != GST_EVENT_SEEK || !amladec->is_ape)
+		return GST_AUDIO_DECODER_CLASS(parent_class)->src_event(dec, event);
+
+	gst_event_parse_seek(event, &rate, &format, &flags, &start_type, &start,
+			&stop_type, &stop);
+	if (format != GST_FORMAT_TIME || start_type != GST_SEEK_TYPE_SET || rate <= 0.0
+			|| !amlApeParserFrameOffset(amladec->apeparser, start, &offset))
+		return GST_AUDIO_DECODER_CLASS(parent_class)->src_event(dec, event);
+	if (stop_type == GST_SEEK_TYPE_SET && stop != -1) {
+		if (!amlApeParserFrameEnd(amladec->apeparser, stop, &stop_offset))
+			return GST_AUDIO_DECODER_CLASS(parent_class)->src_event(dec, event);
+	} else if (stop_type != GST_SEEK_TYPE_NONE && stop != -1) {
+		return GST_AUDIO_DECODER_CLASS(parent_class)->src_event(dec, event);
+	}
+
+	GST_DEBUG_OBJECT(amladec, "seek to %" GST_TIME_FORMAT ", byte %" G_GUINT64_FORMAT
+			", stop byte %" G_GINT64_FORMAT, GST_TIME_ARGS(start), offset, (gint64) stop_offset);
+	seek = gst_event_new_seek(rate, GST_FORMAT_BYTES, flags, GST_SEEK_TYPE_SET, offset,
+			stop_offset == (guint64) -1 ? GST_SEEK_TYPE_NONE : GST_SEEK_TYPE_SET,
+			(gint64) stop_offset);
+	gst_event_set_seqnum(seek, gst_event_get_seqnum(event));
+	gst_event_unref(event);
+	return gst_pad_push_event(GST_AUDIO_DECODER_SINK_PAD(dec), seek);
+}
+
 static GstFlowReturn
 gst_aml_adec_decode (GstAmlAdec *amladec, GstBuffer * buf)
 {
@@ -781,105 +1785,154 @@ gst_aml_adec_decode (GstAmlAdec *amladec, GstBuffer * buf)
 	guint8 *data;
 	guint size;
 	gint written;
-	GstClockTime timestamp = GST_CLOCK_TIME_NONE, pts;
+	GstClockTime timestamp;
 	gboolean valid = TRUE;
-	struct buf_status abuf;
-//	gint64 dt = 0;
+	gint64 stall_start = 0;
+	guint8 prefix[AML_PREFIX_MAX];
+	gint prefix_size;
+	struct iovec iov[2];
 
 	GstMapInfo map;
 
 
+	if (amladec->is_ape) {
+		amlApeParserPush(amladec->apeparser, gst_buffer_ref(buf));
+		return gst_aml_adec_ape_write(amladec, FALSE);
+	}
 	if (!amladec->info) {
 		return GST_FLOW_OK;
 	}
+	/* another track has the hardware */
+	if (!amladec->codec_init_ok || amladec->releasing) {
+		gst_aml_adec_standby_add(amladec, buf);
+		return GST_FLOW_OK;
+	}
 	if (amladec->pcodec && amladec->codec_init_ok) {
-		while (codec_get_abuf_state(amladec->pcodec, &abuf) == 0) {
-			if (abuf.data_len * 10 < abuf.size * 8) {
-				break;
-			}
-			if (amladec->is_paused) {
-				break;
-			}
-			usleep(40000);
+		/* streams whose add_startcode writes on its own are not batched */
+		if (amladec->low_power
+				&& (!amladec->info->add_startcode || amladec->replay))
+			return gst_aml_adec_batch_add(amladec, buf);
+		/* low-power was just turned off */
+		ret = gst_aml_adec_batch_flush(amladec);
+		if (ret == GST_FLOW_OK)
+			ret = gst_aml_adec_wait_abuf(amladec, 0);
+		if (ret == GST_FLOW_FLUSHING) {
+			GST_DEBUG_OBJECT(amladec, "flushing, dropping buffer");
+			return ret;
 		}
 
-		if (GST_BUFFER_PTS_IS_VALID(buf))
-			timestamp = GST_BUFFER_PTS(buf);
-		else if (GST_BUFFER_DTS_IS_VALID(buf))
-			timestamp = GST_BUFFER_DTS(buf);
-		pts = timestamp * 9LL / 100000LL + 1L;
-		if (amladec->segment.rate < 0.0) {
-		    pts = ~pts;
-		}
-		codec_set_av_threshold(amladec->pcodec, 100);
-		if (timestamp != GST_CLOCK_TIME_NONE) {
-			GST_DEBUG_OBJECT(amladec, "audio pts = %x", (unsigned long) pts);
-			if (codec_checkin_pts(amladec->pcodec, (unsigned long) pts) != 0) {
-				GST_WARNING_OBJECT(amladec, "pts checkin flied maybe lose sync");
-			} else {
-			    amladec->last_checkin_pts = pts;
-			}
+		timestamp = gst_aml_adec_buffer_time(buf);
+		gst_aml_adec_update_rate(amladec, timestamp, gst_buffer_get_size(buf));
+		gst_aml_adec_checkin(amladec, timestamp);
+
+		/* replayed captures already contain the startcodes */
+		if (amladec->info->add_startcode && !amladec->replay) {
+			amladec->info->add_startcode(amladec->info, amladec->pcodec, buf);
 		}
 
-		if (TRUE == amladec->is_ape) {
-//TS			amladec->apeparser->accusize += size;
-//			if (amladec->apeparser->ape_head.frames[amladec->apeparser->currentframe].skip > 0) {
-//				dt = amladec->apeparser->accusize
-//						- (amladec->apeparser->ape_head.frames[amladec->apeparser->currentframe].pos + 4);
-//			} else {
-//				dt = amladec->apeparser->accusize
-//						- amladec->apeparser->ape_head.frames[amladec->apeparser->currentframe].pos;
-//			}
-//			if (dt >= 0) {
-//				ret = gst_amladec_write_data(amladec, data, size - dt);
-//
-//				/*add head here*/
-//				gst_ape_add_startcode(amladec);
-//				if (amladec->apeparser->ape_head.frames[amladec->apeparser->currentframe].skip > 0) {
-//					gst_amladec_write_data(amladec, data + size - dt - 4, 4);
-//				}
-//				/**/
-//				ret = gst_amladec_write_data(amladec, data + size - dt, dt);
-//				amladec->apeparser->currentframe++;
-//			} else {
-//				ret = gst_amladec_write_data(amladec, data, size);
-//TE			}
-		} else {
-			if (amladec->info->add_startcode) {
-				amladec->info->add_startcode(amladec->info, amladec->pcodec, buf);
-			}
+		gst_buffer_map(buf, &map, GST_MAP_READ);
+		data = map.data;
+		size = map.size;
+		if (amladec->pcodec->audio_type == AFORMAT_FLAC && data[0] != 0xFF) {
+		    valid = FALSE;
+		}
 
-			gst_buffer_map(buf, &map, GST_MAP_READ);
-			data = map.data;
-			size = map.size;
-			if (amladec->pcodec->audio_type == AFORMAT_FLAC && data[0] != 0xFF) {
-			    valid = FALSE;
+		/* framing and payload in one write */
+		prefix_size = gst_aml_adec_prefix(amladec, buf, prefix);
+		if (prefix_size > 0) {
+			static const AmlEsRecordType types[2] = { AML_ES_RECORD_HEADER, AML_ES_RECORD_DATA };
+
+			iov[0].iov_base = prefix;
+			iov[0].iov_len = prefix_size;
+			iov[1].iov_base = data;
+			iov[1].iov_len = size;
+			written = gst_aml_adec_writev(amladec, iov, 2, types);
+			if (written < prefix_size + (gint) size) {
+				if (amlWaitIsFlushing(&amladec->wait))
+					ret = GST_FLOW_FLUSHING;
+				else if (amlWaitIsCancelled(&amladec->wait))
+					GST_WARNING_OBJECT(amladec, "codec_write busy, buffer cut short");
+				else
+					GST_ERROR_OBJECT(amladec, "codec_write failed");
 			}
+			size = 0;
+		}
 
-			while (size > 0 && amladec->codec_init_ok && valid) {
-				written = codec_write(amladec->pcodec, data, size);
-				if (written >= 0) {
-					size -= written;
-					data += written;
-				} else if (errno == EAGAIN || errno == EINTR) {
-					GST_WARNING_OBJECT(amladec, "codec_write busy");
-					if (amladec->is_paused) {
-						break;
-					}
-					usleep(20000);
-					continue;
-				} else {
-					GST_ERROR_OBJECT(amladec, "codec_write failed");
+		while (size > 0 && amladec->codec_init_ok && valid) {
+			written = codec_write(amladec->pcodec, data, size);
+			g_atomic_int_inc(&amladec->wakeups);
+			if (written >= 0) {
+				amlEsCaptureWrite(amladec->capture, AML_ES_RECORD_DATA, data, written);
+				size -= written;
+				data += written;
+			} else if (errno == EAGAIN || errno == EINTR) {
+				GST_WARNING_OBJECT(amladec, "codec_write busy");
+				/* the switcher is waiting for the stream lock */
+				if (amladec->is_paused || amladec->releasing) {
+					break;
+				}
+				if (!stall_start)
+					stall_start = g_get_monotonic_time();
+				if (!amlWaitSleep(&amladec->wait, 20000)) {
+					ret = GST_FLOW_FLUSHING;
 					break;
 				}
+				continue;
+			} else {
+				GST_ERROR_OBJECT(amladec, "codec_write failed");
+				break;
 			}
-
-			gst_buffer_unmap(buf, &map);
 		}
+		if (stall_start)
+			gst_aml_adec_add_stall(amladec, g_get_monotonic_time() - stall_start);
+
+		gst_buffer_unmap(buf, &map);
 	}
 	return ret;
 }
 
+/* converts raw audio to S16LE in the copy into the buffer that is written,
+ * which is then fed like any other input: batched, kept on standby */
+static GstFlowReturn
+gst_aml_adec_decode_pcm(GstAmlAdec *amladec, GstBuffer *buf)
+{
+	GstBuffer *out = amladec->pcm_buf;
+	GstMapInfo in, map;
+	gsize size, maxsize;
+
+	if (!gst_buffer_map(buf, &in, GST_MAP_READ))
+		return GST_FLOW_OK;
+	size = amlPcmConvOutSize(&amladec->pcm, in.size);
+	/* a frame split between buffers, kept for the next one */
+	if (!size) {
+		amlPcmConvert(&amladec->pcm, NULL, in.data, in.size);
+		gst_buffer_unmap(buf, &in);
+		return GST_FLOW_OK;
+	}
+	/* a batch or the standby queue may still hold the last one */
+	if (out) {
+		gst_buffer_get_sizes(out, NULL, &maxsize);
+		if (!gst_buffer_is_writable(out) || maxsize < size) {
+			gst_buffer_unref(out);
+			out = NULL;
+		}
+	}
+	if (!out)
+		out = gst_buffer_new_allocate(NULL, size, NULL);
+	amladec->pcm_buf = out;
+	gst_buffer_set_size(out, size);
+
+	gst_buffer_map(out, &map, GST_MAP_WRITE);
+	amlPcmConvert(&amladec->pcm, map.data, in.data, in.size);
+	gst_buffer_unmap(out, &map);
+	gst_buffer_unmap(buf, &in);
+
+	GST_BUFFER_PTS(out) = GST_BUFFER_PTS(buf);
+	GST_BUFFER_DTS(out) = GST_BUFFER_DTS(buf);
+	GST_BUFFER_DURATION(out) = GST_BUFFER_DURATION(buf);
+	return gst_aml_adec_decode(amladec, out);
+}
+
 
 /* entry point to initialize the plug-in
  * initialize the plug-in itself
@@ -893,11 +1946,7 @@ amladec_init (GstPlugin * amladec)
 	 * exchange the string 'Template amladec' with your description
 	 */
 	GST_DEBUG_CATEGORY_INIT(gst_aml_adec_debug, "amladec", 0, "Amlogic Audio Decoder");
-	if (!amlcontrol) {
-		amlcontrol = g_malloc(sizeof(struct AmlControl));
-		memset(amlcontrol, 0, sizeof(struct AmlControl));
-		amlcontrol->passthrough = FALSE;
-	}
+	aml_control_init();
 	return gst_element_register(amladec, "amladec", GST_RANK_PRIMARY+1, GST_TYPE_AMLADEC);
 }
 
@@ -51,6 +51,8 @@
 //#include <player.h>
 #include <amlaudioinfo.h>
 #include <gstamlsysctl.h>
+#include "amlapeparser.h"
+#include "amlpcmconv.h"
 #include  <codec.h>
 
 G_BEGIN_DECLS
@@ -69,6 +71,15 @@ G_BEGIN_DECLS
 #define GST_IS_AMLADEC_CLASS(klass) \
   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_AMLADEC))
 
+/* low-power: input buffers coalesced into one write */
+#define AML_ADEC_BATCH_MAX	64
+#define AML_ADEC_BATCH_DURATION	500	/* ms */
+
+/* input kept by a decoder without the hardware, so a track switch can
+ * restart at the playing PTS instead of at the next buffer */
+#define AML_ADEC_STANDBY_SPAN	(3 * GST_SECOND)
+#define AML_ADEC_STANDBY_MAX	512	/* buffers */
+
 typedef struct _GstAmlAdec      GstAmlAdec;
 typedef struct _GstAmlAdecClass GstAmlAdecClass;
 
@@ -91,7 +102,38 @@ struct _GstAmlAdec
 	gboolean is_eos;
 	GstTask * eos_task;
     GStaticRecMutex eos_lock;
+	AmlWait eos_wait;	/* low-power EOS polling, flushing while the task is stopped */
     unsigned long last_checkin_pts;
+	GstClockTime stall_time;	/* cumulative time spent waiting for abuf space */
+	guint target_latency;	/* ms of ES let into abuf, 0: up to 80% of it */
+	guint64 byte_rate;	/* measured ES bytes per second, 0: not yet known */
+	GstClockTime rate_start;	/* PTS the current measurement started at */
+	guint64 rate_bytes;	/* written since rate_start */
+	gsize frame_size;	/* last input buffer, lower bound of the watermark */
+	gboolean low_power;	/* write input in batch_duration batches */
+	guint batch_duration;	/* ms */
+	GstBuffer *batch[AML_ADEC_BATCH_MAX];	/* not written yet, streaming thread only */
+	guint8 batch_prefix[AML_ADEC_BATCH_MAX][AML_PREFIX_MAX];	/* AmlStreamInfo prefix of each */
+	guint8 batch_prefix_size[AML_ADEC_BATCH_MAX];
+	guint batch_len;
+	gsize batch_bytes;
+	GstClockTime batch_start;	/* timestamp of batch[0] */
+	gint wakeups;	/* driver calls and timed sleeps of the decoder threads */
+	AmlWait wait;	/* abuf/codec_write sleeps, flushing on FLUSH_START and PAUSED->READY */
+	gchar *capture_location;
+	AmlEsCapture *capture;
+	guint dump_size;	/* MB of ES kept in memory for dump-location, 0: off */
+	gchar *dump_location;
+	GstCaps *capture_caps;	/* sink caps, written to the capture file header */
+	gboolean replay;	/* input comes from amlesrc, already in codec_write form */
+	GstMemory *token;	/* two silent frames, shared by every output buffer */
+	GQueue standby;	/* recent input while another decoder has the hardware */
+	GMutex switch_lock;	/* track switch vs. close, taken before the stream lock */
+	gboolean releasing;	/* switch in progress, the streaming thread stops writing */
+	guint switches;	/* times this decoder took over the hardware */
+	GstClockTime switch_time;	/* last switch: old codec closed to first write */
+	GstClockTimeDiff switch_gap;	/* last switch: first PTS written - PTS playing at the cut */
+	GMutex stats_lock;	/* hw-stats from other threads: pcodec, codec_init_ok and the counters */
 //
 ////	AmlState eState;
 	codec_para_t *pcodec;
@@ -106,9 +148,10 @@ struct _GstAmlAdec
 //	/*for elapsed*/
 //	gint64 basepcr;
 //
-//	/*private for ape format*/
-////	gst_ape_parser *apeparser;
+	AmlApeParser *apeparser;	/* application/x-ape arrives as the file's bytes */
 	gboolean is_ape;
+	AmlPcmConv pcm;		/* raw audio other than S16LE */
+	GstBuffer *pcm_buf;		/* converted input, reused once written */
 //	gint64 duration;
 //	guint64 filesize;
 	gboolean adecomit;
@@ -121,11 +164,16 @@ struct _GstAmlAdecClass
 	GstAudioDecoderClass parent_class;
 };
 
+/* one hardware audio decoder per process, shared by every amladec */
 struct AmlControl
 {
   GstCaps *firstcaps;
-  gboolean passthrough;
   guint adecnumber;
+  GMutex lock;
+  GstAmlAdec *owner;	/* has the codec open or is opening it */
+  GThreadPool *switcher;	/* pass-through changes, one at a time off the app thread */
+  GstClockTime switch_pts;	/* where the last released decoder stopped playing */
+  gint64 switch_start;	/* monotonic us it was closed at, 0: no switch pending */
 };
 
 GType gst_aml_adec_get_type (void);
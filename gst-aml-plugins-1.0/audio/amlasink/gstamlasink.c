@@ -30,6 +30,7 @@
 #include <string.h>
 #include "gstamlasink.h"
 #include "amlutils.h"
+#include "amlclock.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_aml_asink_debug);
 #define GST_CAT_DEFAULT gst_aml_asink_debug
@@ -66,6 +67,7 @@ static GstStateChangeReturn gst_amlasink_change_state(GstElement * element,
         GstStateChange transition);
 static gboolean gst_aml_asink_query(GstElement * element, GstQuery * query);
 static gboolean gst_aml_asink_event(GstBaseSink * asink, GstEvent *event);
+static GstClock *gst_aml_asink_provide_clock(GstElement * element);
 
 #define parent_class gst_aml_asink_parent_class
 G_DEFINE_TYPE (GstAmlAsink, gst_aml_asink, GST_TYPE_BASE_SINK);
@@ -85,6 +87,8 @@ gst_aml_asink_class_init (GstAmlAsinkClass * klass)
     gstelement_class->change_state =
             GST_DEBUG_FUNCPTR(gst_amlasink_change_state);
     gstelement_class->query = GST_DEBUG_FUNCPTR(gst_aml_asink_query);
+    gstelement_class->provide_clock =
+            GST_DEBUG_FUNCPTR(gst_aml_asink_provide_clock);
     gobject_class->set_property = gst_aml_asink_set_property;
     gobject_class->get_property = gst_aml_asink_get_property;
     gobject_class->finalize = GST_DEBUG_FUNCPTR(gst_aml_asink_finalize);
@@ -131,6 +135,8 @@ gst_aml_asink_init (GstAmlAsink * amlasink)
     GstBaseSink *bsink = GST_BASE_SINK(amlasink);
     gst_base_sink_set_sync(bsink, FALSE);
     gst_base_sink_set_async_enabled(bsink, FALSE);
+    amlasink->clock = gst_aml_clock_new("GstAmlClock");
+    GST_OBJECT_FLAG_SET(amlasink, GST_ELEMENT_FLAG_PROVIDE_CLOCK);
     amlasink->segment.rate = 1.0;
     aptsrate = 1.0;
     gst_aoption_ratepts(&aptsrate);
@@ -213,9 +219,18 @@ gst_amlasink_change_state (GstElement * element, GstStateChange transition)
 static void
 gst_aml_asink_finalize (GObject * object)
 {
+    GstAmlAsink *amlasink = GST_AMLASINK(object);
+    gst_object_unref(amlasink->clock);
     G_OBJECT_CLASS(parent_class)->finalize(object);
 }
 
+static GstClock *
+gst_aml_asink_provide_clock (GstElement * element)
+{
+    GstAmlAsink *amlasink = GST_AMLASINK(element);
+    return gst_object_ref(amlasink->clock);
+}
+
 static GstFlowReturn
 gst_aml_asink_render (GstBaseSink * asink, GstBuffer *buffer)
 {
@@ -247,16 +262,8 @@ gst_aml_asink_query (GstElement * element, GstQuery * query)
     case GST_QUERY_POSITION: {
         GstClockTime cur;
         GstFormat format;
-        unsigned long pts = get_sysfs_int("/sys/class/tsync/pts_pcrscr");
-        if (pts && pts != 1) {
-            if (amlasink->segment.rate < 0.0) {
-                pts = ~pts;
-            }
+        if (amlPositionGet(amlasink->segment.rate, aptsrate, &cur)) {
             gst_query_parse_position(query, &format, NULL);
-            cur = (GstClockTime) pts * 100000LL / 9LL;
-            if (aptsrate != 1.0 && aptsrate > 0 && aptsrate <= MAXRATE) {
-                cur = cur *aptsrate;
-            }
             gst_query_set_position(query, format, cur);
             res = TRUE;
         } else {
@@ -47,6 +47,7 @@ struct _GstAmlAsink {
 
   /*< private >*/
   GstSegment segment;
+  GstClock *clock;          /* tsync PCR, offered to the pipeline */
   /* instance properties */
 
   gboolean mute;
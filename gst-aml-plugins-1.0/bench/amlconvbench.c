@@ -0,0 +1,659 @@
+/*
+ * amlconvbench.c
+ *
+ * Microbenchmark for the per-frame bitstream converters of amstreaminfo
+ * (writeheader/add_startcode of the video and audio stream infos).
+ *
+ * Every converter runs against a counting codec_write() that accepts all
+ * data, over deterministic synthetic streams of realistic frame sizes and,
+ * with --capture, over the data of amlvdec/amladec capture files (see
+ * amlescapture.h). Only the converter call itself is timed; preparing a
+ * fresh copy of the input frame is not.
+ *
+ * One tab separated line per converter and input:
+ *   converter input frames in_bytes ns_per_frame MB_per_s
+ *   allocs_per_frame writes_per_frame out_bytes_per_frame
+ * allocs counts GstMemory allocations through the default allocator.
+ * writes are the converter's own; the decoder's payload write is only in
+ * out_bytes, except for prefix converters, timed with the one write of
+ * prefix and payload that amladec does.
+ * With a fixed --frames the allocation and write columns are exact and
+ * can be diffed between commits; the timing columns need the same box.
+ *
+ *   ./amlconvbench --min-time=1000 --capture=/data/video.amles
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "amlconvbench.h"
+
+#define DEFAULT_MIN_TIME    500     /* ms per converter and input */
+#define DEFAULT_SEED        0x414d4c    /* "AML" */
+#define SYNTHETIC_FRAMES    60
+
+/* counting codec_write, amlCodecWrite() and the decoders end up here */
+static guint64 bench_writes;
+static guint64 bench_written;
+
+int codec_write(codec_para_t *pcodec, void *buffer, int len)
+{
+    bench_writes++;
+    bench_written += len;
+    return len;
+}
+
+/* amlCodecWritev() ends up here, counted as one write */
+int codec_writev(codec_para_t *pcodec, const struct iovec *iov, int iovcnt)
+{
+    int len = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        len += iov[i].iov_len;
+    bench_writes++;
+    bench_written += len;
+    return len;
+}
+
+/* default allocator that counts and forwards to the system allocator */
+typedef struct {
+    GstAllocator parent;
+    GstAllocator *sysmem;
+} AmlBenchAllocator;
+
+typedef struct {
+    GstAllocatorClass parent_class;
+} AmlBenchAllocatorClass;
+
+static volatile gint bench_allocs;
+
+GType aml_bench_allocator_get_type(void);
+G_DEFINE_TYPE(AmlBenchAllocator, aml_bench_allocator, GST_TYPE_ALLOCATOR);
+
+static GstMemory *
+aml_bench_allocator_alloc(GstAllocator *allocator, gsize size, GstAllocationParams *params)
+{
+    AmlBenchAllocator *self = (AmlBenchAllocator *) allocator;
+
+    g_atomic_int_inc(&bench_allocs);
+    return gst_allocator_alloc(self->sysmem, size, params);
+}
+
+static void
+aml_bench_allocator_class_init(AmlBenchAllocatorClass *klass)
+{
+    GST_ALLOCATOR_CLASS(klass)->alloc = aml_bench_allocator_alloc;
+}
+
+static void
+aml_bench_allocator_init(AmlBenchAllocator *self)
+{
+    GST_ALLOCATOR(self)->mem_type = "AmlBenchMemory";
+    self->sysmem = gst_allocator_find(GST_ALLOCATOR_SYSMEM);
+}
+
+typedef struct {
+    const gchar *converter;
+    const gchar *caps_name;         /* picks the stream info from the pools */
+    gboolean header;                /* writeheader instead of add_startcode */
+    const AmlBenchFrameFunc *frame; /* add_startcode not set up by init */
+    GstCaps *(*make_caps)(void);
+    GstBuffer *(*make_frame)(GRand *rand, guint index);
+    gsize padding;                  /* room the converter grows the frame into */
+    gboolean capture;               /* capture data is still the converter input */
+} AmlBenchCase;
+
+typedef struct {
+    const gchar *name;
+    GstCaps *caps;
+    GPtrArray *frames;
+} AmlBenchInput;
+
+static GstBuffer *
+bench_buffer_new(const guint8 *data, gsize size)
+{
+    GstBuffer *buf = gst_buffer_new_allocate(NULL, size, NULL);
+    gst_buffer_fill(buf, 0, data, size);
+    return buf;
+}
+
+static void
+bench_fill_random(GRand *rand, guint8 *data, gsize size)
+{
+    gsize i;
+    for (i = 0; i < size; i++)
+        data[i] = g_rand_int(rand) & 0xff;
+}
+
+/* 1080p-ish frame sizes: an I frame every 30, P frames around it */
+static gsize
+bench_frame_size(GRand *rand, guint index, gsize intra, gsize inter)
+{
+    gsize base = (index % 30 == 0) ? intra : inter;
+    return base - base / 4 + g_rand_int_range(rand, 0, base / 2);
+}
+
+static GstCaps *
+bench_h264_caps(void)
+{
+    static const guint8 avcc[] = {
+        0x01, 0x64, 0x00, 0x28, 0xff, 0xe1, 0x00, 0x1b,
+        0x67, 0x64, 0x00, 0x28, 0xac, 0xd9, 0x40, 0x78, 0x02, 0x27, 0xe5, 0xc0,
+        0x44, 0x00, 0x00, 0x03, 0x00, 0x04, 0x00, 0x00, 0x03, 0x00, 0xf0, 0x3c,
+        0x60, 0xc6, 0x58,
+        0x01, 0x00, 0x04, 0x68, 0xeb, 0xe3, 0xcb
+    };
+    GstBuffer *codec_data = bench_buffer_new(avcc, sizeof(avcc));
+    GstCaps *caps = gst_caps_new_simple("video/x-h264",
+            "width", G_TYPE_INT, 1920, "height", G_TYPE_INT, 1080,
+            "framerate", GST_TYPE_FRACTION, 30, 1,
+            "codec_data", GST_TYPE_BUFFER, codec_data, NULL);
+    gst_buffer_unref(codec_data);
+    return caps;
+}
+
+static GstCaps *
+bench_h265_caps(void)
+{
+    static const guint8 hvcc[] = {
+        0x01, 0x01, 0x60, 0x00, 0x00, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x5d, 0xf0, 0x00, 0xfc, 0xfd, 0xf8, 0xf8, 0x00, 0x00, 0x0f, 0x03,
+        0x20, 0x00, 0x01, 0x00, 0x18,
+        0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00,
+        0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5d, 0x95, 0x98, 0x09,
+        0x21, 0x00, 0x01, 0x00, 0x28,
+        0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+        0x03, 0x00, 0x00, 0x03, 0x00, 0x5d, 0xa0, 0x03, 0xc0, 0x80, 0x10, 0xe5,
+        0x96, 0x56, 0x69, 0x24, 0xca, 0xe0, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10,
+        0x00, 0x00, 0x03, 0x01, 0xe0, 0x80,
+        0x22, 0x00, 0x01, 0x00, 0x07,
+        0x44, 0x01, 0xc1, 0x72, 0xb4, 0x62, 0x40
+    };
+    GstBuffer *codec_data = bench_buffer_new(hvcc, sizeof(hvcc));
+    GstCaps *caps = gst_caps_new_simple("video/x-h265",
+            "width", G_TYPE_INT, 1920, "height", G_TYPE_INT, 1080,
+            "framerate", GST_TYPE_FRACTION, 30, 1,
+            "codec_data", GST_TYPE_BUFFER, codec_data, NULL);
+    gst_buffer_unref(codec_data);
+    return caps;
+}
+
+static GstCaps *
+bench_vp9_caps(void)
+{
+    return gst_caps_new_simple("video/x-vp9",
+            "width", G_TYPE_INT, 1920, "height", G_TYPE_INT, 1080,
+            "framerate", GST_TYPE_FRACTION, 30, 1, NULL);
+}
+
+static GstCaps *
+bench_h263_caps(void)
+{
+    return gst_caps_new_simple("video/x-h263",
+            "width", G_TYPE_INT, 352, "height", G_TYPE_INT, 288,
+            "framerate", GST_TYPE_FRACTION, 25, 1, NULL);
+}
+
+static GstCaps *
+bench_wmv3_caps(void)
+{
+    static const guint8 seqhdr[] = { 0x4e, 0xf9, 0x1a, 0x01 };
+    GstBuffer *codec_data = bench_buffer_new(seqhdr, sizeof(seqhdr));
+    GstCaps *caps = gst_caps_new_simple("video/x-wmv",
+            "wmvversion", G_TYPE_INT, 3, "format", G_TYPE_STRING, "WMV3",
+            "width", G_TYPE_INT, 1280, "height", G_TYPE_INT, 720,
+            "framerate", GST_TYPE_FRACTION, 30, 1,
+            "codec_data", GST_TYPE_BUFFER, codec_data, NULL);
+    gst_buffer_unref(codec_data);
+    return caps;
+}
+
+static GstCaps *
+bench_aac_caps(void)
+{
+    static const guint8 asc[] = { 0x11, 0x90 };    /* AAC LC, 48 kHz, stereo */
+    GstBuffer *codec_data = bench_buffer_new(asc, sizeof(asc));
+    GstCaps *caps = gst_caps_new_simple("audio/mpeg",
+            "mpegversion", G_TYPE_INT, 4, "rate", G_TYPE_INT, 48000,
+            "channels", G_TYPE_INT, 2,
+            "codec_data", GST_TYPE_BUFFER, codec_data, NULL);
+    gst_buffer_unref(codec_data);
+    return caps;
+}
+
+static GstCaps *
+bench_vorbis_caps(void)
+{
+    return gst_caps_new_simple("audio/x-vorbis",
+            "rate", G_TYPE_INT, 48000, "channels", G_TYPE_INT, 2, NULL);
+}
+
+/* AVC frame of 1-4 slices with 4 or 2 byte NAL length prefixes */
+static GstBuffer *
+bench_avc_frame(GRand *rand, guint index, guint length_size)
+{
+    gsize size = bench_frame_size(rand, index, 160000, 24000);
+    guint slices = g_rand_int_range(rand, 1, 5);
+    gsize max_nal = length_size == 2 ? 0xffff : size;
+    GstBuffer *buf;
+    GstMapInfo map;
+    guint8 *p;
+    gsize left, nal;
+
+    /* 2 byte prefixes need every NAL below 64k */
+    while (size / slices > max_nal)
+        slices++;
+    buf = gst_buffer_new_allocate(NULL, size + slices * length_size, NULL);
+    gst_buffer_map(buf, &map, GST_MAP_WRITE);
+    bench_fill_random(rand, map.data, map.size);
+    p = map.data;
+    left = size;
+    while (left > 0) {
+        nal = slices > 1 ? size / slices : left;
+        if (nal > left)
+            nal = left;
+        if (length_size == 4) {
+            p[0] = nal >> 24;
+            p[1] = nal >> 16;
+            p[2] = nal >> 8;
+            p[3] = nal;
+        } else {
+            p[0] = nal >> 8;
+            p[1] = nal;
+        }
+        p[length_size] = (index % 30 == 0) ? 0x65 : 0x41;
+        p += length_size + nal;
+        left -= nal;
+        if (slices > 1)
+            slices--;
+    }
+    gst_buffer_unmap(buf, &map);
+    return buf;
+}
+
+static GstBuffer *
+bench_avc4_frame(GRand *rand, guint index)
+{
+    return bench_avc_frame(rand, index, 4);
+}
+
+static GstBuffer *
+bench_avc2_frame(GRand *rand, guint index)
+{
+    return bench_avc_frame(rand, index, 2);
+}
+
+/* VP9 frames; every fourth one is a superframe with a hidden alt-ref */
+static GstBuffer *
+bench_vp9_frame(GRand *rand, guint index)
+{
+    gsize shown = bench_frame_size(rand, index, 120000, 18000);
+    gsize hidden = (index % 4 == 3) ? bench_frame_size(rand, 1, 0, 30000) : 0;
+    gsize index_sz = hidden ? 2 + 3 * 2 : 0;
+    GstBuffer *buf = gst_buffer_new_allocate(NULL, hidden + shown + index_sz, NULL);
+    GstMapInfo map;
+
+    gst_buffer_map(buf, &map, GST_MAP_WRITE);
+    bench_fill_random(rand, map.data, map.size);
+    if (hidden) {
+        guint8 marker = 0xc0 | (2 << 3) | 1;    /* 3 byte sizes, 2 frames */
+        guint8 *idx = map.data + hidden + shown;
+        idx[0] = marker;
+        idx[1] = hidden;
+        idx[2] = hidden >> 8;
+        idx[3] = hidden >> 16;
+        idx[4] = shown;
+        idx[5] = shown >> 8;
+        idx[6] = shown >> 16;
+        idx[7] = marker;
+        map.data[hidden - 1] = 0;
+    }
+    map.data[hidden + shown - 1] = 0;   /* not a superframe marker */
+    gst_buffer_unmap(buf, &map);
+    return buf;
+}
+
+/* CIF H.263 */
+static GstBuffer *
+bench_h263_frame(GRand *rand, guint index)
+{
+    gsize size = bench_frame_size(rand, index, 12000, 3000);
+    GstBuffer *buf = gst_buffer_new_allocate(NULL, size, NULL);
+    GstMapInfo map;
+
+    gst_buffer_map(buf, &map, GST_MAP_WRITE);
+    bench_fill_random(rand, map.data, map.size);
+    map.data[0] = 0x00;
+    map.data[1] = 0x00;
+    map.data[2] = 0x80;
+    gst_buffer_unmap(buf, &map);
+    return buf;
+}
+
+/* 720p WMV3 */
+static GstBuffer *
+bench_wmv3_frame(GRand *rand, guint index)
+{
+    gsize size = bench_frame_size(rand, index, 80000, 15000);
+    GstBuffer *buf = gst_buffer_new_allocate(NULL, size, NULL);
+    GstMapInfo map;
+
+    gst_buffer_map(buf, &map, GST_MAP_WRITE);
+    bench_fill_random(rand, map.data, map.size);
+    gst_buffer_unmap(buf, &map);
+    return buf;
+}
+
+/* raw AAC access units, ~128 kbit/s at 48 kHz; must not look like ADTS */
+static GstBuffer *
+bench_aac_frame(GRand *rand, guint index)
+{
+    gsize size = g_rand_int_range(rand, 250, 450);
+    GstBuffer *buf = gst_buffer_new_allocate(NULL, size, NULL);
+    GstMapInfo map;
+
+    gst_buffer_map(buf, &map, GST_MAP_WRITE);
+    bench_fill_random(rand, map.data, map.size);
+    map.data[0] = 0x21;
+    gst_buffer_unmap(buf, &map);
+    return buf;
+}
+
+static GstBuffer *
+bench_vorbis_frame(GRand *rand, guint index)
+{
+    gsize size = g_rand_int_range(rand, 150, 600);
+    GstBuffer *buf = gst_buffer_new_allocate(NULL, size, NULL);
+    GstMapInfo map;
+
+    gst_buffer_map(buf, &map, GST_MAP_WRITE);
+    bench_fill_random(rand, map.data, map.size);
+    gst_buffer_unmap(buf, &map);
+    return buf;
+}
+
+static const AmlBenchCase bench_cases[] = {
+    { "h264_write_header", "video/x-h264", TRUE, NULL, bench_h264_caps, NULL, 0, TRUE },
+    { "h264_add_startcode", "video/x-h264", FALSE, &amlBenchH264AddStartcode, bench_h264_caps, bench_avc4_frame, 0, FALSE },
+    { "h264_add_startcode/avc2", "video/x-h264", FALSE, &amlBenchH264AddStartcode, bench_h264_caps, bench_avc2_frame, 0, FALSE },
+    { "h265_write_header", "video/x-h265", TRUE, NULL, bench_h265_caps, NULL, 0, TRUE },
+    { "vp9_add_startcode", "video/x-vp9", FALSE, NULL, bench_vp9_caps, bench_vp9_frame, 2 * 16, FALSE },
+    { "h263_add_startcode", "video/x-h263", FALSE, NULL, bench_h263_caps, bench_h263_frame, 0, FALSE },
+    { "wmv3_add_startcode", "video/x-wmv", FALSE, NULL, bench_wmv3_caps, bench_wmv3_frame, 0, TRUE },
+    { "adts_prefix", "audio/mpeg", FALSE, NULL, bench_aac_caps, bench_aac_frame, 0, TRUE },
+    { "vorbis_prefix", "audio/x-vorbis", FALSE, NULL, bench_vorbis_caps, bench_vorbis_frame, 0, TRUE },
+};
+
+static gint64
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64) ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+/* prefix() plus the write gst_aml_adec_decode makes of it */
+static gint
+bench_prefix_write(AmlStreamInfo *info, codec_para_t *pcodec, GstBuffer *buf)
+{
+    guint8 prefix[AML_PREFIX_MAX];
+    struct iovec iov[2];
+    GstMapInfo map;
+
+    iov[0].iov_base = prefix;
+    iov[0].iov_len = info->prefix(info, buf, prefix);
+    gst_buffer_map(buf, &map, GST_MAP_READ);
+    iov[1].iov_base = map.data;
+    iov[1].iov_len = map.size;
+    amlCodecWritev(pcodec, iov, 2, NULL, NULL);
+    gst_buffer_unmap(buf, &map);
+    return 0;
+}
+
+static AmlStreamInfo *
+bench_stream_info(const AmlBenchCase *bcase, GstCaps *caps, codec_para_t *pcodec)
+{
+    GstStructure *structure = gst_caps_get_structure(caps, 0);
+    gchar *name = (gchar *) bcase->caps_name;
+    AmlStreamInfo *info;
+
+    info = amlVstreamInfoInterface(name);
+    if (!info)
+        info = amlAstreamInfoInterface(name);
+    if (!info)
+        return NULL;
+    memset(pcodec, 0, sizeof(*pcodec));
+    /* the 4k profile check may fail off target, the converters do not care */
+    info->init(info, pcodec, structure);
+    return info;
+}
+
+/* fresh, writable copy of an input frame, with spare room at the end
+ * for converters that grow the buffer in place */
+static GstBuffer *
+bench_prepare(GstBuffer *frame, gsize padding)
+{
+    GstAllocationParams params;
+    GstBuffer *work;
+    GstMapInfo map;
+
+    gst_allocation_params_init(&params);
+    params.padding = padding;
+    gst_buffer_map(frame, &map, GST_MAP_READ);
+    work = gst_buffer_new_allocate(NULL, map.size, &params);
+    gst_buffer_fill(work, 0, map.data, map.size);
+    gst_buffer_unmap(frame, &map);
+    return work;
+}
+
+static void
+bench_run(const AmlBenchCase *bcase, AmlBenchInput *input, gint min_time, gint fixed_frames)
+{
+    codec_para_t pcodec;
+    AmlStreamInfo *info;
+    AmlBenchFrameFunc frame_func;
+    gboolean prefixed;
+    guint64 frames = 0, in_bytes = 0, writes = 0, written = 0, allocs = 0;
+    gint64 elapsed = 0, t0;
+    gint64 deadline;
+
+    info = bench_stream_info(bcase, input->caps, &pcodec);
+    if (!info) {
+        g_printerr("%s: no stream info for %s\n", bcase->converter, bcase->caps_name);
+        return;
+    }
+    frame_func = bcase->frame ? *bcase->frame : info->add_startcode;
+    prefixed = !frame_func && info->prefix;
+    if (prefixed)
+        frame_func = bench_prefix_write;
+    if ((bcase->header && !info->writeheader) || (!bcase->header && !frame_func)) {
+        g_printerr("%s: not set up for %s\n", bcase->converter, input->name);
+        info->finalize(info);
+        return;
+    }
+    if (bcase->header && !info->configdata) {
+        g_printerr("%s: %s has no codec_data\n", bcase->converter, input->name);
+        info->finalize(info);
+        return;
+    }
+    if (!bcase->header && input->frames->len == 0) {
+        info->finalize(info);
+        return;
+    }
+
+    deadline = bench_now() + (gint64) min_time * 1000000;
+    while (fixed_frames > 0 ? frames < (guint64) fixed_frames : bench_now() < deadline) {
+        guint64 writes0, written0;
+        gint allocs0;
+
+        if (bcase->header) {
+            writes0 = bench_writes;
+            written0 = bench_written;
+            allocs0 = g_atomic_int_get(&bench_allocs);
+            t0 = bench_now();
+            info->writeheader(info, &pcodec);
+            elapsed += bench_now() - t0;
+            in_bytes += gst_buffer_get_size(info->configdata);
+        } else {
+            GstBuffer *src = g_ptr_array_index(input->frames, frames % input->frames->len);
+            GstBuffer *work = bench_prepare(src, bcase->padding);
+
+            writes0 = bench_writes;
+            written0 = bench_written;
+            allocs0 = g_atomic_int_get(&bench_allocs);
+            t0 = bench_now();
+            frame_func(info, &pcodec, work);
+            elapsed += bench_now() - t0;
+            in_bytes += gst_buffer_get_size(src);
+            /* plus what the decoder writes after the converter */
+            if (!prefixed)
+                written += gst_buffer_get_size(work);
+            gst_buffer_unref(work);
+        }
+        allocs += g_atomic_int_get(&bench_allocs) - allocs0;
+        writes += bench_writes - writes0;
+        written += bench_written - written0;
+        frames++;
+    }
+
+    g_print("%s\t%s\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\t%.1f\t%.2f\t%.3f\t%.3f\t%.1f\n",
+            bcase->converter, input->name, frames, in_bytes,
+            (double) elapsed / frames,
+            elapsed ? (double) in_bytes * 1000.0 / elapsed : 0.0,
+            (double) allocs / frames,
+            (double) writes / frames,
+            (double) written / frames);
+    info->finalize(info);
+}
+
+static AmlBenchInput *
+bench_input_synthetic(const AmlBenchCase *bcase, guint32 seed)
+{
+    AmlBenchInput *input = g_new0(AmlBenchInput, 1);
+    GRand *rand = g_rand_new_with_seed(seed);
+    guint i;
+
+    input->name = "synthetic";
+    input->caps = bcase->make_caps();
+    input->frames = g_ptr_array_new_with_free_func((GDestroyNotify) gst_buffer_unref);
+    for (i = 0; bcase->make_frame && i < SYNTHETIC_FRAMES; i++)
+        g_ptr_array_add(input->frames, bcase->make_frame(rand, i));
+    g_rand_free(rand);
+    return input;
+}
+
+/* frames are the data records of a capture, one per checked-in PTS.
+ * Converters that only inject headers leave those untouched, the ones
+ * that rewrite the frame in place (avc, vp9, h263) cannot take them. */
+static AmlBenchInput *
+bench_input_capture(const gchar *location)
+{
+    AmlBenchInput *input;
+    AmlEsReader reader;
+    AmlEsRecord record;
+    const guint8 *payload;
+    GByteArray *frame = NULL;
+    GError *error = NULL;
+
+    if (!amlEsReaderOpen(&reader, location, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return NULL;
+    }
+    input = g_new0(AmlBenchInput, 1);
+    input->name = g_path_get_basename(location);
+    input->caps = gst_caps_from_string(reader.caps);
+    input->frames = g_ptr_array_new_with_free_func((GDestroyNotify) gst_buffer_unref);
+    while (amlEsReaderPeek(&reader, &record, &payload)) {
+        if (record.type == AML_ES_RECORD_PTS && frame && frame->len) {
+            g_ptr_array_add(input->frames, bench_buffer_new(frame->data, frame->len));
+            g_byte_array_set_size(frame, 0);
+        } else if (record.type == AML_ES_RECORD_DATA) {
+            if (!frame)
+                frame = g_byte_array_new();
+            g_byte_array_append(frame, payload, record.size);
+        }
+        amlEsReaderSkip(&reader);
+    }
+    if (frame) {
+        if (frame->len)
+            g_ptr_array_add(input->frames, bench_buffer_new(frame->data, frame->len));
+        g_byte_array_free(frame, TRUE);
+    }
+    amlEsReaderClose(&reader);
+    if (!input->caps) {
+        g_printerr("%s: bad caps in capture\n", location);
+        g_ptr_array_free(input->frames, TRUE);
+        g_free(input);
+        return NULL;
+    }
+    return input;
+}
+
+static void
+bench_input_free(AmlBenchInput *input, gboolean synthetic)
+{
+    if (!synthetic)
+        g_free((gchar *) input->name);
+    gst_caps_unref(input->caps);
+    g_ptr_array_free(input->frames, TRUE);
+    g_free(input);
+}
+
+int main(int argc, char **argv)
+{
+    gint min_time = DEFAULT_MIN_TIME;
+    gint fixed_frames = 0;
+    gint seed = DEFAULT_SEED;
+    gchar **captures = NULL;
+    gchar *filter = NULL;
+    GOptionEntry entries[] = {
+        { "min-time", 't', 0, G_OPTION_ARG_INT, &min_time, "Time per converter and input in ms", "MS" },
+        { "frames", 'n', 0, G_OPTION_ARG_INT, &fixed_frames, "Run a fixed number of frames instead", "N" },
+        { "seed", 's', 0, G_OPTION_ARG_INT, &seed, "Seed of the synthetic streams", "SEED" },
+        { "capture", 'c', 0, G_OPTION_ARG_FILENAME_ARRAY, &captures, "Also run on this ES capture", "FILE" },
+        { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "Only converters containing this string", "NAME" },
+        { NULL }
+    };
+    GOptionContext *ctx;
+    GError *error = NULL;
+    guint i, j;
+
+    ctx = g_option_context_new("- amstreaminfo converter benchmark");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(ctx);
+
+    gst_init(NULL, NULL);
+    gst_allocator_set_default(g_object_new(aml_bench_allocator_get_type(), NULL));
+
+    g_print("converter\tinput\tframes\tin_bytes\tns_per_frame\tMB_per_s\tallocs_per_frame\twrites_per_frame\tout_bytes_per_frame\n");
+    for (i = 0; i < G_N_ELEMENTS(bench_cases); i++) {
+        const AmlBenchCase *bcase = &bench_cases[i];
+        AmlBenchInput *input;
+
+        if (filter && !strstr(bcase->converter, filter))
+            continue;
+        input = bench_input_synthetic(bcase, seed);
+        bench_run(bcase, input, min_time, fixed_frames);
+        bench_input_free(input, TRUE);
+
+        for (j = 0; bcase->capture && captures && captures[j]; j++) {
+            input = bench_input_capture(captures[j]);
+            if (!input)
+                continue;
+            if (gst_structure_has_name(gst_caps_get_structure(input->caps, 0), bcase->caps_name))
+                bench_run(bcase, input, min_time, fixed_frames);
+            bench_input_free(input, FALSE);
+        }
+    }
+
+    g_strfreev(captures);
+    g_free(filter);
+    return 0;
+}
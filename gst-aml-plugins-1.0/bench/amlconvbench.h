@@ -0,0 +1,18 @@
+/*
+ * amlconvbench.h
+ *
+ * Shared declarations of the amstreaminfo converter benchmark.
+ */
+
+#ifndef __AML_CONVBENCH_H__
+#define __AML_CONVBENCH_H__
+#include <amlvideoinfo.h>
+#include <amlaudioinfo.h>
+
+typedef gint (*AmlBenchFrameFunc)(AmlStreamInfo *info, codec_para_t *pcodec, GstBuffer *buf);
+
+/* converters the stream info pools do not hand out, taken from
+ * amlvideoinfo.c by amlconvbench_video.c */
+extern const AmlBenchFrameFunc amlBenchH264AddStartcode;
+
+#endif
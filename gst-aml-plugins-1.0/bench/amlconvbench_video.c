@@ -0,0 +1,12 @@
+/*
+ * amlconvbench_video.c
+ *
+ * Builds amlvideoinfo.c into the benchmark so the static converters
+ * that are not reachable through amlVstreamInfoInterface() can be driven
+ * directly. Nothing here may change what gets compiled for amlvdec.
+ */
+
+#include "amlvideoinfo.c"
+#include "amlconvbench.h"
+
+const AmlBenchFrameFunc amlBenchH264AddStartcode = h264_add_startcode;
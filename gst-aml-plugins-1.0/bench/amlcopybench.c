@@ -0,0 +1,252 @@
+/*
+ * amlcopybench.c
+ *
+ * amlvsink yuvplayer copy: the former per-row memcpy/memset loop of
+ * gst_aml_vsink_render against amlCopyPlanes(), single threaded and
+ * with the band pool, on I420 frames copied into a buffer laid out like
+ * the ION buffers (align_width = width rounded up to 64). The stream
+ * variants use the non-temporal stores of copy-mode=write-combine; into
+ * ordinary memory they show what skipping the cache fills saves, not the
+ * write-combined mapping itself. The dma-buf cache sync of copy-mode=cached
+ * is only measurable on the target, see the sink's cache-sync-time.
+ * The box variants are downscale=true, 2:1 and 4:1 into buffers sized
+ * for the smaller frame, checked against a plain C box filter.
+ *
+ * One tab separated line per size and variant:
+ *   size variant threads ms_per_frame MB_per_s match
+ * match compares the result with the legacy loop (box: the C filter),
+ * MB_per_s counts the bytes written.
+ *
+ *   ./amlcopybench --min-time=2000 --threads=4
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "amlvsink_copy.h"
+
+#define DEFAULT_MIN_TIME    1000    /* ms per size and variant */
+
+typedef struct {
+    const gchar *name;
+    gint width, height;
+} AmlCopySize;
+
+static const AmlCopySize copy_sizes[] = {
+    { "720x480", 720, 480 },
+    { "1080p", 1920, 1080 },
+    { "4k", 3840, 2160 },
+};
+
+typedef struct {
+    gint width, height, align_width, yuv_width;
+    guint8 *src;
+    gsize src_size;
+} AmlCopyFrame;
+
+/* verbatim from gst_aml_vsink_render before amlvsink_copy.c; the source
+ * is assumed tightly packed with yuv_width / 2 chroma rows */
+static void legacy_copy(const AmlCopyFrame *f, guint8 *cpu_ptr, const guint8 *data)
+{
+    gint j;
+
+    for (j = 0; j < f->height; j++) {
+        memcpy(cpu_ptr + f->align_width * j, data + j * f->width, f->width);
+        memset(cpu_ptr + f->align_width * j + f->width, 0, f->align_width - f->width);
+    }
+    for (j = 0; j < f->height / 2; j++) {
+        memcpy(cpu_ptr + f->align_width * f->height + f->align_width * j / 2,
+                data + f->width * f->height + j * f->yuv_width / 2,
+                f->yuv_width / 2);
+        memset(cpu_ptr + f->align_width * f->height + f->align_width * j / 2
+                + f->width / 2, 0x80, (f->align_width - f->width) / 2);
+    }
+    for (j = 0; j < f->height / 2; j++) {
+        memcpy(cpu_ptr + f->align_width * f->height + f->align_width * f->height / 4
+                + f->align_width * j / 2,
+                data + f->width * f->height + f->yuv_width * f->height / 4
+                + j * f->yuv_width / 2,
+                f->width / 2);
+        memset(cpu_ptr + f->align_width * f->height + f->align_width * f->height / 4
+                + f->align_width * j / 2 + f->width / 2, 0x80,
+                (f->align_width - f->width) / 2);
+    }
+}
+
+/* same source layout as the legacy loop, described as planes; scale > 0
+ * fills a buffer laid out for the frame 1 << scale smaller */
+static void new_copy(const AmlCopyFrame *f, AmlCopyPool *pool, guint8 *cpu_ptr, const guint8 *data,
+        guint8 flags, gint scale)
+{
+    gint width = (f->width >> scale) & ~1, height = (f->height >> scale) & ~1;
+    gint align_width = (width + 63) & ~63;
+    AmlPlane planes[3];
+    gint p;
+
+    if (scale == 0) {
+        width = f->width;
+        height = f->height;
+    }
+    for (p = 0; p < 3; p++) {
+        planes[p].dst = cpu_ptr;
+        planes[p].dst_stride = p ? align_width / 2 : align_width;
+        planes[p].src = data;
+        planes[p].src_stride = p ? f->yuv_width / 2 : f->width;
+        planes[p].width = p ? width / 2 : width;
+        planes[p].height = p ? height / 2 : height;
+        planes[p].pad = p ? 0x80 : 0;
+        planes[p].flags = flags;
+        planes[p].scale = scale;
+        planes[p].step = 1;
+    }
+    planes[1].dst += align_width * height;
+    planes[2].dst += align_width * height * 5 / 4;
+    planes[1].src += f->width * f->height;
+    planes[2].src += f->width * f->height + f->yuv_width * f->height / 4;
+    amlCopyPlanes(pool, planes, 3);
+}
+
+/* reference for the box variants, one plane */
+static void box_plane(guint8 *dst, gint dst_stride, const guint8 *src, gint src_stride,
+        gint width, gint height, gint scale, guint8 pad)
+{
+    gint n = 1 << scale;
+    gint x, y, i, j;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            guint sum = 0;
+
+            for (j = 0; j < n; j++)
+                for (i = 0; i < n; i++)
+                    sum += src[(y * n + j) * src_stride + x * n + i];
+            dst[y * dst_stride + x] = (sum + n * n / 2) / (n * n);
+        }
+        memset(dst + y * dst_stride + width, pad, dst_stride - width);
+    }
+}
+
+static void box_copy(const AmlCopyFrame *f, guint8 *cpu_ptr, const guint8 *data, gint scale)
+{
+    gint width = (f->width >> scale) & ~1, height = (f->height >> scale) & ~1;
+    gint align_width = (width + 63) & ~63;
+
+    box_plane(cpu_ptr, align_width, data, f->width, width, height, scale, 0);
+    box_plane(cpu_ptr + align_width * height, align_width / 2,
+            data + f->width * f->height, f->yuv_width / 2,
+            width / 2, height / 2, scale, 0x80);
+    box_plane(cpu_ptr + align_width * height * 5 / 4, align_width / 2,
+            data + f->width * f->height + f->yuv_width * f->height / 4, f->yuv_width / 2,
+            width / 2, height / 2, scale, 0x80);
+}
+
+static gint64 bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64) ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+static void bench_size(const AmlCopySize *size, AmlCopyPool *pool, gint threads, gint min_time)
+{
+    AmlCopyFrame f;
+    gsize dst_size;
+    guint8 *dst, *dst_base, *ref;
+    GRand *rand = g_rand_new_with_seed(0x414d4c);
+    gint variant;
+    gsize i;
+
+    f.width = size->width;
+    f.height = size->height;
+    f.align_width = (f.width + 63) & ~63;
+    f.yuv_width = (f.width + 15) & ~15;
+    f.src_size = f.width * f.height + f.yuv_width * f.height / 2;
+    f.src = g_malloc(f.src_size);
+    for (i = 0; i < f.src_size; i++)
+        f.src[i] = g_rand_int(rand);
+    g_rand_free(rand);
+
+    dst_size = f.align_width * f.height * 3 / 2;
+    /* page aligned like the mmapped ION buffers, the stream stores need 16 */
+    dst = g_malloc(dst_size + 4096);
+    dst_base = dst;
+    dst = (guint8 *) (((gsize) dst + 4095) & ~(gsize) 4095);
+    ref = g_malloc(dst_size);
+    legacy_copy(&f, ref, f.src);
+
+    for (variant = 0; variant < 9; variant++) {
+        static const gchar *names[] = { "legacy", "simd", "simd+stream", "simd+pool",
+                "simd+stream+pool", "box2:1", "box4:1", "box2:1+pool", "box4:1+pool" };
+        gboolean use_pool = variant == 3 || variant == 4 || variant >= 7;
+        guint8 flags = variant == 2 || variant == 4 ? AML_COPY_STREAM : 0;
+        gint scale = variant >= 5 ? 2 - variant % 2 : 0;
+        gint scaled_width = ((f.width >> scale) & ~1), scaled_height = (f.height >> scale) & ~1;
+        gsize size_out = scale ? (gsize) ((scaled_width + 63) & ~63) * scaled_height * 3 / 2
+                : dst_size;
+        gint64 start, elapsed, deadline;
+        guint64 frames = 0;
+        gboolean match;
+
+        if (use_pool && !pool)
+            continue;
+        if (scale)
+            box_copy(&f, ref, f.src, scale);
+        memset(dst, 0x55, dst_size);
+        start = bench_now();
+        deadline = start + (gint64) min_time * 1000000;
+        do {
+            if (variant == 0)
+                legacy_copy(&f, dst, f.src);
+            else
+                new_copy(&f, use_pool ? pool : NULL, dst, f.src, flags, scale);
+            frames++;
+        } while (bench_now() < deadline);
+        elapsed = bench_now() - start;
+        match = memcmp(dst, ref, size_out) == 0;
+
+        g_print("%s\t%s\t%d\t%.3f\t%.1f\t%s\n", size->name, names[variant],
+                use_pool ? threads : 1,
+                (double) elapsed / frames / 1e6,
+                (double) size_out * frames * 1000.0 / elapsed,
+                match ? "yes" : "NO");
+    }
+
+    g_free(ref);
+    g_free(dst_base);
+    g_free(f.src);
+}
+
+int main(int argc, char **argv)
+{
+    gint min_time = DEFAULT_MIN_TIME;
+    gint threads = 0;
+    GOptionEntry entries[] = {
+        { "min-time", 't', 0, G_OPTION_ARG_INT, &min_time, "Time per size and variant in ms", "MS" },
+        { "threads", 'j', 0, G_OPTION_ARG_INT, &threads, "Copy threads of the pool variant (0: per core)", "N" },
+        { NULL }
+    };
+    GOptionContext *ctx;
+    GError *error = NULL;
+    AmlCopyPool *pool;
+    guint i;
+
+    ctx = g_option_context_new("- amlvsink plane copy benchmark");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(ctx);
+
+    if (threads <= 0)
+        threads = g_get_num_processors();
+    threads = MIN(threads, AML_COPY_MAX_THREADS);
+    pool = amlCopyPoolNew(threads);
+
+    g_print("size\tvariant\tthreads\tms_per_frame\tMB_per_s\tmatch\n");
+    for (i = 0; i < G_N_ELEMENTS(copy_sizes); i++)
+        bench_size(&copy_sizes[i], pool, threads, min_time);
+
+    amlCopyPoolFree(pool);
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * amlpcmbench.c
+ *
+ * amladec PCM conversion to S16LE: amlPcmConvert() against a plain C
+ * loop doing the same per sample, on buffers of 1024 frames, the size
+ * of a typical demuxer buffer at 48 kHz. Float input is uniform in
+ * [-1.2, 1.2) so the clamp is taken; integer input is random bytes.
+ *
+ * One tab separated line per format, channel count and variant:
+ *   format channels variant us_per_buffer MB_per_s match
+ * match compares the result with the C loop, MB_per_s counts the bytes
+ * read.
+ *
+ *   ./amlpcmbench --min-time=2000
+ */
+
+#include <string.h>
+#include <time.h>
+#include "amlpcmconv.h"
+
+#define DEFAULT_MIN_TIME    1000    /* ms per format, channel count and variant */
+#define BENCH_FRAMES        1024
+
+typedef struct {
+    const gchar *name;          /* caps name */
+    const gchar *format;        /* audio/x-raw format or NULL */
+    gint width;                 /* audio/x-lpcm width */
+} AmlPcmFormat;
+
+static const AmlPcmFormat bench_formats[] = {
+    { "audio/x-raw", "S16BE", 0 },
+    { "audio/x-raw", "S24LE", 0 },
+    { "audio/x-raw", "S24BE", 0 },
+    { "audio/x-raw", "S24_32LE", 0 },
+    { "audio/x-raw", "S32LE", 0 },
+    { "audio/x-raw", "S32BE", 0 },
+    { "audio/x-raw", "F32LE", 0 },
+    { "audio/x-raw", "F32BE", 0 },
+    { "audio/x-lpcm", NULL, 16 },
+    { "audio/x-lpcm", NULL, 24 },
+};
+
+static const gint bench_channels[] = { 2, 6, 8 };
+
+static gint64 bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (gint64) ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+/* one sample at a time, the way an element without SIMD would */
+static gsize plain_convert(const AmlPcmConv *conv, guint8 *d, const guint8 *s, gsize size)
+{
+    gsize units = size / conv->unit, u, i;
+    guint8 *p = d;
+
+    for (u = 0; u < units; u++) {
+        const guint8 *unit = s + u * conv->unit;
+
+        for (i = 0; i < conv->samples; i++) {
+            const guint8 *sample = unit + i * conv->width;
+            gint v;
+
+            if (conv->kind == AML_PCM_INT) {
+                v = sample[conv->lo] | (sample[conv->hi] << 8);
+            } else {
+                guint32 bits;
+                gfloat f;
+
+                memcpy(&bits, sample, 4);
+                bits = conv->kind == AML_PCM_F32BE ? GUINT32_FROM_BE(bits) : GUINT32_FROM_LE(bits);
+                memcpy(&f, &bits, 4);
+                f *= 32768.0f;
+                v = f >= 32767.0f ? 32767 : f > -32768.0f ? (gint) f : -32768;
+            }
+            *p++ = v & 0xff;
+            *p++ = (v >> 8) & 0xff;
+        }
+    }
+    return p - d;
+}
+
+static void bench_fill(const AmlPcmConv *conv, guint8 *src, gsize size)
+{
+    GRand *rand = g_rand_new_with_seed(1);
+    gsize i;
+
+    if (conv->kind == AML_PCM_INT) {
+        for (i = 0; i < size; i++)
+            src[i] = g_rand_int(rand);
+    } else {
+        for (i = 0; i + 4 <= size; i += 4) {
+            gfloat f = g_rand_double_range(rand, -1.2, 1.2);
+            guint32 bits;
+
+            memcpy(&bits, &f, 4);
+            bits = conv->kind == AML_PCM_F32BE ? GUINT32_TO_BE(bits) : GUINT32_TO_LE(bits);
+            memcpy(src + i, &bits, 4);
+        }
+    }
+    g_rand_free(rand);
+}
+
+static void bench_run(const AmlPcmFormat *format, gint channels, gint min_time)
+{
+    static const gchar *names[] = { "c", "conv" };
+    GstStructure *structure;
+    AmlPcmConv conv;
+    guint8 *src, *dst, *ref;
+    gsize size, size_out;
+    gint variant;
+
+    structure = gst_structure_new(format->name, "channels", G_TYPE_INT, channels, NULL);
+    if (format->format)
+        gst_structure_set(structure, "format", G_TYPE_STRING, format->format, NULL);
+    if (format->width)
+        gst_structure_set(structure, "width", G_TYPE_INT, format->width, NULL);
+    if (!amlPcmConvInit(&conv, structure) || !conv.convert) {
+        g_printerr("%s %s not converted\n", format->name, format->format ? format->format : "");
+        gst_structure_free(structure);
+        return;
+    }
+    gst_structure_free(structure);
+
+    /* DVD groups hold two frames */
+    size = conv.unit * (BENCH_FRAMES * channels / conv.samples);
+    size_out = amlPcmConvOutSize(&conv, size);
+    src = g_malloc(size);
+    dst = g_malloc(size_out);
+    ref = g_malloc(size_out);
+    bench_fill(&conv, src, size);
+    plain_convert(&conv, ref, src, size);
+
+    for (variant = 0; variant < 2; variant++) {
+        gint64 start, deadline, elapsed;
+        guint64 buffers = 0;
+        gboolean match;
+
+        memset(dst, 0, size_out);
+        start = bench_now();
+        deadline = start + (gint64) min_time * 1000000;
+        do {
+            if (variant == 0)
+                plain_convert(&conv, dst, src, size);
+            else
+                amlPcmConvert(&conv, dst, src, size);
+            buffers++;
+        } while ((buffers & 63) || bench_now() < deadline);
+        elapsed = bench_now() - start;
+        match = memcmp(dst, ref, size_out) == 0;
+
+        g_print("%s\t%d\t%s\t%.2f\t%.1f\t%s\n",
+                format->format ? format->format : (format->width == 16 ? "LPCM16" : "LPCM24"),
+                channels, names[variant], (double) elapsed / buffers / 1000.0,
+                (double) size * buffers * 1000.0 / elapsed, match ? "yes" : "NO");
+    }
+
+    g_free(src);
+    g_free(dst);
+    g_free(ref);
+}
+
+int main(int argc, char **argv)
+{
+    gint min_time = DEFAULT_MIN_TIME;
+    GOptionEntry entries[] = {
+        { "min-time", 't', 0, G_OPTION_ARG_INT, &min_time, "Time per format, channel count and variant in ms", "MS" },
+        { NULL }
+    };
+    GOptionContext *ctx;
+    GError *error = NULL;
+    guint i, j;
+
+    ctx = g_option_context_new("- amladec PCM conversion benchmark");
+    g_option_context_add_main_entries(ctx, entries, NULL);
+    g_option_context_add_group(ctx, gst_init_get_option_group());
+    if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(ctx);
+
+    g_print("format\tchannels\tvariant\tus_per_buffer\tMB_per_s\tmatch\n");
+    for (i = 0; i < G_N_ELEMENTS(bench_formats); i++) {
+        for (j = 0; j < G_N_ELEMENTS(bench_channels); j++)
+            bench_run(&bench_formats[i], bench_channels[j], min_time);
+    }
+    return 0;
+}
@@ -6,14 +6,45 @@
 #include <errno.h>
 #include <linux/fb.h>
 #include <ctype.h>
+#include <sys/stat.h>
 #include "gstamlsysctl.h"
 static int axis[8] = {0};
 static int use_wayland;
+
+#ifdef AML_MOCK_AMCODEC
+/* off-target (--enable-mock-amcodec) builds resolve every path under
+ * $AML_SYSFS_ROOT, creating directories on write, so the plugins and the
+ * stand-in libamcodec share one virtual /sys tree */
+static const char *sysfs_path(const char *path, char *buf, int size, int create)
+{
+    const char *root = getenv("AML_SYSFS_ROOT");
+    char *p;
+
+    if (!root || !*root)
+        return path;
+    snprintf(buf, size, "%s%s", root, path);
+    if (create) {
+        for (p = strchr(buf + 1, '/'); p; p = strchr(p + 1, '/')) {
+            *p = '\0';
+            mkdir(buf, 0755);
+            *p = '/';
+        }
+    }
+    return buf;
+}
+#else
+static inline const char *sysfs_path(const char *path, char *buf, int size, int create)
+{
+    return path;
+}
+#endif
+
 int set_sysfs_str(const char *path, const char *val)
 {
     int fd;
     int bytes;
-    fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    char pathbuf[256];
+    fd = open(sysfs_path(path, pathbuf, sizeof(pathbuf), 1), O_CREAT | O_RDWR | O_TRUNC, 0644);
     if (fd >= 0) {
         bytes = write(fd, val, strlen(val));
         close(fd);
@@ -25,7 +56,8 @@ int set_sysfs_str(const char *path, const char *val)
 int  get_sysfs_str(const char *path, char *valstr, int size)
 {
     int fd;
-    fd = open(path, O_RDONLY);
+    char pathbuf[256];
+    fd = open(sysfs_path(path, pathbuf, sizeof(pathbuf), 0), O_RDONLY);
     if (fd >= 0) {
         read(fd, valstr, size - 1);
         valstr[strlen(valstr)] = '\0';
@@ -43,7 +75,8 @@ int set_sysfs_int(const char *path, int val)
     int fd;
     int bytes;
     char  bcmd[16];
-    fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    char pathbuf[256];
+    fd = open(sysfs_path(path, pathbuf, sizeof(pathbuf), 1), O_CREAT | O_RDWR | O_TRUNC, 0644);
     if (fd >= 0) {
         sprintf(bcmd, "%d", val);
         bytes = write(fd, bcmd, strlen(bcmd));
@@ -57,7 +90,8 @@ int get_sysfs_int(const char *path)
     int fd;
     int val = 0;
     char  bcmd[16];
-    fd = open(path, O_RDONLY);
+    char pathbuf[256];
+    fd = open(sysfs_path(path, pathbuf, sizeof(pathbuf), 0), O_RDONLY);
     if (fd >= 0) {
         read(fd, bcmd, sizeof(bcmd));
         val = strtol(bcmd, NULL, 16);
@@ -217,7 +251,8 @@ int set_display_axis(int recovery)
     char *path = "/sys/class/display/axis";
     char str[128];
     int count, i;
-    fd = open(path, O_CREAT|O_RDWR | O_TRUNC, 0644);
+    char pathbuf[256];
+    fd = open(sysfs_path(path, pathbuf, sizeof(pathbuf), 1), O_CREAT|O_RDWR | O_TRUNC, 0644);
     if (fd >= 0) {
         if (!recovery) {
             read(fd, str, 128);
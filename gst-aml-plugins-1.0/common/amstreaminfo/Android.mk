@@ -27,7 +27,9 @@ LOCAL_C_INCLUDES += \
 	$(AMPLAYER_APK_DIR)/amffmpeg/
 	
         
-LOCAL_SRC_FILES := amlstreaminfo.c amlutils.c
+LOCAL_SRC_FILES := amlstreaminfo.c amlutils.c amlescapture.c amldumpring.c amlwait.c amlclock.c \
+	../amlsysctl/gstamlsysctl.c
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../amlsysctl
 
 #LOCAL_STATIC_LIBRARIES +=
 #LOCAL_SHARED_LIBRARIES += libsme_generic libsme_mediautils
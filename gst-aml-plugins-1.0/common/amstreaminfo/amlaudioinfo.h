@@ -363,6 +363,8 @@ typedef struct{
     AmlAudioInfo audioinfo;
     gint version;
     GstBuffer *headerbuf;
+    guint8 adts[ADTS_HEADER_SIZE];  /* configdata as ADTS, length patched per frame */
+    gboolean has_adts;
 }AmlAinfoMpeg;
 
 typedef struct{
@@ -0,0 +1,230 @@
+/*
+ * amlclock.c
+ *
+ * tsync PCR clock, see amlclock.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "amlclock.h"
+#include "gstamlsysctl.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_aml_clock_debug);
+#define GST_CAT_DEFAULT gst_aml_clock_debug
+
+static void gst_aml_clock_class_init(GstAmlClockClass *klass);
+static void gst_aml_clock_init(GstAmlClock *clock);
+static gpointer parent_class;
+
+/* the autotools build compiles this file into each sink plugin, each
+ * with its own type name; Android links the one copy in libamlstreaminfo */
+#ifndef AML_CLOCK_TYPE_NAME
+#define AML_CLOCK_TYPE_NAME "GstAmlClock"
+#endif
+
+GType
+gst_aml_clock_get_type (void)
+{
+    static gsize type = 0;
+
+    if (g_once_init_enter(&type)) {
+        GType t = g_type_register_static_simple(GST_TYPE_SYSTEM_CLOCK,
+                g_intern_static_string(AML_CLOCK_TYPE_NAME),
+                sizeof(GstAmlClockClass),
+                (GClassInitFunc) gst_aml_clock_class_init,
+                sizeof(GstAmlClock),
+                (GInstanceInitFunc) gst_aml_clock_init, 0);
+        g_once_init_leave(&type, t);
+    }
+    return type;
+}
+
+static GstClockTime
+aml_clock_monotonic (void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return GST_TIMESPEC_TO_TIME(ts);
+}
+
+/* PCR in ns on a 64 bit time line, NONE while tsync has none; 0 and 1
+ * are what tsync reports when it is not running */
+static GstClockTime
+aml_clock_read_pcr (GstAmlClock *self)
+{
+    char buf[16];
+    guint32 pcr;
+
+    memset(buf, 0, sizeof(buf));
+    if (get_sysfs_str(AML_CLOCK_PCR_PATH, buf, sizeof(buf)) < 0)
+        return GST_CLOCK_TIME_NONE;
+    pcr = strtoul(buf, NULL, 16);
+    if (pcr <= 1)
+        return GST_CLOCK_TIME_NONE;
+
+    /* the counter wraps after 2^32 ticks, about 13 hours */
+    if (self->have_pcr && pcr < self->pcr && self->pcr - pcr > G_MAXUINT32 / 2)
+        self->pcr_wraps++;
+    self->pcr = pcr;
+    return gst_util_uint64_scale(((guint64) self->pcr_wraps << 32) | pcr,
+            GST_SECOND, 90000);
+}
+
+static GstClockTime
+gst_aml_clock_get_internal_time (GstClock *clock)
+{
+    GstAmlClock *self = GST_AML_CLOCK(clock);
+    GstClockTime mono = aml_clock_monotonic();
+    GstClockTime now, pcr;
+
+    g_mutex_lock(&self->lock);
+    /* a PCR standing still, paused, holds the clock */
+    now = self->read_time;
+    if (self->moving)
+        now += mono - self->read_mono;
+    if (mono - self->read_mono >= AML_CLOCK_READ_INTERVAL) {
+        guint32 last_pcr = self->pcr;
+        gboolean had_pcr = self->have_pcr;
+        GstClockTimeDiff diff;
+
+        pcr = aml_clock_read_pcr(self);
+        if (GST_CLOCK_TIME_IS_VALID(pcr)) {
+            self->moving = !had_pcr || self->pcr != last_pcr;
+            diff = (GstClockTimeDiff) (pcr + self->offset) - (GstClockTimeDiff) now;
+
+            if (!self->have_pcr || ABS(diff) > AML_CLOCK_RESYNC) {
+                GST_DEBUG_OBJECT(self, "PCR %" GST_TIME_FORMAT " resync, off by %"
+                        G_GINT64_FORMAT, GST_TIME_ARGS(pcr), diff);
+                self->offset = (GstClockTimeDiff) now - (GstClockTimeDiff) pcr;
+                self->have_pcr = TRUE;
+            }
+            now = pcr + self->offset;
+        } else {
+            self->have_pcr = FALSE;
+            self->moving = TRUE;
+        }
+        self->read_mono = mono;
+        self->read_time = now;
+    }
+    now = MAX(now, self->last);
+    self->last = now;
+    g_mutex_unlock(&self->lock);
+
+    return now;
+}
+
+static void
+gst_aml_clock_finalize (GObject *object)
+{
+    GstAmlClock *self = GST_AML_CLOCK(object);
+
+    g_mutex_clear(&self->lock);
+    G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void
+gst_aml_clock_class_init (GstAmlClockClass *klass)
+{
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    GstClockClass *clock_class = (GstClockClass *) klass;
+
+    parent_class = g_type_class_peek_parent(klass);
+    gobject_class->finalize = gst_aml_clock_finalize;
+    clock_class->get_internal_time = gst_aml_clock_get_internal_time;
+
+    GST_DEBUG_CATEGORY_INIT(gst_aml_clock_debug, "amlclock", 0,
+            "Amlogic tsync PCR clock");
+}
+
+static void
+gst_aml_clock_init (GstAmlClock *clock)
+{
+    g_mutex_init(&clock->lock);
+    /* starts out as the monotonic system clock */
+    clock->read_mono = clock->read_time = aml_clock_monotonic();
+    clock->last = 0;
+    clock->offset = 0;
+    clock->have_pcr = FALSE;
+    clock->moving = TRUE;
+    clock->pcr = 0;
+    clock->pcr_wraps = 0;
+}
+
+typedef struct {
+    GMutex lock;
+    GstClockTime mono;      /* CLOCK_MONOTONIC of the sample, 0: none yet */
+    gboolean valid;
+    gboolean moving;        /* PCR advanced since the sample before */
+    guint32 pcr;
+} AmlPcrCache;
+
+/* one cache per copy of this file: shared by all sinks of a plugin,
+ * by both sinks where they link libamlstreaminfo */
+static AmlPcrCache *
+aml_pcr_cache (void)
+{
+    static AmlPcrCache *cache = NULL;
+
+    if (g_once_init_enter(&cache)) {
+        AmlPcrCache *c = g_new0(AmlPcrCache, 1);
+
+        g_mutex_init(&c->lock);
+        g_once_init_leave(&cache, c);
+    }
+    return cache;
+}
+
+/* position for the segment rate and the media_gst_rate trick rate. In
+ * reverse playback tsync counts the complement of the 32 bit pts; the
+ * PCR is taken to run at the segment speed between samples unless it
+ * stood still across the last two. */
+gboolean
+amlPositionGet (gdouble rate, gdouble trick_rate, GstClockTime *position)
+{
+    AmlPcrCache *cache = aml_pcr_cache();
+    GstClockTime mono = aml_clock_monotonic();
+    GstClockTime pos;
+    guint32 pcr;
+
+    g_mutex_lock(&cache->lock);
+    if (!cache->mono || mono - cache->mono >= AML_POSITION_INTERVAL) {
+        char buf[16];
+
+        memset(buf, 0, sizeof(buf));
+        pcr = get_sysfs_str(AML_CLOCK_PCR_PATH, buf, sizeof(buf)) < 0
+                ? 0 : strtoul(buf, NULL, 16);
+        cache->moving = cache->valid && pcr != cache->pcr;
+        cache->valid = pcr > 1;
+        cache->pcr = pcr;
+        cache->mono = mono;
+    }
+    if (!cache->valid) {
+        g_mutex_unlock(&cache->lock);
+        return FALSE;
+    }
+    pcr = cache->pcr;
+    if (cache->moving)
+        pcr += (guint32) gst_util_uint64_scale(mono - cache->mono,
+                (guint64) (ABS(rate) * 90000), GST_SECOND);
+    g_mutex_unlock(&cache->lock);
+
+    if (rate < 0.0)
+        pcr = ~pcr;
+    pos = gst_util_uint64_scale(pcr, GST_SECOND, 90000);
+    if (trick_rate > 0.0 && trick_rate != 1.0)
+        pos = pos * trick_rate;
+    *position = pos;
+    return TRUE;
+}
+
+GstClock *
+gst_aml_clock_new (const gchar *name)
+{
+    GstClock *clock = g_object_new(GST_TYPE_AML_CLOCK, "name", name,
+            "clock-type", GST_CLOCK_TYPE_MONOTONIC, NULL);
+
+    gst_object_ref_sink(clock);
+    return clock;
+}
@@ -0,0 +1,61 @@
+/*
+ * amlclock.h
+ *
+ * GstClock running on the tsync PCR (/sys/class/tsync/pts_pcrscr), the
+ * time the display and audio output actually present at. The counter
+ * is read at most every AML_CLOCK_READ_INTERVAL; in between, and while
+ * tsync has no PCR, the time is extrapolated with CLOCK_MONOTONIC unless
+ * the last two reads returned the same PCR (paused). It never goes
+ * backwards: a PCR behind the extrapolation holds the clock until it
+ * catches up.
+ *
+ * amlPositionGet() answers position queries from a PCR sample shared by
+ * the sinks linking this copy, taken at most every AML_POSITION_INTERVAL
+ * and extrapolated in between.
+ */
+
+#ifndef __AML_CLOCK_H__
+#define __AML_CLOCK_H__
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_AML_CLOCK \
+  (gst_aml_clock_get_type())
+#define GST_AML_CLOCK(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_AML_CLOCK,GstAmlClock))
+
+#define AML_CLOCK_PCR_PATH          "/sys/class/tsync/pts_pcrscr"
+#define AML_CLOCK_READ_INTERVAL     (20 * GST_MSECOND)
+/* PCR steps further than this from the extrapolation are a new stream
+ * or a seek: the clock follows the PCR rate from where it is */
+#define AML_CLOCK_RESYNC            (GST_SECOND)
+#define AML_POSITION_INTERVAL       (50 * GST_MSECOND)
+
+typedef struct _GstAmlClock GstAmlClock;
+typedef struct _GstAmlClockClass GstAmlClockClass;
+
+struct _GstAmlClock {
+  GstSystemClock parent;
+  GMutex lock;
+  GstClockTime read_mono;   /* CLOCK_MONOTONIC of the last PCR read */
+  GstClockTime read_time;   /* clock time at read_mono */
+  GstClockTime last;        /* last time handed out */
+  GstClockTimeDiff offset;  /* clock time - PCR time */
+  gboolean have_pcr;
+  gboolean moving;          /* PCR advanced across the last two reads */
+  guint32 pcr;              /* last PCR read, 90kHz */
+  guint64 pcr_wraps;        /* 2^32 PCR ticks passed */
+};
+
+struct _GstAmlClockClass {
+  GstSystemClockClass parent_class;
+};
+
+GType gst_aml_clock_get_type(void);
+GstClock *gst_aml_clock_new(const gchar *name);
+gboolean amlPositionGet(gdouble rate, gdouble trick_rate, GstClockTime *position);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * amldumpring.c
+ *
+ * In-memory capture ring, see amldumpring.h.
+ *
+ * Entries are stored exactly as amlescapture lays them out in a file, an
+ * AmlEsRecord followed by the payload padded to 8 bytes, so an ES dump
+ * is the snapshot written in one go. Entries may wrap around the end of
+ * the buffer; the snapshot is linearized oldest first.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "amldumpring.h"
+
+struct _AmlDumpRing {
+    guint8 *buf;
+    gsize size;
+    gsize head;                 /* offset of the oldest entry */
+    gsize used;
+    GMutex lock;
+};
+
+typedef struct {
+    gchar *location;
+    AmlDumpFormat format;
+    guint8 *head;
+    gsize head_size;
+    guint8 *data;
+    gsize size;
+} AmlDumpJob;
+
+/* one snapshot in flight per process, bounds the memory a burst of
+ * dump requests can pin */
+static gint aml_dump_pending;
+
+static void aml_ring_copy_in(AmlDumpRing *ring, gsize offset, const void *data, gsize size)
+{
+    gsize first = MIN(size, ring->size - offset);
+
+    memcpy(ring->buf + offset, data, first);
+    if (size > first)
+        memcpy(ring->buf, (const guint8 *) data + first, size - first);
+}
+
+static void aml_ring_copy_out(AmlDumpRing *ring, gsize offset, void *data, gsize size)
+{
+    gsize first = MIN(size, ring->size - offset);
+
+    memcpy(data, ring->buf + offset, first);
+    if (size > first)
+        memcpy((guint8 *) data + first, ring->buf, size - first);
+}
+
+static gsize aml_ring_entry_size(guint32 size)
+{
+    return sizeof(AmlEsRecord) + AML_ES_ALIGN((gsize) size);
+}
+
+AmlDumpRing *amlDumpRingNew(gsize size)
+{
+    AmlDumpRing *ring;
+
+    size &= ~(gsize) 7;
+    if (size < sizeof(AmlEsRecord))
+        return NULL;
+    ring = g_new0(AmlDumpRing, 1);
+    ring->buf = g_try_malloc(size);
+    if (!ring->buf) {
+        GST_ERROR("no memory for a %" G_GSIZE_FORMAT " byte dump ring", size);
+        g_free(ring);
+        return NULL;
+    }
+    ring->size = size;
+    g_mutex_init(&ring->lock);
+    return ring;
+}
+
+/* a dump being written holds its own snapshot, nothing to wait for */
+void amlDumpRingFree(AmlDumpRing *ring)
+{
+    if (!ring)
+        return;
+    g_mutex_clear(&ring->lock);
+    g_free(ring->buf);
+    g_free(ring);
+}
+
+gsize amlDumpRingSize(AmlDumpRing *ring)
+{
+    return ring ? ring->size : 0;
+}
+
+void amlDumpRingClear(AmlDumpRing *ring)
+{
+    if (!ring)
+        return;
+    g_mutex_lock(&ring->lock);
+    ring->head = ring->used = 0;
+    g_mutex_unlock(&ring->lock);
+}
+
+void amlDumpRingPush(AmlDumpRing *ring, const AmlEsRecord *record, const void *payload)
+{
+    static const guint8 zero[8];
+    guint32 size = GUINT32_FROM_LE(record->size);
+    gsize entry = aml_ring_entry_size(size);
+    gsize tail;
+
+    if (!ring || entry > ring->size)
+        return;
+
+    g_mutex_lock(&ring->lock);
+    while (ring->size - ring->used < entry) {
+        AmlEsRecord oldest;
+        gsize oldest_size;
+
+        aml_ring_copy_out(ring, ring->head, &oldest, sizeof(oldest));
+        oldest_size = aml_ring_entry_size(GUINT32_FROM_LE(oldest.size));
+        ring->head = (ring->head + oldest_size) % ring->size;
+        ring->used -= oldest_size;
+    }
+    tail = (ring->head + ring->used) % ring->size;
+    aml_ring_copy_in(ring, tail, record, sizeof(*record));
+    tail = (tail + sizeof(*record)) % ring->size;
+    if (size > 0)
+        aml_ring_copy_in(ring, tail, payload, size);
+    if (AML_ES_ALIGN((gsize) size) != size)
+        aml_ring_copy_in(ring, (tail + size) % ring->size, zero, AML_ES_ALIGN((gsize) size) - size);
+    ring->used += entry;
+    g_mutex_unlock(&ring->lock);
+}
+
+static void aml_dump_job_free(AmlDumpJob *job)
+{
+    g_free(job->location);
+    g_free(job->head);
+    g_free(job->data);
+    g_free(job);
+}
+
+static gpointer aml_dump_thread(gpointer data)
+{
+    AmlDumpJob *job = data;
+    gsize offset, records = 0;
+    FILE *fp;
+
+    fp = fopen(job->location, "wb");
+    if (!fp) {
+        GST_ERROR("could not open dump file %s", job->location);
+        goto done;
+    }
+    if (job->head_size > 0)
+        fwrite(job->head, 1, job->head_size, fp);
+
+    for (offset = 0; offset + sizeof(AmlEsRecord) <= job->size; records++) {
+        const AmlEsRecord *record = (const AmlEsRecord *) (job->data + offset);
+        guint32 size = GUINT32_FROM_LE(record->size);
+
+        if (job->format == AML_DUMP_RAW && size > 0)
+            fwrite(job->data + offset + sizeof(*record), 1, size, fp);
+        offset += aml_ring_entry_size(size);
+    }
+    if (job->format == AML_DUMP_RECORDS)
+        fwrite(job->data, 1, job->size, fp);
+
+    if (fclose(fp) != 0)
+        GST_ERROR("writing dump file %s failed", job->location);
+    else
+        GST_INFO("dumped %" G_GSIZE_FORMAT " records (%" G_GSIZE_FORMAT " bytes) to %s",
+                records, job->size, job->location);
+
+done:
+    aml_dump_job_free(job);
+    g_atomic_int_set(&aml_dump_pending, 0);
+    return NULL;
+}
+
+gboolean amlDumpRingDump(AmlDumpRing *ring, const gchar *location, AmlDumpFormat format,
+        const void *head, gsize head_size)
+{
+    AmlDumpJob *job;
+    GThread *thread;
+    GError *error = NULL;
+
+    if (!ring || !location)
+        return FALSE;
+    if (!g_atomic_int_compare_and_exchange(&aml_dump_pending, 0, 1)) {
+        GST_WARNING("a dump is still being written, %s skipped", location);
+        return FALSE;
+    }
+
+    job = g_new0(AmlDumpJob, 1);
+    job->location = g_strdup(location);
+    job->format = format;
+    job->head = g_memdup(head, head_size);
+    job->head_size = head ? head_size : 0;
+
+    g_mutex_lock(&ring->lock);
+    job->size = ring->used;
+    job->data = g_try_malloc(MAX(job->size, 1));
+    if (job->data)
+        aml_ring_copy_out(ring, ring->head, job->data, job->size);
+    g_mutex_unlock(&ring->lock);
+
+    if (!job->data) {
+        GST_ERROR("no memory for a %" G_GSIZE_FORMAT " byte dump snapshot", job->size);
+        goto fail;
+    }
+
+    thread = g_thread_try_new("amldump", aml_dump_thread, job, &error);
+    if (!thread) {
+        GST_ERROR("could not start the dump thread: %s", error->message);
+        g_error_free(error);
+        goto fail;
+    }
+    g_thread_unref(thread);
+    return TRUE;
+
+fail:
+    aml_dump_job_free(job);
+    g_atomic_int_set(&aml_dump_pending, 0);
+    return FALSE;
+}
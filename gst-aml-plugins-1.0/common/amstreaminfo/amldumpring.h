@@ -0,0 +1,33 @@
+/*
+ * amldumpring.h
+ *
+ * Fixed size in-memory ring of AmlEsRecord framed payloads, oldest
+ * records evicted first. Pushing is a memcpy under a mutex; nothing
+ * touches the disk until a dump is requested, which snapshots the ring
+ * and writes it from a one-shot thread.
+ */
+
+#ifndef __AML_DUMPRING_H__
+#define __AML_DUMPRING_H__
+#include <gst/gst.h>
+#include "amlescapture.h"
+
+typedef struct _AmlDumpRing AmlDumpRing;
+
+typedef enum {
+    AML_DUMP_RECORDS,           /* AmlEsRecord + padded payload, as amlescapture writes them */
+    AML_DUMP_RAW,               /* payloads only, back to back */
+} AmlDumpFormat;
+
+AmlDumpRing *amlDumpRingNew(gsize size);
+void amlDumpRingFree(AmlDumpRing *ring);
+gsize amlDumpRingSize(AmlDumpRing *ring);
+void amlDumpRingClear(AmlDumpRing *ring);
+/* record is in file byte order, its size payload bytes are copied after it;
+ * records larger than the ring are dropped */
+void amlDumpRingPush(AmlDumpRing *ring, const AmlEsRecord *record, const void *payload);
+/* head (may be NULL) is written before the records; FALSE if a dump is still being written */
+gboolean amlDumpRingDump(AmlDumpRing *ring, const gchar *location, AmlDumpFormat format,
+        const void *head, gsize head_size);
+
+#endif
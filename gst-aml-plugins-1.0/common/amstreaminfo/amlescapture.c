@@ -0,0 +1,250 @@
+/*
+ * amlescapture.c
+ *
+ * Writer and mmap reader for the amlvdec/amladec elementary stream
+ * capture format, see amlescapture.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "amlescapture.h"
+#include "amldumpring.h"
+
+#define AML_ES_CAPTURE_BUFSIZE  (256 * 1024)
+
+struct _AmlEsCapture {
+    FILE *fp;                   /* NULL when only the ring is kept */
+    gchar *buf;
+    AmlDumpRing *ring;
+    guint8 *head;               /* file header and caps, written first by a dump */
+    gsize head_size;
+    gint64 start;
+    GMutex lock;
+};
+
+static const guint8 aml_es_zero[8];
+
+static void aml_es_write_padded(FILE *fp, const void *data, gsize size)
+{
+    if (size > 0)
+        fwrite(data, 1, size, fp);
+    if (AML_ES_ALIGN(size) != size)
+        fwrite(aml_es_zero, 1, AML_ES_ALIGN(size) - size, fp);
+}
+
+static void aml_es_write_record(AmlEsCapture *capture, AmlEsRecordType type,
+        const void *data, gsize size, guint64 pts, GstClockTime timestamp)
+{
+    AmlEsRecord record;
+
+    record.type = GUINT32_TO_LE(type);
+    record.size = GUINT32_TO_LE((guint32) size);
+    record.time = GUINT64_TO_LE((g_get_monotonic_time() - capture->start) * GST_USECOND);
+    record.pts = GUINT64_TO_LE(pts);
+    record.timestamp = GUINT64_TO_LE(timestamp);
+
+    amlDumpRingPush(capture->ring, &record, data);
+    if (!capture->fp)
+        return;
+    g_mutex_lock(&capture->lock);
+    fwrite(&record, 1, sizeof(record), capture->fp);
+    aml_es_write_padded(capture->fp, data, size);
+    g_mutex_unlock(&capture->lock);
+}
+
+AmlEsCapture *amlEsCaptureNew(const gchar *location, gsize ring_size,
+        AmlEsStreamType type, const GstCaps *caps)
+{
+    AmlEsCapture *capture;
+    AmlEsFileHeader header;
+    gchar *caps_str;
+    gsize caps_len;
+    FILE *fp = NULL;
+    AmlDumpRing *ring = NULL;
+
+    if (location) {
+        fp = fopen(location, "wb");
+        if (!fp) {
+            GST_ERROR("could not open capture file %s", location);
+            return NULL;
+        }
+    }
+    if (ring_size > 0) {
+        ring = amlDumpRingNew(ring_size);
+        if (!ring && !fp)
+            return NULL;
+    }
+    if (!fp && !ring)
+        return NULL;
+
+    capture = g_new0(AmlEsCapture, 1);
+    capture->fp = fp;
+    capture->ring = ring;
+    if (fp) {
+        capture->buf = g_malloc(AML_ES_CAPTURE_BUFSIZE);
+        setvbuf(fp, capture->buf, _IOFBF, AML_ES_CAPTURE_BUFSIZE);
+    }
+    g_mutex_init(&capture->lock);
+    capture->start = g_get_monotonic_time();
+
+    caps_str = caps ? gst_caps_to_string(caps) : g_strdup("");
+    caps_len = strlen(caps_str) + 1;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AML_ES_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = GUINT32_TO_LE(AML_ES_CAPTURE_VERSION);
+    header.stream_type = GUINT32_TO_LE(type);
+    header.caps_len = GUINT32_TO_LE(caps_len);
+    capture->head_size = sizeof(header) + AML_ES_ALIGN(caps_len);
+    capture->head = g_malloc0(capture->head_size);
+    memcpy(capture->head, &header, sizeof(header));
+    memcpy(capture->head + sizeof(header), caps_str, caps_len);
+    g_free(caps_str);
+    if (fp)
+        fwrite(capture->head, 1, capture->head_size, fp);
+
+    if (fp)
+        GST_INFO("capturing %s stream to %s", type == AML_ES_STREAM_VIDEO ? "video" : "audio", location);
+    if (ring)
+        GST_INFO("keeping the last %" G_GSIZE_FORMAT " bytes of the %s stream",
+                amlDumpRingSize(ring), type == AML_ES_STREAM_VIDEO ? "video" : "audio");
+    return capture;
+}
+
+AmlEsCapture *amlEsCaptureOpen(const gchar *location, AmlEsStreamType type, const GstCaps *caps)
+{
+    return amlEsCaptureNew(location, 0, type, caps);
+}
+
+void amlEsCaptureClose(AmlEsCapture *capture)
+{
+    if (!capture)
+        return;
+    if (capture->fp)
+        fclose(capture->fp);
+    amlDumpRingFree(capture->ring);
+    g_free(capture->head);
+    g_free(capture->buf);
+    g_mutex_clear(&capture->lock);
+    g_free(capture);
+}
+
+/* the ring as a capture file amlesrc can replay; it starts wherever the
+ * ring was cut, so the decoder may need a few frames to resync */
+gboolean amlEsCaptureDump(AmlEsCapture *capture, const gchar *location)
+{
+    if (!capture || !capture->ring) {
+        GST_WARNING("no capture ring to dump to %s", location);
+        return FALSE;
+    }
+    return amlDumpRingDump(capture->ring, location, AML_DUMP_RECORDS,
+            capture->head, capture->head_size);
+}
+
+void amlEsCaptureWrite(AmlEsCapture *capture, AmlEsRecordType type, const void *data, gsize size)
+{
+    if (!capture || size == 0)
+        return;
+    aml_es_write_record(capture, type, data, size, 0, GST_CLOCK_TIME_NONE);
+}
+
+void amlEsCapturePts(AmlEsCapture *capture, guint64 pts, GstClockTime timestamp)
+{
+    if (!capture)
+        return;
+    aml_es_write_record(capture, AML_ES_RECORD_PTS, NULL, 0, pts, timestamp);
+}
+
+void amlEsCaptureFlush(AmlEsCapture *capture)
+{
+    if (!capture)
+        return;
+    aml_es_write_record(capture, AML_ES_RECORD_FLUSH, NULL, 0, 0, GST_CLOCK_TIME_NONE);
+    if (!capture->fp)
+        return;
+    g_mutex_lock(&capture->lock);
+    fflush(capture->fp);
+    g_mutex_unlock(&capture->lock);
+}
+
+gboolean amlEsReaderOpen(AmlEsReader *reader, const gchar *location, GError **error)
+{
+    const AmlEsFileHeader *header;
+    guint32 caps_len;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->file = g_mapped_file_new(location, FALSE, error);
+    if (!reader->file)
+        return FALSE;
+    reader->data = (const guint8 *) g_mapped_file_get_contents(reader->file);
+    reader->size = g_mapped_file_get_length(reader->file);
+
+    header = (const AmlEsFileHeader *) reader->data;
+    if (reader->size < sizeof(*header)
+            || memcmp(header->magic, AML_ES_CAPTURE_MAGIC, sizeof(header->magic))
+            || GUINT32_FROM_LE(header->version) != AML_ES_CAPTURE_VERSION) {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s is not an amlogic ES capture", location);
+        goto fail;
+    }
+    caps_len = GUINT32_FROM_LE(header->caps_len);
+    if (caps_len == 0 || sizeof(*header) + AML_ES_ALIGN(caps_len) > reader->size
+            || reader->data[sizeof(*header) + caps_len - 1] != '\0') {
+        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s has a truncated header", location);
+        goto fail;
+    }
+
+    reader->stream_type = GUINT32_FROM_LE(header->stream_type);
+    reader->caps = (const gchar *) reader->data + sizeof(*header);
+    reader->records = sizeof(*header) + AML_ES_ALIGN(caps_len);
+    reader->offset = reader->records;
+    return TRUE;
+
+fail:
+    g_mapped_file_unref(reader->file);
+    reader->file = NULL;
+    return FALSE;
+}
+
+/* returns FALSE at the end of the file or on a truncated trailing record,
+ * which is what a capture cut short by a crash looks like */
+gboolean amlEsReaderPeek(AmlEsReader *reader, AmlEsRecord *record, const guint8 **payload)
+{
+    const AmlEsRecord *raw;
+
+    if (reader->offset + sizeof(*raw) > reader->size)
+        return FALSE;
+    raw = (const AmlEsRecord *) (reader->data + reader->offset);
+    record->type = GUINT32_FROM_LE(raw->type);
+    record->size = GUINT32_FROM_LE(raw->size);
+    record->time = GUINT64_FROM_LE(raw->time);
+    record->pts = GUINT64_FROM_LE(raw->pts);
+    record->timestamp = GUINT64_FROM_LE(raw->timestamp);
+    if (reader->offset + sizeof(*raw) + record->size > reader->size)
+        return FALSE;
+    if (payload)
+        *payload = reader->data + reader->offset + sizeof(*raw);
+    return TRUE;
+}
+
+void amlEsReaderSkip(AmlEsReader *reader)
+{
+    AmlEsRecord record;
+
+    if (amlEsReaderPeek(reader, &record, NULL))
+        reader->offset += sizeof(record) + AML_ES_ALIGN(record.size);
+    else
+        reader->offset = reader->size;
+}
+
+void amlEsReaderRewind(AmlEsReader *reader)
+{
+    reader->offset = reader->records;
+}
+
+void amlEsReaderClose(AmlEsReader *reader)
+{
+    if (reader->file)
+        g_mapped_file_unref(reader->file);
+    memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,82 @@
+/*
+ * amlescapture.h
+ *
+ * Elementary stream capture file: everything that went into codec_write,
+ * with the checked-in PTS, header injections and flush points, in a form
+ * that can be mmapped and replayed by amlesrc. The records can also be
+ * kept in a fixed size ring only and dumped on request, see amldumpring.h.
+ *
+ * Layout (little endian):
+ *   AmlEsFileHeader, caps string (NUL terminated, padded to 8 bytes),
+ *   then a sequence of AmlEsRecord, each followed by `size` payload bytes
+ *   padded to 8 bytes.
+ */
+
+#ifndef __AML_ESCAPTURE_H__
+#define __AML_ESCAPTURE_H__
+#include <gst/gst.h>
+
+#define AML_ES_CAPTURE_MAGIC     "AMLES\0\0\0"
+#define AML_ES_CAPTURE_VERSION   1
+#define AML_ES_ALIGN(x)          (((x) + 7) & ~7)
+
+typedef enum {
+    AML_ES_STREAM_VIDEO = 0,
+    AML_ES_STREAM_AUDIO = 1,
+} AmlEsStreamType;
+
+typedef enum {
+    AML_ES_RECORD_DATA = 0,     /* buffer payload written by the decoder */
+    AML_ES_RECORD_HEADER = 1,   /* header/startcode injected by AmlStreamInfo */
+    AML_ES_RECORD_PTS = 2,      /* codec_checkin_pts(), no payload */
+    AML_ES_RECORD_FLUSH = 3,    /* codec_reset(), no payload */
+} AmlEsRecordType;
+
+typedef struct {
+    gchar magic[8];
+    guint32 version;
+    guint32 stream_type;
+    guint32 caps_len;           /* including NUL, before padding */
+    guint32 reserved;
+} AmlEsFileHeader;
+
+typedef struct {
+    guint32 type;
+    guint32 size;               /* payload bytes, before padding */
+    guint64 time;               /* capture clock, ns since the file was opened */
+    guint64 pts;                /* 90kHz value handed to codec_checkin_pts */
+    guint64 timestamp;          /* GstClockTime the pts was derived from */
+} AmlEsRecord;
+
+typedef struct _AmlEsCapture AmlEsCapture;
+
+/* upper bound in MB of the decoders' dump-size property */
+#define AML_DUMP_SIZE_MAX        256
+
+/* location, ring_size or both; ring_size 0 means no ring */
+AmlEsCapture *amlEsCaptureNew(const gchar *location, gsize ring_size,
+        AmlEsStreamType type, const GstCaps *caps);
+AmlEsCapture *amlEsCaptureOpen(const gchar *location, AmlEsStreamType type, const GstCaps *caps);
+void amlEsCaptureClose(AmlEsCapture *capture);
+gboolean amlEsCaptureDump(AmlEsCapture *capture, const gchar *location);
+void amlEsCaptureWrite(AmlEsCapture *capture, AmlEsRecordType type, const void *data, gsize size);
+void amlEsCapturePts(AmlEsCapture *capture, guint64 pts, GstClockTime timestamp);
+void amlEsCaptureFlush(AmlEsCapture *capture);
+
+typedef struct {
+    GMappedFile *file;
+    const guint8 *data;
+    gsize size;
+    gsize offset;
+    gsize records;              /* offset of the first record */
+    AmlEsStreamType stream_type;
+    const gchar *caps;
+} AmlEsReader;
+
+gboolean amlEsReaderOpen(AmlEsReader *reader, const gchar *location, GError **error);
+gboolean amlEsReaderPeek(AmlEsReader *reader, AmlEsRecord *record, const guint8 **payload);
+void amlEsReaderSkip(AmlEsReader *reader);
+void amlEsReaderRewind(AmlEsReader *reader);
+void amlEsReaderClose(AmlEsReader *reader);
+
+#endif
@@ -17,7 +17,7 @@ int amlStreamInfoWriteHeader(AmlStreamInfo *info, codec_para_t *pcodec)
     guint8 *configbuf = map.data;
     gint configsize = map.size;
     if(configbuf && (configsize > 0)){
-        codec_write(pcodec, configbuf, configsize);
+        amlCodecWrite(pcodec, configbuf, configsize);
     }
     gst_buffer_unmap(info->configdata, &map);
     return 0;
@@ -29,6 +29,7 @@ AmlStreamInfo *createStreamInfo(gint size)
     info->init = NULL;
     info->writeheader = amlStreamInfoWriteHeader;
     info->add_startcode = NULL;
+    info->prefix = NULL;
     info->finalize = amlStreamInfoFinalize;
     info->configdata = NULL;
     return info;
@@ -62,21 +63,47 @@ AmlStreamInfo *amlStreamInfoInterface(gchar *format, AmlStreamInfoPool *amlStrea
     return info;
 }
 
+void amlCodecSetCapture(codec_para_t *pcodec, AmlEsCapture *capture)
+{
+    g_dataset_set_data(pcodec, "aml-es-capture", capture);
+}
+
+AmlEsCapture *amlCodecGetCapture(codec_para_t *pcodec)
+{
+    return g_dataset_get_data(pcodec, "aml-es-capture");
+}
+
+void amlCodecSetWait(codec_para_t *pcodec, AmlWait *wait)
+{
+    g_dataset_set_data(pcodec, "aml-wait", wait);
+}
+
+AmlWait *amlCodecGetWait(codec_para_t *pcodec)
+{
+    return g_dataset_get_data(pcodec, "aml-wait");
+}
+
+/* everything written through here is a header or startcode injection,
+ * so it goes to the capture as a HEADER record */
 int amlCodecWrite(codec_para_t *pcodec, void *data, int size)
 {
     int written = 0;
     int total = 0;
     int retry = 0;
+    AmlEsCapture *capture = amlCodecGetCapture(pcodec);
+    AmlWait *wait = amlCodecGetWait(pcodec);
     while (size > 0 && retry < 10) {
         written = codec_write(pcodec, data, size);
         if (written >= 0) {
+            amlEsCaptureWrite(capture, AML_ES_RECORD_HEADER, data, written);
             size -= written;
             data += written;
             total += written;
             retry = 0;
         } else if (errno == EAGAIN || errno == EINTR) {
             retry++;
-            usleep(20000);
+            if (!amlWaitSleep(wait, 20000))
+                break;
         } else {
             break;
         }
@@ -84,3 +111,58 @@ int amlCodecWrite(codec_para_t *pcodec, void *data, int size)
     return total;
 
 }
+
+#ifndef AML_MOCK_AMCODEC
+/* libamcodec has no vectored write, the ES device takes writev() on the
+ * handle codec_write() writes to */
+static int codec_writev(codec_para_t *pcodec, const struct iovec *iov, int iovcnt)
+{
+    return writev(pcodec->handle, iov, iovcnt);
+}
+#endif
+
+/* one vectored write for a batch of buffers or a header and its payload;
+ * types gives each vector's capture record, NULL for all DATA. A short
+ * write resumes inside the vector it stopped in. iovcnt stays within
+ * IOV_MAX. Returns the bytes written, less than asked for when flushing,
+ * when the wait's owner cancels a blocked write or on a write error.
+ * The microseconds from the first EAGAIN to the return are added to
+ * *stall, if given. */
+int amlCodecWritev(codec_para_t *pcodec, struct iovec *iov, int iovcnt, const AmlEsRecordType *types,
+        gint64 *stall)
+{
+    ssize_t written;
+    gsize n;
+    int total = 0;
+    int i = 0;
+    gint64 stall_start = 0;
+    AmlEsCapture *capture = amlCodecGetCapture(pcodec);
+    AmlWait *wait = amlCodecGetWait(pcodec);
+
+    while (i < iovcnt && !iov[i].iov_len)
+        i++;
+    while (i < iovcnt) {
+        written = codec_writev(pcodec, iov + i, iovcnt - i);
+        if (written < 0) {
+            if (!stall_start && (errno == EAGAIN || errno == EINTR))
+                stall_start = g_get_monotonic_time();
+            if ((errno == EAGAIN || errno == EINTR) && !amlWaitIsCancelled(wait)
+                    && amlWaitSleep(wait, 20000))
+                continue;
+            break;
+        }
+        total += written;
+        while (i < iovcnt && (written > 0 || !iov[i].iov_len)) {
+            n = MIN((gsize) written, iov[i].iov_len);
+            amlEsCaptureWrite(capture, types ? types[i] : AML_ES_RECORD_DATA, iov[i].iov_base, n);
+            iov[i].iov_base = (guint8 *) iov[i].iov_base + n;
+            iov[i].iov_len -= n;
+            written -= n;
+            if (!iov[i].iov_len)
+                i++;
+        }
+    }
+    if (stall && stall_start)
+        *stall += g_get_monotonic_time() - stall_start;
+    return total;
+}
@@ -2,11 +2,17 @@
 #ifndef __AML_STREAMINFO_H__
 #define __AML_STREAMINFO_H__
 #include <gst/gst.h>
+#include <sys/uio.h>
 //#include <player.h>
 #include "amlutils.h"
+#include "amlescapture.h"
+#include "amlwait.h"
 #include  <codec.h>
 #define AML_STREAMINFO_BASE(x) ((AmlStreamInfo *)(x))
 
+/* longest prefix() a stream info hands back */
+#define AML_PREFIX_MAX 16
+
 typedef enum{
      AmlStateNormal,
     AmlStateFastForward,
@@ -20,6 +26,9 @@ struct stAmlStreamInfo{
     gint (*init)(AmlStreamInfo* info, codec_para_t *pcodec, GstStructure  *structure); //pure virtual function
     gint (*writeheader)(AmlStreamInfo* info, codec_para_t *pcodec);
     gint (*add_startcode)(AmlStreamInfo* info, codec_para_t *pcodec, GstBuffer *buf); //pure virtual function
+    /* framing written in front of buf, in the same write as buf; returns
+     * its size, at most AML_PREFIX_MAX, 0 for none */
+    gint (*prefix)(AmlStreamInfo* info, GstBuffer *buf, guint8 *prefix);
     void (*finalize)(AmlStreamInfo* info);
 //protected:
     GstBuffer *configdata;
@@ -35,5 +44,11 @@ AmlStreamInfo *amlStreamInfoInterface(gchar *format, AmlStreamInfoPool *amlStrea
 AmlStreamInfo *createStreamInfo(gint size);
 void amlStreamInfoFinalize(AmlStreamInfo *info);
 int amlCodecWrite(codec_para_t *pcodec, void *data, int size);
+int amlCodecWritev(codec_para_t *pcodec, struct iovec *iov, int iovcnt, const AmlEsRecordType *types,
+        gint64 *stall);
+void amlCodecSetCapture(codec_para_t *pcodec, AmlEsCapture *capture);
+AmlEsCapture *amlCodecGetCapture(codec_para_t *pcodec);
+void amlCodecSetWait(codec_para_t *pcodec, AmlWait *wait);
+AmlWait *amlCodecGetWait(codec_para_t *pcodec);
 #endif
 
@@ -13,8 +13,6 @@
 	aml_dump_buffer(x, name, __FUNCTION__, __LINE__); \
 }
 
-#define DEBUG_DUMP 0
-
 void _gst_debug_dump_mem2 (GstDebugCategory * cat, const gchar * file,
     const gchar * func, gint line, GObject * obj, const gchar * msg,
     const guint8 * data, guint length);
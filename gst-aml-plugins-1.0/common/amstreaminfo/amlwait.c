@@ -0,0 +1,89 @@
+/*
+ * amlwait.c
+ *
+ * Interruptible sleep, see amlwait.h.
+ */
+
+#include <unistd.h>
+#include "amlwait.h"
+
+void amlWaitInit(AmlWait *wait)
+{
+    g_mutex_init(&wait->lock);
+    g_cond_init(&wait->cond);
+    wait->flushing = FALSE;
+    wait->cancel = NULL;
+    wait->cancel_data = NULL;
+}
+
+void amlWaitClear(AmlWait *wait)
+{
+    g_mutex_clear(&wait->lock);
+    g_cond_clear(&wait->cond);
+}
+
+void amlWaitSetFlushing(AmlWait *wait, gboolean flushing)
+{
+    g_mutex_lock(&wait->lock);
+    wait->flushing = flushing;
+    if (flushing)
+        g_cond_broadcast(&wait->cond);
+    g_mutex_unlock(&wait->lock);
+}
+
+gboolean amlWaitIsFlushing(AmlWait *wait)
+{
+    gboolean flushing;
+
+    if (!wait)
+        return FALSE;
+    g_mutex_lock(&wait->lock);
+    flushing = wait->flushing;
+    g_mutex_unlock(&wait->lock);
+    return flushing;
+}
+
+void amlWaitSetCancel(AmlWait *wait, AmlWaitCancelFunc cancel, gpointer user_data)
+{
+    wait->cancel = cancel;
+    wait->cancel_data = user_data;
+}
+
+/* TRUE if the owner wants a blocked write to give up, with what it has
+ * written so far; without a callback writes only stop for flushing */
+gboolean amlWaitIsCancelled(AmlWait *wait)
+{
+    if (!wait || !wait->cancel)
+        return FALSE;
+    return wait->cancel(wait->cancel_data);
+}
+
+/* cut the current sleep short without flushing, e.g. on pause so the
+ * sleeper re-checks its state right away */
+void amlWaitWake(AmlWait *wait)
+{
+    g_mutex_lock(&wait->lock);
+    g_cond_broadcast(&wait->cond);
+    g_mutex_unlock(&wait->lock);
+}
+
+/* sleeps up to usec, returns FALSE if flushing (already or meanwhile).
+ * Without an AmlWait this is a plain usleep. */
+gboolean amlWaitSleep(AmlWait *wait, gint64 usec)
+{
+    gboolean ret;
+    gint64 end;
+
+    if (!wait) {
+        usleep(usec);
+        return TRUE;
+    }
+    g_mutex_lock(&wait->lock);
+    if (!wait->flushing) {
+        end = g_get_monotonic_time() + usec;
+        g_cond_wait_until(&wait->cond, &wait->lock, end);
+    }
+    ret = !wait->flushing;
+    g_mutex_unlock(&wait->lock);
+    return ret;
+}
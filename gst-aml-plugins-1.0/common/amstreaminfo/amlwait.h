@@ -0,0 +1,36 @@
+/*
+ * amlwait.h
+ *
+ * Interruptible sleep for the loops that poll the amports buffers
+ * (vbuf/abuf watermark, codec_write EAGAIN retries). The owning element
+ * sets it flushing on FLUSH_START and on the way down to READY, which
+ * wakes every sleeper at once instead of letting it finish its retry
+ * or drain cycle. A write retry also asks the owner's cancel callback
+ * whether it is still worth waiting for room, e.g. not while paused and
+ * the buffer does not drain.
+ */
+
+#ifndef __AML_WAIT_H__
+#define __AML_WAIT_H__
+#include <gst/gst.h>
+
+typedef gboolean (*AmlWaitCancelFunc) (gpointer user_data);
+
+typedef struct {
+    GMutex lock;
+    GCond cond;
+    gboolean flushing;
+    AmlWaitCancelFunc cancel;   /* set once before the first write */
+    gpointer cancel_data;
+} AmlWait;
+
+void amlWaitInit(AmlWait *wait);
+void amlWaitClear(AmlWait *wait);
+void amlWaitSetFlushing(AmlWait *wait, gboolean flushing);
+gboolean amlWaitIsFlushing(AmlWait *wait);
+void amlWaitSetCancel(AmlWait *wait, AmlWaitCancelFunc cancel, gpointer user_data);
+gboolean amlWaitIsCancelled(AmlWait *wait);
+void amlWaitWake(AmlWait *wait);
+gboolean amlWaitSleep(AmlWait *wait, gint64 usec);
+
+#endif
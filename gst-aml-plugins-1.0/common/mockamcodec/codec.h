@@ -0,0 +1,193 @@
+/*
+ * Stand-in for the libamcodec public headers (codec.h, codec_type.h,
+ * codec_error.h), used when the tree is configured with
+ * --enable-mock-amcodec. Only what the plugins use is declared; the
+ * layouts follow the amcodec ones so the plugin sources build unchanged.
+ */
+
+#ifndef _AML_MOCK_CODEC_H_
+#define _AML_MOCK_CODEC_H_
+
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CODEC_ERROR_NONE        (0)
+#define CODEC_ERROR_INVAL       (-0x1003)
+#define CODEC_ERROR_NOMEM       (-0x1004)
+#define CODEC_ERROR_INIT_FAILED (-0x1006)
+
+#define AUDIO_EXTRA_DATA_SIZE   (4096)
+
+typedef int CODEC_HANDLE;
+
+typedef enum {
+    STREAM_TYPE_UNKNOW,
+    STREAM_TYPE_ES_VIDEO,
+    STREAM_TYPE_ES_AUDIO,
+    STREAM_TYPE_ES_SUB,
+    STREAM_TYPE_PS,
+    STREAM_TYPE_TS,
+    STREAM_TYPE_RM,
+} stream_type_t;
+
+typedef enum {
+    VFORMAT_UNKNOWN = -1,
+    VFORMAT_MPEG12 = 0,
+    VFORMAT_MPEG4,
+    VFORMAT_H264,
+    VFORMAT_MJPEG,
+    VFORMAT_REAL,
+    VFORMAT_JPEG,
+    VFORMAT_VC1,
+    VFORMAT_AVS,
+    VFORMAT_SW,
+    VFORMAT_H264MVC,
+    VFORMAT_H264_4K2K,
+    VFORMAT_HEVC,
+    VFORMAT_H264_ENC,
+    VFORMAT_JPEG_ENC,
+    VFORMAT_VP9,
+    VFORMAT_UNSUPPORT,
+} vformat_t;
+
+typedef enum {
+    AFORMAT_UNKNOWN = -1,
+    AFORMAT_MPEG = 0,
+    AFORMAT_PCM_S16LE,
+    AFORMAT_AAC,
+    AFORMAT_AC3,
+    AFORMAT_ALAW,
+    AFORMAT_MULAW,
+    AFORMAT_DTS,
+    AFORMAT_PCM_S16BE,
+    AFORMAT_FLAC,
+    AFORMAT_COOK,
+    AFORMAT_PCM_U8,
+    AFORMAT_ADPCM,
+    AFORMAT_AMR,
+    AFORMAT_RAAC,
+    AFORMAT_WMA,
+    AFORMAT_WMAPRO,
+    AFORMAT_PCM_BLURAY,
+    AFORMAT_ALAC,
+    AFORMAT_VORBIS,
+    AFORMAT_AAC_LATM,
+    AFORMAT_APE,
+    AFORMAT_EAC3,
+    AFORMAT_PCM_WIFIDISPLAY,
+    AFORMAT_DRA,
+    AFORMAT_SIPR,
+    AFORMAT_TRUEHD,
+    AFORMAT_MPEG1,
+    AFORMAT_MPEG2,
+    AFORMAT_WMAVOI,
+    AFORMAT_UNSUPPORT,
+} aformat_t;
+
+typedef enum {
+    VIDEO_DEC_FORMAT_UNKNOW,
+    VIDEO_DEC_FORMAT_MPEG4_3,
+    VIDEO_DEC_FORMAT_MPEG4_4,
+    VIDEO_DEC_FORMAT_MPEG4_5,
+    VIDEO_DEC_FORMAT_H264,
+    VIDEO_DEC_FORMAT_MJPEG,
+    VIDEO_DEC_FORMAT_MP4,
+    VIDEO_DEC_FORMAT_H263,
+    VIDEO_DEC_FORMAT_REAL_8,
+    VIDEO_DEC_FORMAT_REAL_9,
+    VIDEO_DEC_FORMAT_WMV3,
+    VIDEO_DEC_FORMAT_WVC1,
+    VIDEO_DEC_FORMAT_SW,
+    VIDEO_DEC_FORMAT_AVS,
+    VIDEO_DEC_FORMAT_H264_4K2K,
+    VIDEO_DEC_FORMAT_HEVC,
+    VIDEO_DEC_FORMAT_VP9,
+    VIDEO_DEC_FORMAT_MAX,
+} vdec_type_t;
+
+typedef struct {
+    unsigned int format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int rate;
+    unsigned int extra;
+    unsigned int status;
+    unsigned int ratio;
+    void *param;
+    unsigned long long ratio64;
+} dec_sysinfo_t;
+
+typedef struct {
+    int valid;
+    int sample_rate;
+    int channels;
+    int bitrate;
+    int codec_id;
+    int block_align;
+    int extradata_size;
+    char extradata[AUDIO_EXTRA_DATA_SIZE];
+} audio_info_t;
+
+struct buf_status {
+    int status;
+    int size;
+    int data_len;
+    int free_len;
+    unsigned int read_pointer;
+    unsigned int write_pointer;
+};
+
+typedef struct {
+    CODEC_HANDLE handle;        /* write end of the simulated ES buffer */
+    CODEC_HANDLE cntl_handle;
+    CODEC_HANDLE sub_handle;
+    CODEC_HANDLE audio_utils_handle;
+    stream_type_t stream_type;
+    unsigned int has_video: 1;
+    unsigned int has_audio: 1;
+    unsigned int has_sub: 1;
+    unsigned int noblock: 1;
+    int video_type;
+    int audio_type;
+    int sub_type;
+    int video_pid;
+    int audio_pid;
+    int sub_pid;
+    int audio_channels;
+    int audio_samplerate;
+    int vbuf_size;
+    int abuf_size;
+    dec_sysinfo_t am_sysinfo;
+    audio_info_t audio_info;
+    int packet_size;
+    void *adec_priv;
+    void *mock_priv;            /* simulated decoder state */
+} codec_para_t;
+
+int codec_init(codec_para_t *pcodec);
+int codec_close(codec_para_t *pcodec);
+int codec_reset(codec_para_t *pcodec);
+int codec_write(codec_para_t *pcodec, void *buffer, int len);
+/* not in libamcodec, amstreaminfo has its own for the real library */
+int codec_writev(codec_para_t *pcodec, const struct iovec *iov, int iovcnt);
+int codec_checkin_pts(codec_para_t *pcodec, unsigned long pts);
+int codec_get_vbuf_state(codec_para_t *pcodec, struct buf_status *buf);
+int codec_get_abuf_state(codec_para_t *pcodec, struct buf_status *buf);
+unsigned int codec_get_vpts(codec_para_t *pcodec);
+unsigned int codec_get_apts(codec_para_t *pcodec);
+int codec_pause(codec_para_t *pcodec);
+int codec_resume(codec_para_t *pcodec);
+int codec_set_pcrscr(codec_para_t *pcodec, int val);
+int codec_set_av_threshold(codec_para_t *pcodec, int threshold);
+int codec_audio_basic_init(void);
+
+int amsysfs_set_sysfs_str(const char *path, const char *val);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AML_MOCK_CODEC_H_ */
@@ -0,0 +1,447 @@
+/*
+ * Stand-in libamcodec for off-target builds (--enable-mock-amcodec).
+ *
+ * Each codec_init() gets a pipe that plays the hardware ES buffer: the
+ * plugins write into it through pcodec->handle exactly like into the
+ * amstream device, and a drain thread consumes it at a fixed byte rate.
+ * The pipe capacity bounds the buffer, so codec_write() sees EAGAIN when
+ * it is full. Checked-in PTS are queued against their stream offset and
+ * become the current vpts/apts once the drain thread reaches them; the
+ * current PTS is also published as tsync/pts_pcrscr in the sysfs tree.
+ *
+ * Tunables, all optional:
+ *   AML_MOCK_VBUF_SIZE / AML_MOCK_ABUF_SIZE    buffer size in bytes
+ *   AML_MOCK_VDRAIN_RATE / AML_MOCK_ADRAIN_RATE drain rate in bytes/s
+ *   AML_SYSFS_ROOT                              root of the virtual /sys
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "codec.h"
+
+#define MOCK_DEFAULT_VBUF_SIZE      (1024 * 1024)
+#define MOCK_DEFAULT_ABUF_SIZE      (256 * 1024)
+#define MOCK_DEFAULT_VDRAIN_RATE    (1024 * 1024)
+#define MOCK_DEFAULT_ADRAIN_RATE    (32 * 1024)
+#define MOCK_DRAIN_TICK_US          (5000)
+#define MOCK_PTS_QUEUE_SIZE         (4096)
+#define MOCK_PCR_PATH               "/sys/class/tsync/pts_pcrscr"
+
+typedef struct {
+    unsigned long long offset;
+    unsigned long pts;
+} mock_pts_t;
+
+typedef struct {
+    int rfd;
+    int size;
+    int rate;
+    int is_audio;
+    pthread_t drain_thread;
+    pthread_mutex_t lock;
+    int running;
+    int paused;
+    unsigned long long consumed;
+    mock_pts_t ptsq[MOCK_PTS_QUEUE_SIZE];
+    int pts_head;
+    int pts_count;
+    unsigned long cur_pts;
+} mock_codec_t;
+
+static pthread_mutex_t audio_lock = PTHREAD_MUTEX_INITIALIZER;
+static int audio_instances;
+
+static int env_int(const char *name, int def)
+{
+    const char *val = getenv(name);
+    int ret;
+
+    if (!val || !*val) {
+        return def;
+    }
+    ret = strtol(val, NULL, 0);
+    return ret > 0 ? ret : def;
+}
+
+static const char *mock_sysfs_path(const char *path, char *buf, int size, int create)
+{
+    const char *root = getenv("AML_SYSFS_ROOT");
+    char *p;
+
+    if (!root || !*root) {
+        return path;
+    }
+    snprintf(buf, size, "%s%s", root, path);
+    if (create) {
+        for (p = strchr(buf + 1, '/'); p; p = strchr(p + 1, '/')) {
+            *p = '\0';
+            mkdir(buf, 0755);
+            *p = '/';
+        }
+    }
+    return buf;
+}
+
+int amsysfs_set_sysfs_str(const char *path, const char *val)
+{
+    char pathbuf[512];
+    int fd, ret = -1;
+
+    fd = open(mock_sysfs_path(path, pathbuf, sizeof(pathbuf), 1),
+            O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd >= 0) {
+        if (write(fd, val, strlen(val)) >= 0) {
+            ret = 0;
+        }
+        close(fd);
+    }
+    return ret;
+}
+
+static void mock_publish_pcr(mock_codec_t *m, unsigned long pts)
+{
+    char val[32];
+    int has_audio;
+
+    /* with an audio stream around it is the tsync master */
+    pthread_mutex_lock(&audio_lock);
+    has_audio = audio_instances > 0;
+    pthread_mutex_unlock(&audio_lock);
+    if (m->is_audio || !has_audio) {
+        snprintf(val, sizeof(val), "0x%lx", pts);
+        amsysfs_set_sysfs_str(MOCK_PCR_PATH, val);
+    }
+}
+
+static int mock_queued(mock_codec_t *m)
+{
+    int len = 0;
+
+    if (ioctl(m->rfd, FIONREAD, &len) < 0) {
+        return 0;
+    }
+    return len;
+}
+
+/* caller holds m->lock */
+static int mock_advance_pts(mock_codec_t *m)
+{
+    int moved = 0;
+
+    while (m->pts_count > 0 && m->ptsq[m->pts_head].offset < m->consumed) {
+        m->cur_pts = m->ptsq[m->pts_head].pts;
+        m->pts_head = (m->pts_head + 1) % MOCK_PTS_QUEUE_SIZE;
+        m->pts_count--;
+        moved = 1;
+    }
+    return moved;
+}
+
+static long long mock_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void *mock_drain_loop(void *data)
+{
+    mock_codec_t *m = data;
+    char scratch[16384];
+    long long last = mock_now_us(), now;
+    double budget = 0;
+    int moved;
+    unsigned long pts;
+
+    while (1) {
+        usleep(MOCK_DRAIN_TICK_US);
+        now = mock_now_us();
+
+        pthread_mutex_lock(&m->lock);
+        if (!m->running) {
+            pthread_mutex_unlock(&m->lock);
+            break;
+        }
+        if (m->paused) {
+            budget = 0;
+        } else {
+            budget += (double)m->rate * (now - last) / 1000000.0;
+            while (budget >= 1) {
+                int want = budget > sizeof(scratch) ? (int)sizeof(scratch) : (int)budget;
+                int n = read(m->rfd, scratch, want);
+                if (n <= 0) {
+                    /* buffer ran dry, do not bank the unused rate */
+                    budget = 0;
+                    break;
+                }
+                m->consumed += n;
+                budget -= n;
+            }
+        }
+        last = now;
+        moved = mock_advance_pts(m);
+        pts = m->cur_pts;
+        pthread_mutex_unlock(&m->lock);
+
+        if (moved) {
+            mock_publish_pcr(m, pts);
+        }
+    }
+    return NULL;
+}
+
+int codec_audio_basic_init(void)
+{
+    return 0;
+}
+
+int codec_init(codec_para_t *pcodec)
+{
+    mock_codec_t *m;
+    int fds[2];
+    int is_audio = pcodec->stream_type == STREAM_TYPE_ES_AUDIO;
+
+    if (pcodec->mock_priv) {
+        return CODEC_ERROR_INIT_FAILED;
+    }
+    m = calloc(1, sizeof(*m));
+    if (!m) {
+        return CODEC_ERROR_NOMEM;
+    }
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        free(m);
+        return CODEC_ERROR_INIT_FAILED;
+    }
+
+    m->is_audio = is_audio;
+    if (is_audio) {
+        m->size = pcodec->abuf_size > 0 ? pcodec->abuf_size
+                  : env_int("AML_MOCK_ABUF_SIZE", MOCK_DEFAULT_ABUF_SIZE);
+        m->rate = env_int("AML_MOCK_ADRAIN_RATE", MOCK_DEFAULT_ADRAIN_RATE);
+    } else {
+        m->size = pcodec->vbuf_size > 0 ? pcodec->vbuf_size
+                  : env_int("AML_MOCK_VBUF_SIZE", MOCK_DEFAULT_VBUF_SIZE);
+        m->rate = env_int("AML_MOCK_VDRAIN_RATE", MOCK_DEFAULT_VDRAIN_RATE);
+    }
+    /* the kernel rounds up to pages and caps at pipe-max-size */
+    fcntl(fds[1], F_SETPIPE_SZ, m->size);
+    m->size = fcntl(fds[1], F_GETPIPE_SZ);
+
+    m->rfd = fds[0];
+    m->running = 1;
+    pthread_mutex_init(&m->lock, NULL);
+    if (pthread_create(&m->drain_thread, NULL, mock_drain_loop, m) != 0) {
+        pthread_mutex_destroy(&m->lock);
+        close(fds[0]);
+        close(fds[1]);
+        free(m);
+        return CODEC_ERROR_INIT_FAILED;
+    }
+
+    if (is_audio) {
+        pthread_mutex_lock(&audio_lock);
+        audio_instances++;
+        pthread_mutex_unlock(&audio_lock);
+    }
+
+    pcodec->handle = fds[1];
+    pcodec->cntl_handle = fds[1];
+    pcodec->mock_priv = m;
+    return CODEC_ERROR_NONE;
+}
+
+int codec_close(codec_para_t *pcodec)
+{
+    mock_codec_t *m = pcodec->mock_priv;
+
+    if (!m) {
+        return CODEC_ERROR_INVAL;
+    }
+    pthread_mutex_lock(&m->lock);
+    m->running = 0;
+    pthread_mutex_unlock(&m->lock);
+    pthread_join(m->drain_thread, NULL);
+
+    if (m->is_audio) {
+        pthread_mutex_lock(&audio_lock);
+        audio_instances--;
+        pthread_mutex_unlock(&audio_lock);
+    }
+
+    close(m->rfd);
+    close(pcodec->handle);
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+    pcodec->mock_priv = NULL;
+    pcodec->handle = -1;
+    pcodec->cntl_handle = -1;
+    return CODEC_ERROR_NONE;
+}
+
+int codec_reset(codec_para_t *pcodec)
+{
+    mock_codec_t *m = pcodec->mock_priv;
+    char scratch[16384];
+    int n;
+
+    if (!m) {
+        return CODEC_ERROR_INVAL;
+    }
+    pthread_mutex_lock(&m->lock);
+    while ((n = read(m->rfd, scratch, sizeof(scratch))) > 0) {
+        m->consumed += n;
+    }
+    m->pts_head = 0;
+    m->pts_count = 0;
+    m->cur_pts = 0;
+    pthread_mutex_unlock(&m->lock);
+    return CODEC_ERROR_NONE;
+}
+
+int codec_write(codec_para_t *pcodec, void *buffer, int len)
+{
+    if (!pcodec->mock_priv) {
+        errno = EINVAL;
+        return -1;
+    }
+    return write(pcodec->handle, buffer, len);
+}
+
+int codec_writev(codec_para_t *pcodec, const struct iovec *iov, int iovcnt)
+{
+    if (!pcodec->mock_priv) {
+        errno = EINVAL;
+        return -1;
+    }
+    return writev(pcodec->handle, iov, iovcnt);
+}
+
+int codec_checkin_pts(codec_para_t *pcodec, unsigned long pts)
+{
+    mock_codec_t *m = pcodec->mock_priv;
+    int tail;
+
+    if (!m) {
+        return CODEC_ERROR_INVAL;
+    }
+    pthread_mutex_lock(&m->lock);
+    if (m->pts_count == MOCK_PTS_QUEUE_SIZE) {
+        /* drop the oldest, like the pts server does when it overflows */
+        m->pts_head = (m->pts_head + 1) % MOCK_PTS_QUEUE_SIZE;
+        m->pts_count--;
+    }
+    tail = (m->pts_head + m->pts_count) % MOCK_PTS_QUEUE_SIZE;
+    /* whatever is queued now sits in front of the data this pts belongs to */
+    m->ptsq[tail].offset = m->consumed + mock_queued(m);
+    m->ptsq[tail].pts = pts;
+    m->pts_count++;
+    pthread_mutex_unlock(&m->lock);
+    return CODEC_ERROR_NONE;
+}
+
+static int mock_get_buf_state(codec_para_t *pcodec, struct buf_status *buf)
+{
+    mock_codec_t *m = pcodec->mock_priv;
+    int queued;
+
+    if (!m) {
+        return CODEC_ERROR_INVAL;
+    }
+    pthread_mutex_lock(&m->lock);
+    queued = mock_queued(m);
+    memset(buf, 0, sizeof(*buf));
+    buf->status = 1;
+    buf->size = m->size;
+    buf->data_len = queued;
+    buf->free_len = m->size - queued;
+    buf->read_pointer = (unsigned int)m->consumed;
+    buf->write_pointer = (unsigned int)(m->consumed + queued);
+    pthread_mutex_unlock(&m->lock);
+    return 0;
+}
+
+int codec_get_vbuf_state(codec_para_t *pcodec, struct buf_status *buf)
+{
+    return mock_get_buf_state(pcodec, buf);
+}
+
+int codec_get_abuf_state(codec_para_t *pcodec, struct buf_status *buf)
+{
+    return mock_get_buf_state(pcodec, buf);
+}
+
+static unsigned int mock_get_pts(codec_para_t *pcodec)
+{
+    mock_codec_t *m = pcodec->mock_priv;
+    unsigned int pts;
+
+    if (!m) {
+        return -1;
+    }
+    pthread_mutex_lock(&m->lock);
+    pts = m->cur_pts;
+    pthread_mutex_unlock(&m->lock);
+    return pts;
+}
+
+unsigned int codec_get_vpts(codec_para_t *pcodec)
+{
+    return mock_get_pts(pcodec);
+}
+
+unsigned int codec_get_apts(codec_para_t *pcodec)
+{
+    return mock_get_pts(pcodec);
+}
+
+static int mock_set_paused(codec_para_t *pcodec, int paused)
+{
+    mock_codec_t *m = pcodec->mock_priv;
+
+    if (!m) {
+        return CODEC_ERROR_INVAL;
+    }
+    pthread_mutex_lock(&m->lock);
+    m->paused = paused;
+    pthread_mutex_unlock(&m->lock);
+    return CODEC_ERROR_NONE;
+}
+
+int codec_pause(codec_para_t *pcodec)
+{
+    return mock_set_paused(pcodec, 1);
+}
+
+int codec_resume(codec_para_t *pcodec)
+{
+    return mock_set_paused(pcodec, 0);
+}
+
+int codec_set_pcrscr(codec_para_t *pcodec, int val)
+{
+    mock_codec_t *m = pcodec->mock_priv;
+
+    if (!m) {
+        return CODEC_ERROR_INVAL;
+    }
+    pthread_mutex_lock(&m->lock);
+    m->cur_pts = val;
+    pthread_mutex_unlock(&m->lock);
+    mock_publish_pcr(m, val);
+    return CODEC_ERROR_NONE;
+}
+
+int codec_set_av_threshold(codec_para_t *pcodec, int threshold)
+{
+    return CODEC_ERROR_NONE;
+}
@@ -0,0 +1,14 @@
+/*
+ * Stand-in for the H.263 VLD rewrite libamcodec does before feeding
+ * H.263 to the hardware; off-target the bitstream is passed as is.
+ * Kept apart from mockamcodec.c so a program can provide its own
+ * codec_write() and still link this from the archive.
+ */
+
+#include <string.h>
+
+int h263vld(unsigned char *inbuf, unsigned char *outbuf, int inbuf_len, int s263)
+{
+    memcpy(outbuf, inbuf, inbuf_len);
+    return inbuf_len;
+}
@@ -0,0 +1,374 @@
+/* GStreamer
+ * Copyright (C) 2015 Amlogic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+/**
+ * SECTION:element-amlesrc
+ *
+ * Replays an elementary stream capture written by the "capture-location"
+ * property of amlvdec/amladec. Each checked-in PTS starts a new buffer
+ * carrying the header and data bytes that followed it, wrapped straight
+ * from the mmapped file. Recorded flushes are replayed as flush events.
+ *
+ * The caps are those the decoder was configured with, plus an
+ * "aml-es-replay" field telling the decoder not to inject headers and
+ * startcodes again, so the bytes reaching codec_write are the captured
+ * ones. With pace=false the file is pushed as fast as the decoder takes it.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 amlesrc location=/data/video.amles ! amlvdec ! amlvsink
+ * gst-launch-1.0 amlesrc location=/data/audio.amles pace=false ! amladec ! amlasink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+#include "gstamlesrc.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_aml_es_src_debug);
+#define GST_CAT_DEFAULT gst_aml_es_src_debug
+#define VERSION	"1.1"
+
+enum
+{
+    PROP_0,
+    PROP_LOCATION,
+    PROP_PACE
+};
+
+#define DEFAULT_PACE TRUE
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY
+    );
+
+static void             gst_aml_es_src_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
+static void             gst_aml_es_src_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
+static void             gst_aml_es_src_finalize (GObject * object);
+static gboolean         gst_aml_es_src_start (GstBaseSrc * basesrc);
+static gboolean         gst_aml_es_src_stop (GstBaseSrc * basesrc);
+static GstCaps *        gst_aml_es_src_get_caps (GstBaseSrc * basesrc, GstCaps * filter);
+static gboolean         gst_aml_es_src_unlock (GstBaseSrc * basesrc);
+static gboolean         gst_aml_es_src_unlock_stop (GstBaseSrc * basesrc);
+static GstFlowReturn    gst_aml_es_src_create (GstBaseSrc * basesrc, guint64 offset, guint size, GstBuffer ** outbuf);
+
+#define gst_aml_es_src_parent_class parent_class
+G_DEFINE_TYPE (GstAmlEsSrc, gst_aml_es_src, GST_TYPE_BASE_SRC);
+
+static void
+gst_aml_es_src_class_init (GstAmlEsSrcClass * klass)
+{
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    GstElementClass *element_class = (GstElementClass *) klass;
+    GstBaseSrcClass *base_class = (GstBaseSrcClass *) klass;
+
+    gobject_class->set_property = gst_aml_es_src_set_property;
+    gobject_class->get_property = gst_aml_es_src_get_property;
+    gobject_class->finalize = gst_aml_es_src_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_LOCATION,
+            g_param_spec_string("location", "Location",
+                    "Capture file written by amlvdec/amladec capture-location",
+                    NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(gobject_class, PROP_PACE,
+            g_param_spec_boolean("pace", "Pace",
+                    "Replay at the recorded pace instead of as fast as possible",
+                    DEFAULT_PACE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&src_factory));
+    gst_element_class_set_details_simple(element_class,
+            "Amlogic ES capture source",
+            "Source/File",
+            "Replays elementary stream captures into amlvdec/amladec",
+            "mm@amlogic.com");
+
+    base_class->start = GST_DEBUG_FUNCPTR(gst_aml_es_src_start);
+    base_class->stop = GST_DEBUG_FUNCPTR(gst_aml_es_src_stop);
+    base_class->get_caps = GST_DEBUG_FUNCPTR(gst_aml_es_src_get_caps);
+    base_class->unlock = GST_DEBUG_FUNCPTR(gst_aml_es_src_unlock);
+    base_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_aml_es_src_unlock_stop);
+    base_class->create = GST_DEBUG_FUNCPTR(gst_aml_es_src_create);
+}
+
+static void
+gst_aml_es_src_init (GstAmlEsSrc * src)
+{
+    src->pace = DEFAULT_PACE;
+    g_mutex_init(&src->lock);
+    g_cond_init(&src->cond);
+    gst_base_src_set_format(GST_BASE_SRC(src), GST_FORMAT_TIME);
+}
+
+static void
+gst_aml_es_src_finalize (GObject * object)
+{
+    GstAmlEsSrc *src = GST_AMLESSRC(object);
+
+    g_free(src->location);
+    g_mutex_clear(&src->lock);
+    g_cond_clear(&src->cond);
+    G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void
+gst_aml_es_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+    GstAmlEsSrc *src = GST_AMLESSRC(object);
+
+    switch (prop_id) {
+    case PROP_LOCATION:
+        GST_OBJECT_LOCK(src);
+        g_free(src->location);
+        src->location = g_value_dup_string(value);
+        GST_OBJECT_UNLOCK(src);
+        break;
+    case PROP_PACE:
+        src->pace = g_value_get_boolean(value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void
+gst_aml_es_src_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+    GstAmlEsSrc *src = GST_AMLESSRC(object);
+
+    switch (prop_id) {
+    case PROP_LOCATION:
+        GST_OBJECT_LOCK(src);
+        g_value_set_string(value, src->location);
+        GST_OBJECT_UNLOCK(src);
+        break;
+    case PROP_PACE:
+        g_value_set_boolean(value, src->pace);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static gboolean
+gst_aml_es_src_start (GstBaseSrc * basesrc)
+{
+    GstAmlEsSrc *src = GST_AMLESSRC(basesrc);
+    GError *error = NULL;
+
+    if (!src->location) {
+        GST_ELEMENT_ERROR(src, RESOURCE, NOT_FOUND, ("No capture file specified"), (NULL));
+        return FALSE;
+    }
+    if (!amlEsReaderOpen(&src->reader, src->location, &error)) {
+        GST_ELEMENT_ERROR(src, RESOURCE, OPEN_READ, ("%s", error->message), (NULL));
+        g_error_free(error);
+        return FALSE;
+    }
+
+    src->caps = gst_caps_from_string(src->reader.caps);
+    if (!src->caps || gst_caps_is_empty(src->caps)) {
+        GST_ELEMENT_ERROR(src, STREAM, FORMAT, ("Invalid caps in capture: %s", src->reader.caps), (NULL));
+        gst_caps_replace(&src->caps, NULL);
+        amlEsReaderClose(&src->reader);
+        return FALSE;
+    }
+    src->caps = gst_caps_make_writable(src->caps);
+    gst_caps_set_simple(src->caps, "aml-es-replay", G_TYPE_BOOLEAN, TRUE, NULL);
+    GST_INFO_OBJECT(src, "replaying %s capture, caps %" GST_PTR_FORMAT,
+            src->reader.stream_type == AML_ES_STREAM_VIDEO ? "video" : "audio", src->caps);
+
+    src->base_mono = -1;
+    src->unlocked = FALSE;
+    return TRUE;
+}
+
+static gboolean
+gst_aml_es_src_stop (GstBaseSrc * basesrc)
+{
+    GstAmlEsSrc *src = GST_AMLESSRC(basesrc);
+
+    gst_caps_replace(&src->caps, NULL);
+    amlEsReaderClose(&src->reader);
+    return TRUE;
+}
+
+static GstCaps *
+gst_aml_es_src_get_caps (GstBaseSrc * basesrc, GstCaps * filter)
+{
+    GstAmlEsSrc *src = GST_AMLESSRC(basesrc);
+    GstCaps *caps;
+
+    if (!src->caps)
+        return GST_BASE_SRC_CLASS(parent_class)->get_caps(basesrc, filter);
+
+    if (filter)
+        caps = gst_caps_intersect_full(filter, src->caps, GST_CAPS_INTERSECT_FIRST);
+    else
+        caps = gst_caps_ref(src->caps);
+    return caps;
+}
+
+static gboolean
+gst_aml_es_src_unlock (GstBaseSrc * basesrc)
+{
+    GstAmlEsSrc *src = GST_AMLESSRC(basesrc);
+
+    g_mutex_lock(&src->lock);
+    src->unlocked = TRUE;
+    g_cond_broadcast(&src->cond);
+    g_mutex_unlock(&src->lock);
+    return TRUE;
+}
+
+static gboolean
+gst_aml_es_src_unlock_stop (GstBaseSrc * basesrc)
+{
+    GstAmlEsSrc *src = GST_AMLESSRC(basesrc);
+
+    g_mutex_lock(&src->lock);
+    src->unlocked = FALSE;
+    src->base_mono = -1;
+    g_mutex_unlock(&src->lock);
+    return TRUE;
+}
+
+/* sleep until `time` (capture clock) has elapsed since the first buffer,
+ * FALSE when unlocked for a flush or state change */
+static gboolean
+gst_aml_es_src_wait (GstAmlEsSrc *src, guint64 time)
+{
+    gint64 deadline;
+    gboolean ret;
+
+    g_mutex_lock(&src->lock);
+    if (src->base_mono < 0 || time < src->base_time) {
+        src->base_mono = g_get_monotonic_time();
+        src->base_time = time;
+    }
+    deadline = src->base_mono + (gint64) ((time - src->base_time) / GST_USECOND);
+    while (!src->unlocked && g_get_monotonic_time() < deadline)
+        g_cond_wait_until(&src->cond, &src->lock, deadline);
+    ret = !src->unlocked;
+    g_mutex_unlock(&src->lock);
+    return ret;
+}
+
+/* the decoder reset its ES buffer here while capturing, do the same */
+static void
+gst_aml_es_src_replay_flush (GstAmlEsSrc *src)
+{
+    GstPad *pad = GST_BASE_SRC_PAD(src);
+    GstSegment segment;
+
+    GST_DEBUG_OBJECT(src, "replaying flush at offset %" G_GSIZE_FORMAT, src->reader.offset);
+    gst_pad_push_event(pad, gst_event_new_flush_start());
+    gst_pad_push_event(pad, gst_event_new_flush_stop(TRUE));
+    gst_segment_init(&segment, GST_FORMAT_TIME);
+    gst_pad_push_event(pad, gst_event_new_segment(&segment));
+}
+
+static GstFlowReturn
+gst_aml_es_src_create (GstBaseSrc * basesrc, guint64 offset, guint size,
+    GstBuffer ** outbuf)
+{
+    GstAmlEsSrc *src = GST_AMLESSRC(basesrc);
+    AmlEsRecord record;
+    const guint8 *payload;
+    GstBuffer *buf = NULL;
+    GstClockTime timestamp = GST_CLOCK_TIME_NONE;
+    guint64 time = 0;
+    gboolean have_time = FALSE;
+
+    while (amlEsReaderPeek(&src->reader, &record, &payload)) {
+        if (record.type == AML_ES_RECORD_PTS || record.type == AML_ES_RECORD_FLUSH) {
+            /* both end the current buffer */
+            if (buf)
+                break;
+            amlEsReaderSkip(&src->reader);
+            if (record.type == AML_ES_RECORD_FLUSH) {
+                gst_aml_es_src_replay_flush(src);
+                have_time = FALSE;
+                timestamp = GST_CLOCK_TIME_NONE;
+            } else {
+                timestamp = record.timestamp;
+                time = record.time;
+                have_time = TRUE;
+            }
+            continue;
+        }
+
+        if (!buf) {
+            buf = gst_buffer_new();
+            if (!have_time)
+                time = record.time;
+        }
+        if (record.size > 0) {
+            gst_buffer_append_memory(buf,
+                    gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, (gpointer) payload,
+                            record.size, 0, record.size,
+                            g_mapped_file_ref(src->reader.file),
+                            (GDestroyNotify) g_mapped_file_unref));
+        }
+        amlEsReaderSkip(&src->reader);
+    }
+
+    if (!buf) {
+        GST_DEBUG_OBJECT(src, "end of capture");
+        return GST_FLOW_EOS;
+    }
+
+    if (src->pace && !gst_aml_es_src_wait(src, time)) {
+        gst_buffer_unref(buf);
+        return GST_FLOW_FLUSHING;
+    }
+
+    GST_BUFFER_PTS(buf) = timestamp;
+    GST_LOG_OBJECT(src, "buffer of %" G_GSIZE_FORMAT " bytes, pts %" GST_TIME_FORMAT,
+            gst_buffer_get_size(buf), GST_TIME_ARGS(timestamp));
+    *outbuf = buf;
+    return GST_FLOW_OK;
+}
+
+static gboolean
+amlesrc_init (GstPlugin * plugin)
+{
+    GST_DEBUG_CATEGORY_INIT(gst_aml_es_src_debug, "amlesrc", 0, "Amlogic ES capture source");
+
+    return gst_element_register(plugin, "amlesrc", GST_RANK_NONE, GST_TYPE_AMLESSRC);
+}
+
+#ifndef PACKAGE
+#define PACKAGE "gst-plugins-amlogic"
+#endif
+
+GST_PLUGIN_DEFINE (
+    GST_VERSION_MAJOR,
+    GST_VERSION_MINOR,
+    amlesrc,
+    "Amlogic ES capture source",
+    amlesrc_init,
+    VERSION,
+    "LGPL",
+    "Amlogic",
+    "http://amlogic.com/"
+)
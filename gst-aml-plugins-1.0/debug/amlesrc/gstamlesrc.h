@@ -0,0 +1,63 @@
+/* GStreamer
+ * Copyright (C) 2015 Amlogic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef __GST_AMLESSRC_H__
+#define __GST_AMLESSRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+#include <amlescapture.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_AMLESSRC \
+  (gst_aml_es_src_get_type())
+#define GST_AMLESSRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_AMLESSRC,GstAmlEsSrc))
+#define GST_AMLESSRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_AMLESSRC,GstAmlEsSrcClass))
+#define GST_IS_AMLESSRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_AMLESSRC))
+#define GST_IS_AMLESSRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_AMLESSRC))
+
+typedef struct _GstAmlEsSrc GstAmlEsSrc;
+typedef struct _GstAmlEsSrcClass GstAmlEsSrcClass;
+
+struct _GstAmlEsSrc {
+    GstBaseSrc parent;
+
+    gchar *location;
+    gboolean pace;
+
+    AmlEsReader reader;
+    GstCaps *caps;
+
+    /* recorded pace: capture time of the first buffer and when it went out */
+    gint64 base_mono;
+    guint64 base_time;
+    GMutex lock;
+    GCond cond;
+    gboolean unlocked;
+};
+
+struct _GstAmlEsSrcClass {
+    GstBaseSrcClass parent_class;
+};
+
+GType gst_aml_es_src_get_type(void);
+
+G_END_DECLS
+
+#endif /* __GST_AMLESSRC_H__ */
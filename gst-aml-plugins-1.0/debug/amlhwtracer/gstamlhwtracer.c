@@ -0,0 +1,358 @@
+/* GStreamer
+ * Copyright (C) 2015 Amlogic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+/**
+ * SECTION:tracer-amlhw
+ *
+ * Samples the hardware elementary stream buffers behind amlvdec and amladec
+ * once per interval: vbuf/abuf fill level, last checked-in PTS against the
+ * PTS the decoder reports, and the cumulative time the streaming thread
+ * spent waiting for buffer space. A periodic system clock id samples every
+ * decoder created since the tracer started, so a stalled stream keeps
+ * being recorded; pushes into a decoder sample it too when the interval
+ * has passed. The values are read through the decoders' "hw-stats"
+ * property and logged as "amlhw" tracer records, so gst-stats and the
+ * other tracer tools can pick them up.
+ *
+ * |[
+ * GST_TRACERS="amlhw(interval=200)" GST_DEBUG="GST_TRACER:7" gst-launch-1.0 ...
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+#include <string.h>
+#include "gstamlhwtracer.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_aml_hw_tracer_debug);
+#define GST_CAT_DEFAULT gst_aml_hw_tracer_debug
+#define VERSION	"1.1"
+
+#define gst_aml_hw_tracer_parent_class parent_class
+G_DEFINE_TYPE (GstAmlHwTracer, gst_aml_hw_tracer, GST_TYPE_TRACER);
+
+static GstTracerRecord *tr_amlhw;
+static GQuark last_sample_quark;
+
+static gboolean
+is_aml_decoder(GstElement *element)
+{
+    GstElementFactory *factory = gst_element_get_factory(element);
+    const gchar *name;
+
+    if (!factory)
+        return FALSE;
+
+    name = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+    return !strcmp(name, "amlvdec") || !strcmp(name, "amladec");
+}
+
+/* the element owning the pad data really ends up in, looking through
+ * ghost pads of the bins (decodebin, playbin) the decoders live in */
+static GstElement *
+get_real_peer_parent(GstPad *pad)
+{
+    GstPad *peer, *target;
+    GstElement *parent;
+
+    peer = gst_pad_get_peer(pad);
+    while (peer && GST_IS_GHOST_PAD(peer)) {
+        target = gst_ghost_pad_get_target(GST_GHOST_PAD(peer));
+        gst_object_unref(peer);
+        peer = target;
+    }
+    if (!peer)
+        return NULL;
+
+    parent = gst_pad_get_parent_element(peer);
+    gst_object_unref(peer);
+    return parent;
+}
+
+/* the decoder's last sample time, adding it to the timer's list the
+ * first time it is seen; called with the lock held */
+static GstClockTime *
+watch_decoder(GstAmlHwTracer *self, GstElement *element)
+{
+    GstClockTime *last;
+    GWeakRef *ref;
+
+    last = g_object_get_qdata(G_OBJECT(element), last_sample_quark);
+    if (!last) {
+        last = g_new(GstClockTime, 1);
+        *last = GST_CLOCK_TIME_NONE;
+        g_object_set_qdata_full(G_OBJECT(element), last_sample_quark, last, g_free);
+        ref = g_new(GWeakRef, 1);
+        g_weak_ref_init(ref, element);
+        self->decoders = g_list_prepend(self->decoders, ref);
+    }
+    return last;
+}
+
+static void
+free_weak_ref(GWeakRef *ref)
+{
+    g_weak_ref_clear(ref);
+    g_free(ref);
+}
+
+/* at most one sample per min_gap */
+static void
+sample_decoder(GstAmlHwTracer *self, guint64 ts, GstElement *element, GstClockTime min_gap)
+{
+    GstClockTime *last;
+    GstStructure *stats = NULL;
+    const gchar *stream;
+    guint data_len = 0, size = 0;
+    guint64 checkin_pts = 0, current_pts = 0, stall_time = 0;
+    gchar *name;
+
+    /* pushes and the timer may both get here */
+    g_mutex_lock(&self->lock);
+    last = watch_decoder(self, element);
+    if (*last != GST_CLOCK_TIME_NONE && ts - *last < min_gap) {
+        g_mutex_unlock(&self->lock);
+        return;
+    }
+    *last = ts;
+    g_mutex_unlock(&self->lock);
+
+    g_object_get(element, "hw-stats", &stats, NULL);
+    if (!stats)
+        return;
+
+    stream = gst_structure_get_string(stats, "stream");
+    gst_structure_get_uint(stats, "buf-data-len", &data_len);
+    gst_structure_get_uint(stats, "buf-size", &size);
+    gst_structure_get_uint64(stats, "checkin-pts", &checkin_pts);
+    gst_structure_get_uint64(stats, "current-pts", &current_pts);
+    gst_structure_get_uint64(stats, "stall-time", &stall_time);
+
+    name = gst_object_get_name(GST_OBJECT(element));
+    gst_tracer_record_log(tr_amlhw, name, stream ? stream : "unknown",
+            data_len, size, checkin_pts, current_pts, stall_time, ts);
+    g_free(name);
+    gst_structure_free(stats);
+}
+
+static void
+sample_pad_peer(GstAmlHwTracer *self, guint64 ts, GstPad *pad)
+{
+    GstElement *parent = get_real_peer_parent(pad);
+
+    if (!parent)
+        return;
+    if (is_aml_decoder(parent))
+        sample_decoder(self, ts, parent, self->interval);
+    gst_object_unref(parent);
+}
+
+static void
+do_push_buffer_pre(GstAmlHwTracer *self, guint64 ts, GstPad *pad,
+    GstBuffer *buffer)
+{
+    sample_pad_peer(self, ts, pad);
+}
+
+static void
+do_push_buffer_list_pre(GstAmlHwTracer *self, guint64 ts, GstPad *pad,
+    GstBufferList *list)
+{
+    sample_pad_peer(self, ts, pad);
+}
+
+static void
+do_element_new(GstAmlHwTracer *self, guint64 ts, GstElement *element)
+{
+    if (!is_aml_decoder(element))
+        return;
+    g_mutex_lock(&self->lock);
+    watch_decoder(self, element);
+    g_mutex_unlock(&self->lock);
+}
+
+/* runs on the system clock's thread every interval, whether or not the
+ * decoders get data. unschedule does not wait for a tick already running,
+ * so the tick holds the tracer through a weak ref and finalize cannot
+ * start under it. */
+static gboolean
+sample_timer(GstClock *clock, GstClockTime time, GstClockID id, gpointer user_data)
+{
+    GstAmlHwTracer *self = g_weak_ref_get(user_data);
+    GList *l, *next, *decoders = NULL;
+    GstElement *element;
+    guint64 ts;
+
+    if (!self)
+        return TRUE;
+    ts = gst_util_get_timestamp();
+    g_mutex_lock(&self->lock);
+    for (l = self->decoders; l; l = next) {
+        next = l->next;
+        element = g_weak_ref_get(l->data);
+        if (element) {
+            decoders = g_list_prepend(decoders, element);
+        } else {
+            free_weak_ref(l->data);
+            self->decoders = g_list_delete_link(self->decoders, l);
+        }
+    }
+    g_mutex_unlock(&self->lock);
+
+    /* a late tick is still one per interval */
+    for (l = decoders; l; l = l->next)
+        sample_decoder(self, ts, l->data, self->interval / 2);
+    g_list_free_full(decoders, gst_object_unref);
+    gst_object_unref(self);
+    return TRUE;
+}
+
+static void
+gst_aml_hw_tracer_constructed(GObject *object)
+{
+    GstAmlHwTracer *self = GST_AMLHWTRACER(object);
+    GstStructure *params_struct = NULL;
+    gchar *params, *tmp;
+    gint interval;
+
+    g_object_get(self, "params", &params, NULL);
+    if (params) {
+        tmp = g_strdup_printf("amlhw,%s", params);
+        params_struct = gst_structure_from_string(tmp, NULL);
+        g_free(tmp);
+        g_free(params);
+    }
+    if (params_struct) {
+        if (gst_structure_get_int(params_struct, "interval", &interval) && interval >= 0)
+            self->interval = interval * GST_MSECOND;
+        gst_structure_free(params_struct);
+    }
+    GST_INFO_OBJECT(self, "sampling every %" GST_TIME_FORMAT,
+            GST_TIME_ARGS(self->interval));
+
+    /* interval=0 samples on every push, there is nothing to time */
+    if (self->interval > 0) {
+        GWeakRef *ref = g_new0(GWeakRef, 1);
+
+        g_weak_ref_init(ref, self);
+        self->clock = gst_system_clock_obtain();
+        self->timer = gst_clock_new_periodic_id(self->clock,
+                gst_clock_get_time(self->clock) + self->interval, self->interval);
+        gst_clock_id_wait_async(self->timer, sample_timer, ref,
+                (GDestroyNotify) free_weak_ref);
+    }
+
+    G_OBJECT_CLASS(parent_class)->constructed(object);
+}
+
+static void
+gst_aml_hw_tracer_finalize(GObject *object)
+{
+    GstAmlHwTracer *self = GST_AMLHWTRACER(object);
+
+    if (self->timer) {
+        gst_clock_id_unschedule(self->timer);
+        gst_clock_id_unref(self->timer);
+    }
+    if (self->clock)
+        gst_object_unref(self->clock);
+    g_list_free_full(self->decoders, (GDestroyNotify) free_weak_ref);
+    g_mutex_clear(&self->lock);
+
+    G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static GstStructure *
+record_value(GType type, const gchar *description)
+{
+    return gst_structure_new("value",
+            "type", G_TYPE_GTYPE, type,
+            "description", G_TYPE_STRING, description,
+            NULL);
+}
+
+static void
+gst_aml_hw_tracer_class_init(GstAmlHwTracerClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->constructed = gst_aml_hw_tracer_constructed;
+    gobject_class->finalize = gst_aml_hw_tracer_finalize;
+
+    tr_amlhw = gst_tracer_record_new("amlhw.class",
+            "element", GST_TYPE_STRUCTURE, gst_structure_new("scope",
+                    "type", G_TYPE_GTYPE, G_TYPE_STRING,
+                    "related-to", GST_TYPE_TRACER_VALUE_SCOPE, GST_TRACER_VALUE_SCOPE_ELEMENT,
+                    NULL),
+            "stream", GST_TYPE_STRUCTURE, record_value(G_TYPE_STRING,
+                    "elementary stream type, video or audio"),
+            "buf-data-len", GST_TYPE_STRUCTURE, record_value(G_TYPE_UINT,
+                    "bytes queued in the hardware ES buffer"),
+            "buf-size", GST_TYPE_STRUCTURE, record_value(G_TYPE_UINT,
+                    "size of the hardware ES buffer in bytes"),
+            "checkin-pts", GST_TYPE_STRUCTURE, record_value(G_TYPE_UINT64,
+                    "last PTS checked in to the decoder, 90 kHz"),
+            "current-pts", GST_TYPE_STRUCTURE, record_value(G_TYPE_UINT64,
+                    "PTS currently reported by the decoder, 90 kHz"),
+            "stall-time", GST_TYPE_STRUCTURE, record_value(G_TYPE_UINT64,
+                    "cumulative time spent waiting for ES buffer space in ns"),
+            "ts", GST_TYPE_STRUCTURE, record_value(G_TYPE_UINT64,
+                    "ts when the sample has been logged"),
+            NULL);
+    GST_OBJECT_FLAG_SET(tr_amlhw, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+static void
+gst_aml_hw_tracer_init(GstAmlHwTracer *self)
+{
+    GstTracer *tracer = GST_TRACER(self);
+
+    self->interval = DEFAULT_SAMPLE_INTERVAL;
+    g_mutex_init(&self->lock);
+
+    gst_tracing_register_hook(tracer, "element-new",
+            G_CALLBACK(do_element_new));
+    gst_tracing_register_hook(tracer, "pad-push-pre",
+            G_CALLBACK(do_push_buffer_pre));
+    gst_tracing_register_hook(tracer, "pad-push-list-pre",
+            G_CALLBACK(do_push_buffer_list_pre));
+}
+
+static gboolean
+amlhwtracer_init(GstPlugin *plugin)
+{
+    GST_DEBUG_CATEGORY_INIT(gst_aml_hw_tracer_debug, "amlhwtracer", 0,
+            "Amlogic hardware buffer tracer");
+
+    last_sample_quark = g_quark_from_static_string("amlhw-last-sample");
+
+    return gst_tracer_register(plugin, "amlhw", GST_TYPE_AMLHWTRACER);
+}
+
+#ifndef PACKAGE
+#define PACKAGE "gst-plugins-amlogic"
+#endif
+
+GST_PLUGIN_DEFINE (
+    GST_VERSION_MAJOR,
+    GST_VERSION_MINOR,
+    amlhwtracer,
+    "Amlogic hardware buffer tracer",
+    amlhwtracer_init,
+    VERSION,
+    "LGPL",
+    "Amlogic",
+    "http://amlogic.com/"
+)
@@ -0,0 +1,58 @@
+/* GStreamer
+ * Copyright (C) 2015 Amlogic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ */
+
+#ifndef __GST_AMLHWTRACER_H__
+#define __GST_AMLHWTRACER_H__
+
+#include <gst/gst.h>
+#include <gst/gsttracer.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_AMLHWTRACER \
+  (gst_aml_hw_tracer_get_type())
+#define GST_AMLHWTRACER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_AMLHWTRACER,GstAmlHwTracer))
+#define GST_AMLHWTRACER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_AMLHWTRACER,GstAmlHwTracerClass))
+#define GST_IS_AMLHWTRACER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_AMLHWTRACER))
+#define GST_IS_AMLHWTRACER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_AMLHWTRACER))
+
+/* default sampling period, overridden with GST_TRACERS="amlhw(interval=ms)" */
+#define DEFAULT_SAMPLE_INTERVAL (100 * GST_MSECOND)
+
+typedef struct _GstAmlHwTracer GstAmlHwTracer;
+typedef struct _GstAmlHwTracerClass GstAmlHwTracerClass;
+
+struct _GstAmlHwTracer {
+    GstTracer parent;
+    GstClockTime interval;
+
+    GMutex lock;
+    GList *decoders;            /* GWeakRef of each amlvdec/amladec seen */
+    GstClock *clock;
+    GstClockID timer;           /* samples them while no data flows */
+};
+
+struct _GstAmlHwTracerClass {
+    GstTracerClass parent_class;
+};
+
+GType gst_aml_hw_tracer_get_type(void);
+
+G_END_DECLS
+
+#endif /* __GST_AMLHWTRACER_H__ */
@@ -69,6 +69,15 @@ GST_DEBUG_CATEGORY_STATIC (gst_aml_vdec_debug);
 #define GST_CAT_DEFAULT gst_aml_vdec_debug
 #define VERSION	"1.1"
 
+enum
+{
+	PROP_0,
+	PROP_HW_STATS,
+	PROP_CAPTURE_LOCATION,
+	PROP_DUMP_SIZE,
+	PROP_DUMP_LOCATION
+};
+
 #define COMMON_VIDEO_CAPS \
   "width = (int) [ 16, 4096 ], " \
   "height = (int) [ 16, 4096 ] "
@@ -131,6 +140,7 @@ static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     );
 
 static void					gst_aml_vdec_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
+static void					gst_aml_vdec_finalize (GObject * object);
 static void					gst_aml_vdec_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
 static gboolean					gst_aml_vdec_open(GstVideoDecoder * dec);
 static gboolean					gst_aml_vdec_close(GstVideoDecoder * dec);
@@ -140,6 +150,7 @@ static gboolean					gst_aml_vdec_set_format(GstVideoDecoder *dec, GstVideoCodecS
 static GstFlowReturn			gst_aml_vdec_handle_frame(GstVideoDecoder *dec, GstVideoCodecFrame *frame);
 static void					gst_aml_vdec_flush(GstVideoDecoder * dec);
 static gboolean					gst_aml_vdec_sink_event  (GstVideoDecoder * amlvdec, GstEvent * event);
+static gboolean					gst_aml_vdec_decide_allocation(GstVideoDecoder * dec, GstQuery * query);
 static gboolean					gst_set_vstream_info(GstAmlVdec *amlvdec, GstCaps * caps);
 static GstFlowReturn			gst_aml_vdec_decode (GstAmlVdec *amlvdec, GstBuffer * buf, GstVideoCodecFrame *frame);
 static GstStateChangeReturn		gst_aml_vdec_change_state (GstElement * element, GstStateChange transition);
@@ -158,6 +169,7 @@ gst_aml_vdec_class_init (GstAmlVdecClass * klass)
 	GstVideoDecoderClass *base_class = (GstVideoDecoderClass *) klass;
 	gobject_class->set_property = gst_aml_vdec_set_property;
 	gobject_class->get_property = gst_aml_vdec_get_property;
+	gobject_class->finalize = gst_aml_vdec_finalize;
 	element_class->change_state = GST_DEBUG_FUNCPTR (gst_aml_vdec_change_state);
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&sink_factory));
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&src_factory));
@@ -176,7 +188,24 @@ gst_aml_vdec_class_init (GstAmlVdecClass * klass)
 	base_class->handle_frame = GST_DEBUG_FUNCPTR(gst_aml_vdec_handle_frame);
 	base_class->flush = GST_DEBUG_FUNCPTR(gst_aml_vdec_flush);
 	base_class->sink_event =  GST_DEBUG_FUNCPTR(gst_aml_vdec_sink_event);
-
+	base_class->decide_allocation = GST_DEBUG_FUNCPTR(gst_aml_vdec_decide_allocation);
+
+	g_object_class_install_property(gobject_class, PROP_HW_STATS,
+			g_param_spec_boxed("hw-stats", "Hardware stats",
+					"vbuf level, checked-in/current PTS and write stall time, sampled by the amlhw tracer",
+					GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_CAPTURE_LOCATION,
+			g_param_spec_string("capture-location", "Capture location",
+					"Record everything written to the decoder to this file for replay with amlesrc",
+					NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_DUMP_SIZE,
+			g_param_spec_uint("dump-size", "Dump size",
+					"Keep the last N MB written to the decoder in memory for dump-location, 0: off",
+					0, AML_DUMP_SIZE_MAX, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(gobject_class, PROP_DUMP_LOCATION,
+			g_param_spec_string("dump-location", "Dump location",
+					"Setting it writes the kept data to this file in the background, in the capture-location format",
+					NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 /* initialize the new element
@@ -188,6 +217,8 @@ static void
 gst_aml_vdec_init (GstAmlVdec * amlvdec)
 {
 	GstVideoDecoder *dec = GST_VIDEO_DECODER (amlvdec);
+	amlWaitInit(&amlvdec->wait);
+	g_mutex_init(&amlvdec->stats_lock);
 }
 
 static void
@@ -197,12 +228,84 @@ gst_aml_vdec_set_property (GObject * object, guint prop_id,
 	GstAmlVdec *amlvdec = GST_AMLVDEC(object);
 
 	switch (prop_id) {
+	case PROP_CAPTURE_LOCATION:
+		GST_OBJECT_LOCK(amlvdec);
+		g_free(amlvdec->capture_location);
+		amlvdec->capture_location = g_value_dup_string(value);
+		GST_OBJECT_UNLOCK(amlvdec);
+		break;
+	case PROP_DUMP_SIZE:
+		GST_OBJECT_LOCK(amlvdec);
+		amlvdec->dump_size = g_value_get_uint(value);
+		GST_OBJECT_UNLOCK(amlvdec);
+		break;
+	case PROP_DUMP_LOCATION:
+		GST_OBJECT_LOCK(amlvdec);
+		g_free(amlvdec->dump_location);
+		amlvdec->dump_location = g_value_dup_string(value);
+		/* the ring only exists while the decoder is open */
+		if (amlvdec->dump_location)
+			amlEsCaptureDump(amlvdec->capture, amlvdec->dump_location);
+		GST_OBJECT_UNLOCK(amlvdec);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
 	}
 }
 
+static void
+gst_aml_vdec_finalize (GObject * object)
+{
+	GstAmlVdec *amlvdec = GST_AMLVDEC(object);
+
+	g_free(amlvdec->capture_location);
+	g_free(amlvdec->dump_location);
+	amlWaitClear(&amlvdec->wait);
+	g_mutex_clear(&amlvdec->stats_lock);
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+/* any thread, the tracer polls it from the system clock's */
+static GstStructure *
+gst_aml_vdec_get_hw_stats (GstAmlVdec *amlvdec)
+{
+	struct buf_status vbuf;
+	guint data_len = 0, size = 0;
+	guint64 checkin_pts = 0, current_pts = 0;
+	GstStructure *stats;
+
+	g_mutex_lock(&amlvdec->stats_lock);
+	if (amlvdec->pcodec && amlvdec->codec_init_ok) {
+		if (codec_get_vbuf_state(amlvdec->pcodec, &vbuf) == 0) {
+			data_len = vbuf.data_len;
+			size = vbuf.size;
+		}
+		current_pts = codec_get_vpts(amlvdec->pcodec);
+		if (amlvdec->last_checkin_pts != -1L)
+			checkin_pts = amlvdec->last_checkin_pts;
+	}
+
+	stats = gst_structure_new("amlhw-stats",
+			"stream", G_TYPE_STRING, "video",
+			"buf-data-len", G_TYPE_UINT, data_len,
+			"buf-size", G_TYPE_UINT, size,
+			"checkin-pts", G_TYPE_UINT64, checkin_pts,
+			"current-pts", G_TYPE_UINT64, current_pts,
+			"stall-time", G_TYPE_UINT64, amlvdec->stall_time,
+			NULL);
+	g_mutex_unlock(&amlvdec->stats_lock);
+	return stats;
+}
+
+static void
+gst_aml_vdec_add_stall (GstAmlVdec *amlvdec, gint64 usec)
+{
+	g_mutex_lock(&amlvdec->stats_lock);
+	amlvdec->stall_time += usec * GST_USECOND;
+	g_mutex_unlock(&amlvdec->stats_lock);
+}
+
 static void
 gst_aml_vdec_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
@@ -210,6 +313,24 @@ gst_aml_vdec_get_property (GObject * object, guint prop_id,
 	GstAmlVdec *amlvdec = GST_AMLVDEC(object);
 
 	switch (prop_id) {
+	case PROP_HW_STATS:
+		g_value_take_boxed(value, gst_aml_vdec_get_hw_stats(amlvdec));
+		break;
+	case PROP_CAPTURE_LOCATION:
+		GST_OBJECT_LOCK(amlvdec);
+		g_value_set_string(value, amlvdec->capture_location);
+		GST_OBJECT_UNLOCK(amlvdec);
+		break;
+	case PROP_DUMP_SIZE:
+		GST_OBJECT_LOCK(amlvdec);
+		g_value_set_uint(value, amlvdec->dump_size);
+		GST_OBJECT_UNLOCK(amlvdec);
+		break;
+	case PROP_DUMP_LOCATION:
+		GST_OBJECT_LOCK(amlvdec);
+		g_value_set_string(value, amlvdec->dump_location);
+		GST_OBJECT_UNLOCK(amlvdec);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -220,9 +341,14 @@ static gboolean
 gst_aml_vdec_open(GstVideoDecoder * dec)
 {
 	GstAmlVdec *amlvdec = GST_AMLVDEC(dec);
+	codec_para_t *pcodec;
 
-	amlvdec->pcodec = g_malloc(sizeof(codec_para_t));
-	memset(amlvdec->pcodec, 0, sizeof(codec_para_t));
+	pcodec = g_malloc(sizeof(codec_para_t));
+	memset(pcodec, 0, sizeof(codec_para_t));
+	amlCodecSetWait(pcodec, &amlvdec->wait);
+	g_mutex_lock(&amlvdec->stats_lock);
+	amlvdec->pcodec = pcodec;
+	g_mutex_unlock(&amlvdec->stats_lock);
 
 	set_tsync_enable(0);
 	set_tsync_mode(TSYNC_MODE_PCRSCR);
@@ -318,7 +444,9 @@ gst_aml_vdec_close(GstVideoDecoder * dec)
 	gint ret = 0;
 	stop_eos_task(amlvdec);
 	if (amlvdec->codec_init_ok) {
+		g_mutex_lock(&amlvdec->stats_lock);
 		amlvdec->codec_init_ok = 0;
+		g_mutex_unlock(&amlvdec->stats_lock);
 		if (amlvdec->is_paused == TRUE) {
 			ret = codec_resume(amlvdec->pcodec);
 			if (ret != 0) {
@@ -328,7 +456,14 @@ gst_aml_vdec_close(GstVideoDecoder * dec)
 			}
 		}
 		set_black_policy(1);
+		amlCodecSetCapture(amlvdec->pcodec, NULL);
+		GST_OBJECT_LOCK(amlvdec);
+		amlEsCaptureClose(amlvdec->capture);
+		amlvdec->capture = NULL;
+		GST_OBJECT_UNLOCK(amlvdec);
+		g_mutex_lock(&amlvdec->stats_lock);
 		codec_close(amlvdec->pcodec);
+		g_mutex_unlock(&amlvdec->stats_lock);
 
 		amlvdec->is_headerfeed = FALSE;
 		if (amlvdec->input_state) {
@@ -343,8 +478,11 @@ gst_aml_vdec_close(GstVideoDecoder * dec)
 	}
 
 	if (amlvdec->pcodec) {
+		amlCodecSetWait(amlvdec->pcodec, NULL);
+		g_mutex_lock(&amlvdec->stats_lock);
 		g_free(amlvdec->pcodec);
 		amlvdec->pcodec = NULL;
+		g_mutex_unlock(&amlvdec->stats_lock);
 	}
 
 	if (amlvdec->list) {
@@ -373,6 +511,11 @@ gst_aml_vdec_start(GstVideoDecoder * dec)
 	amlvdec->trickRate = 1.0;
 	amlvdec->segment.rate = 1.0;
 	amlvdec->list = NULL;
+	g_mutex_lock(&amlvdec->stats_lock);
+	amlvdec->last_checkin_pts = -1L;
+	amlvdec->stall_time = 0;
+	g_mutex_unlock(&amlvdec->stats_lock);
+	amlvdec->replay = FALSE;
 	vrate=1.0;
 	amsysfs_set_sysfs_str("/sys/class/vfm/map", "rm default");
 	amsysfs_set_sysfs_str("/sys/class/vfm/map", "add default decoder ppmgr deinterlace amvideo");
@@ -417,6 +560,7 @@ static gboolean gst_aml_vdec_set_format(GstVideoDecoder *dec, GstVideoCodecState
 	structure = gst_caps_get_structure(state->caps, 0);
 	name = gst_structure_get_name(structure);
 	GST_INFO_OBJECT(amlvdec, "format = %s", name);
+	amlvdec->replay = gst_structure_has_field(structure, "aml-es-replay");
 	if (name) {
 		ret = gst_set_vstream_info(amlvdec, state->caps);
 		if (!amlvdec->output_state && amlvdec->pcodec->am_sysinfo.width
@@ -431,6 +575,10 @@ static gboolean gst_aml_vdec_set_format(GstVideoDecoder *dec, GstVideoCodecState
 					fmt, info->width,
 					info->height,
 					amlvdec->input_state);
+			/* tells amlvsink not to prepare the yuvplayer for these caps */
+			amlvdec->output_state->caps = gst_video_info_to_caps(&amlvdec->output_state->info);
+			gst_caps_set_simple(amlvdec->output_state->caps, "aml-hw-decoded",
+					G_TYPE_BOOLEAN, TRUE, NULL);
 			gst_video_decoder_negotiate (GST_VIDEO_DECODER (amlvdec));
 		}
 
@@ -472,8 +620,9 @@ gst_aml_vdec_handle_frame(GstVideoDecoder *dec, GstVideoCodecFrame *frame)
 			if (G_UNLIKELY(ret != GST_FLOW_OK)) {
 				GST_ERROR_OBJECT(amlvdec, "failed to allocate output frame");
 				gst_video_codec_frame_unref(p);
+			} else if (gst_aml_vdec_decode(amlvdec, p->input_buffer, p) == GST_FLOW_FLUSHING) {
+				gst_video_decoder_drop_frame(dec, p);
 			} else {
-				gst_aml_vdec_decode(amlvdec, p->input_buffer, p);
 				GST_BUFFER_FLAG_SET(p->output_buffer, (1 << 16));   //set flag to avoid use yuvplayer
 				gst_video_decoder_finish_frame(dec, p);
 			}
@@ -486,6 +635,17 @@ gst_aml_vdec_handle_frame(GstVideoDecoder *dec, GstVideoCodecFrame *frame)
 	return GST_FLOW_OK;
 }
 
+/* the output buffers only carry AMLDEC_FLAG, the picture goes through
+ * the hardware; keep them out of amlvsink's ION pool so acquiring one
+ * does not start the yuvplayer */
+static gboolean
+gst_aml_vdec_decide_allocation(GstVideoDecoder * dec, GstQuery * query)
+{
+	while (gst_query_get_n_allocation_pools(query) > 0)
+		gst_query_remove_nth_allocation_pool(query, 0);
+	return GST_VIDEO_DECODER_CLASS(parent_class)->decide_allocation(dec, query);
+}
+
 static gboolean
 gst_aml_vdec_sink_event  (GstVideoDecoder * dec, GstEvent * event)
 {
@@ -502,6 +662,18 @@ gst_aml_vdec_sink_event  (GstVideoDecoder * dec, GstEvent * event)
 				event);
 		break;
 	}
+	/* FLUSH_START is not serialized, it arrives while the streaming
+	 * thread may be sleeping on a full vbuf */
+	case GST_EVENT_FLUSH_START:
+		amlWaitSetFlushing(&amlvdec->wait, TRUE);
+		ret = GST_VIDEO_DECODER_CLASS (parent_class)->sink_event(amlvdec,
+				event);
+		break;
+	case GST_EVENT_FLUSH_STOP:
+		amlWaitSetFlushing(&amlvdec->wait, FALSE);
+		ret = GST_VIDEO_DECODER_CLASS (parent_class)->sink_event(amlvdec,
+				event);
+		break;
 #if 0
 	case GST_EVENT_FLUSH_START:
 
@@ -577,6 +749,15 @@ gst_aml_vdec_change_state (GstElement * element, GstStateChange transition)
 		GST_INFO_OBJECT(amlvdec, "GST_STATE_CHANGE_PAUSED_TO_PLAYING");
 		break;
 
+	case GST_STATE_CHANGE_READY_TO_PAUSED:
+		amlWaitSetFlushing(&amlvdec->wait, FALSE);
+		break;
+
+	/* the sink pad deactivation below waits for the streaming thread */
+	case GST_STATE_CHANGE_PAUSED_TO_READY:
+		amlWaitSetFlushing(&amlvdec->wait, TRUE);
+		break;
+
 	default:
 		break;
 	}
@@ -592,6 +773,7 @@ gst_aml_vdec_change_state (GstElement * element, GstStateChange transition)
 				GST_ERROR_OBJECT(amlvdec, "pause failed!ret=%d", ret);
 			} else {
 				amlvdec->is_paused = TRUE;
+				amlWaitWake(&amlvdec->wait);
 			}
 		}
 		break;
@@ -638,8 +820,11 @@ gst_aml_vdec_flush(GstVideoDecoder * dec)
 			} else {
 				amlvdec->is_headerfeed = FALSE;
 			}
+			amlEsCaptureFlush(amlvdec->capture);
 			amlvdec->is_eos = FALSE;
+			g_mutex_lock(&amlvdec->stats_lock);
 			amlvdec->last_checkin_pts = -1L;
+			g_mutex_unlock(&amlvdec->stats_lock);
 			gst_task_start(amlvdec->eos_task);
 		}
 	}
@@ -691,7 +876,16 @@ gst_set_vstream_info(GstAmlVdec *amlvdec, GstCaps * caps)
 			}
 
 			codec_set_pcrscr(amlvdec->pcodec, 0);
+			g_mutex_lock(&amlvdec->stats_lock);
 			amlvdec->codec_init_ok = 1;
+			g_mutex_unlock(&amlvdec->stats_lock);
+			GST_OBJECT_LOCK(amlvdec);
+			if (amlvdec->capture_location || amlvdec->dump_size) {
+				amlvdec->capture = amlEsCaptureNew(amlvdec->capture_location,
+						(gsize) amlvdec->dump_size << 20, AML_ES_STREAM_VIDEO, caps);
+				amlCodecSetCapture(amlvdec->pcodec, amlvdec->capture);
+			}
+			GST_OBJECT_UNLOCK(amlvdec);
 			if (amlvdec->trickRate > 0) {
 				if (amlvdec->pcodec && amlvdec->pcodec->cntl_handle) {
 //T					codec_set_video_playrate(amlvdec->pcodec, (int) (amlvdec->trickRate * (1 << 16)));
@@ -716,6 +910,7 @@ gst_aml_vdec_decode (GstAmlVdec *amlvdec, GstBuffer * buf, GstVideoCodecFrame *f
 
 	struct buf_status vbuf;
 	GstMapInfo map;
+	gint64 stall_start = 0;
 
 	if (amlvdec->pcodec && amlvdec->codec_init_ok) {
 		while (codec_get_vbuf_state(amlvdec->pcodec, &vbuf) == 0) {
@@ -725,7 +920,20 @@ gst_aml_vdec_decode (GstAmlVdec *amlvdec, GstBuffer * buf, GstVideoCodecFrame *f
 			if (amlvdec->is_paused) {
 				break;
 			}
-			usleep(20000);
+			if (!stall_start)
+				stall_start = g_get_monotonic_time();
+			if (!amlWaitSleep(&amlvdec->wait, 20000)) {
+				ret = GST_FLOW_FLUSHING;
+				break;
+			}
+		}
+		if (stall_start) {
+			gst_aml_vdec_add_stall(amlvdec, g_get_monotonic_time() - stall_start);
+			stall_start = 0;
+		}
+		if (ret == GST_FLOW_FLUSHING) {
+			GST_DEBUG_OBJECT(amlvdec, "flushing, dropping frame");
+			return ret;
 		}
 		/*
 		if (GST_BUFFER_PTS_IS_VALID(buf))
@@ -748,34 +956,30 @@ gst_aml_vdec_decode (GstAmlVdec *amlvdec, GstBuffer * buf, GstVideoCodecFrame *f
 			if (codec_checkin_pts(amlvdec->pcodec, (unsigned long) pts) != 0) {
 				GST_ERROR_OBJECT(amlvdec, "pts checkin flied maybe lose sync");
 			} else {
+				g_mutex_lock(&amlvdec->stats_lock);
 				amlvdec->last_checkin_pts = pts;
+				g_mutex_unlock(&amlvdec->stats_lock);
+				amlEsCapturePts(amlvdec->capture, pts, timestamp);
 			}
 		}
 
+		/* replayed captures already contain the headers and startcodes */
 		if (!amlvdec->is_headerfeed) {
-			if (amlvdec->info->writeheader) {
+			if (amlvdec->info->writeheader && !amlvdec->replay) {
 				amlvdec->info->writeheader(amlvdec->info, amlvdec->pcodec);
 			}
 			amlvdec->is_headerfeed = TRUE;
 		}
-		if (amlvdec->info->add_startcode) {
+		if (amlvdec->info->add_startcode && !amlvdec->replay) {
 			amlvdec->info->add_startcode(amlvdec->info, amlvdec->pcodec, buf);
 		}
 		gst_buffer_map(buf, &map, GST_MAP_READ);
 		data = map.data;
 		size = map.size;
-#if 0
-		FILE *fp2= fopen("/mnt/codec.data","a+");
-		if (fp2) {
-			int flen=fwrite(data,1,size,fp2);
-			fclose(fp2);
-		} else {
-			g_print("could not open file:codec.data");
-		}
-#endif
 		while (size > 0) {
 			written = codec_write(amlvdec->pcodec, data, size);
 			if (written >= 0) {
+				amlEsCaptureWrite(amlvdec->capture, AML_ES_RECORD_DATA, data, written);
 				size -= written;
 				data += written;
 			} else if (errno == EAGAIN || errno == EINTR) {
@@ -783,13 +987,20 @@ gst_aml_vdec_decode (GstAmlVdec *amlvdec, GstBuffer * buf, GstVideoCodecFrame *f
 				if (amlvdec->is_paused) {
 					break;
 				}
-				usleep(20000);
+				if (!stall_start)
+					stall_start = g_get_monotonic_time();
+				if (!amlWaitSleep(&amlvdec->wait, 20000)) {
+					ret = GST_FLOW_FLUSHING;
+					break;
+				}
 			} else {
 				GST_ERROR_OBJECT(amlvdec, "codec_write failed");
 				ret = GST_FLOW_ERROR;
 				break;
 			}
 		}
+		if (stall_start)
+			gst_aml_vdec_add_stall(amlvdec, g_get_monotonic_time() - stall_start);
 		gst_buffer_unmap(buf, &map);
 	}
 	return ret;
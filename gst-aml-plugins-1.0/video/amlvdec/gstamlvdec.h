@@ -87,6 +87,14 @@ struct _GstAmlVdec
     GstTask * eos_task;
     GStaticRecMutex eos_lock;
     unsigned long last_checkin_pts;
+    GstClockTime stall_time;	/* cumulative time spent waiting for vbuf space */
+    GMutex stats_lock;	/* hw-stats from other threads: pcodec, codec_init_ok and the counters */
+    AmlWait wait;		/* vbuf/codec_write sleeps, flushing on FLUSH_START and PAUSED->READY */
+    gchar *capture_location;
+    AmlEsCapture *capture;
+    guint dump_size;	/* MB of ES kept in memory for dump-location, 0: off */
+    gchar *dump_location;
+    gboolean replay;		/* input comes from amlesrc, already in codec_write form */
     GstSegment segment;
     GSList *list;
     GstVideoCodecState *input_state;
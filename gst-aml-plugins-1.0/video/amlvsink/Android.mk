@@ -17,7 +17,7 @@ LOCAL_C_INCLUDES += \
     $(gcv_3rd_install_prefix)/include/glib-2.0/glib/gobject
 
 
-LOCAL_SRC_FILES := gstamlvsink.c 
+LOCAL_SRC_FILES := gstamlvsink.c amlvsink_copy.c amlvsink_pool.c
 
 #LOCAL_STATIC_LIBRARIES +=
 LOCAL_SHARED_LIBRARIES += libamlstreaminfo
@@ -0,0 +1,1011 @@
+/*
+ * amlvsink_copy.c
+ *
+ * Plane copy for the yuvplayer path, see amlvsink_copy.h.
+ *
+ * The conversions work on row pairs: two luma rows and the chroma row
+ * they share are written in one go, chroma of packed sources is the
+ * rounded average of the pair. RGB goes through BT.601 limited range.
+ *
+ * Overlays are blended at full resolution, each chroma sample is the
+ * mean of its blended 2x2 block: d (1 - mean a) + mean (a c), with the
+ * alpha of the block's pixels that lie outside the overlay taken as 0.
+ *
+ * The downscale is a box filter, one pass per dst row: the source rows
+ * are widened and summed to 16 bit, pairwise adds fold the neighbouring
+ * samples of one component (every other byte of NV12/NV21 chroma) and a
+ * rounding shift gives the mean.
+ *
+ * AML_COPY_STREAM only changes the plain row copy: SSE2 has
+ * _mm_stream_si128; NEON has no non-temporal vector store, the cores
+ * already stop allocating on long store runs and write-combined memory
+ * merges the stores on the bus, so ARM keeps vst1q.
+ */
+
+#include <string.h>
+#include "amlvsink_copy.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AML_COPY_SIMD   1
+typedef uint8x16_t aml_vec;
+#define aml_vec_load(p)         vld1q_u8((const uint8_t *) (p))
+#define aml_vec_store(p, v)     vst1q_u8((uint8_t *) (p), (v))
+#define aml_vec_splat(x)        vdupq_n_u8(x)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AML_COPY_SIMD   1
+typedef __m128i aml_vec;
+#define aml_vec_load(p)         _mm_loadu_si128((const __m128i *) (p))
+#define aml_vec_store(p, v)     _mm_storeu_si128((__m128i *) (p), (v))
+#define aml_vec_splat(x)        _mm_set1_epi8((char) (x))
+#define AML_COPY_STREAM_SIMD    1
+#define aml_vec_stream(p, v)    _mm_stream_si128((__m128i *) (p), (v))
+#else
+#define AML_COPY_SIMD   0
+#endif
+
+struct _AmlCopyPool {
+    GThreadPool *threads;
+    gint n_threads;
+    GMutex lock;
+    GCond done;
+    gint pending;
+};
+
+typedef struct {
+    AmlCopyPool *pool;
+    AmlPlane plane;
+    const AmlConvertFrame *frame;   /* NULL: copy plane */
+    gint row, rows;                 /* of frame, row is even */
+} AmlCopyBand;
+
+#ifndef AML_COPY_STREAM_SIMD
+#define AML_COPY_STREAM_SIMD    0
+#endif
+
+#if AML_COPY_SIMD
+/* 64 bytes per iteration in the body, whole 16 byte vectors for the
+ * tail of the row merged with the first padding bytes, then vector
+ * stores of the pad value up to the stride */
+static void aml_copy_row(guint8 *dst, gint dst_stride, const guint8 *src,
+        gint width, aml_vec pad, guint8 pad_value)
+{
+    gint x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        aml_vec a = aml_vec_load(src + x);
+        aml_vec b = aml_vec_load(src + x + 16);
+        aml_vec c = aml_vec_load(src + x + 32);
+        aml_vec d = aml_vec_load(src + x + 48);
+        aml_vec_store(dst + x, a);
+        aml_vec_store(dst + x + 16, b);
+        aml_vec_store(dst + x + 32, c);
+        aml_vec_store(dst + x + 48, d);
+    }
+    for (; x + 16 <= width; x += 16)
+        aml_vec_store(dst + x, aml_vec_load(src + x));
+    if (x < width) {
+        guint8 tail[16];
+
+        /* never read past the end of the source row */
+        memset(tail, pad_value, sizeof(tail));
+        memcpy(tail, src + x, width - x);
+        if (x + 16 <= dst_stride) {
+            aml_vec_store(dst + x, aml_vec_load(tail));
+            x += 16;
+        } else {
+            memcpy(dst + x, tail, dst_stride - x);
+            return;
+        }
+    }
+    for (; x + 16 <= dst_stride; x += 16)
+        aml_vec_store(dst + x, pad);
+    if (x < dst_stride)
+        memset(dst + x, pad_value, dst_stride - x);
+}
+#endif
+
+#if AML_COPY_STREAM_SIMD
+/* aml_copy_row with non-temporal stores, dst 16 byte aligned */
+static void aml_stream_row(guint8 *dst, gint dst_stride, const guint8 *src,
+        gint width, aml_vec pad, guint8 pad_value)
+{
+    gint x = 0;
+
+    for (; x + 64 <= width; x += 64) {
+        aml_vec a = aml_vec_load(src + x);
+        aml_vec b = aml_vec_load(src + x + 16);
+        aml_vec c = aml_vec_load(src + x + 32);
+        aml_vec d = aml_vec_load(src + x + 48);
+        aml_vec_stream(dst + x, a);
+        aml_vec_stream(dst + x + 16, b);
+        aml_vec_stream(dst + x + 32, c);
+        aml_vec_stream(dst + x + 48, d);
+    }
+    for (; x + 16 <= width; x += 16)
+        aml_vec_stream(dst + x, aml_vec_load(src + x));
+    if (x < width) {
+        guint8 tail[16];
+
+        memset(tail, pad_value, sizeof(tail));
+        memcpy(tail, src + x, width - x);
+        if (x + 16 <= dst_stride) {
+            aml_vec_stream(dst + x, aml_vec_load(tail));
+            x += 16;
+        } else {
+            memcpy(dst + x, tail, dst_stride - x);
+            return;
+        }
+    }
+    for (; x + 16 <= dst_stride; x += 16)
+        aml_vec_stream(dst + x, pad);
+    if (x < dst_stride)
+        memset(dst + x, pad_value, dst_stride - x);
+}
+#endif
+
+static void aml_copy_rows(guint8 *dst, gint dst_stride, const guint8 *src, gint src_stride,
+        gint width, gint height, guint8 pad, guint flags)
+{
+    gint y;
+#if AML_COPY_SIMD
+    aml_vec pad_vec = aml_vec_splat(pad);
+
+#if AML_COPY_STREAM_SIMD
+    if ((flags & AML_COPY_STREAM) && ((gsize) dst & 15) == 0 && (dst_stride & 15) == 0) {
+        for (y = 0; y < height; y++)
+            aml_stream_row(dst + y * dst_stride, dst_stride, src + y * src_stride,
+                    width, pad_vec, pad);
+        /* order the weakly ordered stores before the buffer is handed on */
+        _mm_sfence();
+        return;
+    }
+#endif
+    for (y = 0; y < height; y++)
+        aml_copy_row(dst + y * dst_stride, dst_stride, src + y * src_stride,
+                width, pad_vec, pad);
+#else
+    if (src_stride == width && dst_stride == width) {
+        memcpy(dst, src, (gsize) width * height);
+        return;
+    }
+    for (y = 0; y < height; y++) {
+        memcpy(dst + y * dst_stride, src + y * src_stride, width);
+        memset(dst + y * dst_stride + width, pad, dst_stride - width);
+    }
+#endif
+}
+
+void amlCopyRows(guint8 *dst, gint dst_stride, const guint8 *src, gint src_stride,
+        gint width, gint height, guint8 pad)
+{
+    aml_copy_rows(dst, dst_stride, src, src_stride, width, height, pad, 0);
+}
+
+/* 2:1 in one pass: n dst bytes from rows s0 and s1 */
+static void aml_scale2_row(guint8 *d, const guint8 *s0, const guint8 *s1, gint n, gint step)
+{
+    gint x = 0, i;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 16 <= n; x += 16) {
+        if (step == 1) {
+            uint16x8_t lo = vpadalq_u8(vpaddlq_u8(vld1q_u8(s0 + 2 * x)), vld1q_u8(s1 + 2 * x));
+            uint16x8_t hi = vpadalq_u8(vpaddlq_u8(vld1q_u8(s0 + 2 * x + 16)),
+                    vld1q_u8(s1 + 2 * x + 16));
+
+            vst1q_u8(d + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+        } else {
+            uint8x16x2_t a = vld2q_u8(s0 + 2 * x), b = vld2q_u8(s1 + 2 * x);
+            uint8x8x2_t out;
+
+            out.val[0] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(a.val[0]), b.val[0]), 2);
+            out.val[1] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(a.val[1]), b.val[1]), 2);
+            vst2_u8(d + x, out);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i low = _mm_set1_epi16(0x00ff), two = _mm_set1_epi16(2);
+    const __m128i ones = _mm_set1_epi16(1);
+
+    for (; x + 16 <= n; x += 16) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (s0 + 2 * x));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (s0 + 2 * x + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *) (s1 + 2 * x));
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (s1 + 2 * x + 16));
+        /* u16 lanes: even and odd bytes of both rows */
+        __m128i e0 = _mm_add_epi16(_mm_and_si128(a0, low), _mm_and_si128(b0, low));
+        __m128i e1 = _mm_add_epi16(_mm_and_si128(a1, low), _mm_and_si128(b1, low));
+        __m128i o0 = _mm_add_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(b0, 8));
+        __m128i o1 = _mm_add_epi16(_mm_srli_epi16(a1, 8), _mm_srli_epi16(b1, 8));
+        __m128i out;
+
+        if (step == 1) {
+            e0 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(e0, o0), two), 2);
+            e1 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(e1, o1), two), 2);
+            out = _mm_packus_epi16(e0, e1);
+        } else {
+            /* even bytes are U, odd V (or the other way round), sum pixel pairs */
+            __m128i u = _mm_packs_epi32(_mm_madd_epi16(e0, ones), _mm_madd_epi16(e1, ones));
+            __m128i v = _mm_packs_epi32(_mm_madd_epi16(o0, ones), _mm_madd_epi16(o1, ones));
+
+            u = _mm_srli_epi16(_mm_add_epi16(u, two), 2);
+            v = _mm_srli_epi16(_mm_add_epi16(v, two), 2);
+            out = _mm_packus_epi16(u, v);
+            out = _mm_unpacklo_epi8(out, _mm_srli_si128(out, 8));
+        }
+        _mm_storeu_si128((__m128i *) (d + x), out);
+    }
+#endif
+    for (; x < n; x++) {
+        i = x / step * 2 * step + x % step;
+        d[x] = (s0[i] + s0[i + step] + s1[i] + s1[i + step] + 2) >> 2;
+    }
+}
+
+/* 4:1 in one pass: n dst bytes from four rows of s, stride apart; the
+ * 16 bytes per iteration are 64 source bytes of each row */
+static void aml_scale4_row(guint8 *d, const guint8 *s, gint stride, gint n, gint step)
+{
+    gint x = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 16 <= n; x += 16) {
+        const guint8 *p = s + 4 * x;
+        gint r, h;
+
+        if (step == 1) {
+            uint8x8_t out[2];
+
+            for (h = 0; h < 2; h++) {
+                uint16x8_t a = vpaddlq_u8(vld1q_u8(p + 32 * h));
+                uint16x8_t b = vpaddlq_u8(vld1q_u8(p + 32 * h + 16));
+
+                for (r = 1; r < 4; r++) {
+                    a = vpadalq_u8(a, vld1q_u8(p + (gsize) r * stride + 32 * h));
+                    b = vpadalq_u8(b, vld1q_u8(p + (gsize) r * stride + 32 * h + 16));
+                }
+                out[h] = vrshrn_n_u16(vcombine_u16(
+                        vpadd_u16(vget_low_u16(a), vget_high_u16(a)),
+                        vpadd_u16(vget_low_u16(b), vget_high_u16(b))), 4);
+            }
+            vst1q_u8(d + x, vcombine_u8(out[0], out[1]));
+        } else {
+            uint16x8_t sum[2][2];   /* [half][component] */
+            uint8x8x2_t out;
+            gint c;
+
+            for (h = 0; h < 2; h++) {
+                uint8x16x2_t v = vld2q_u8(p + 32 * h);
+
+                sum[h][0] = vpaddlq_u8(v.val[0]);
+                sum[h][1] = vpaddlq_u8(v.val[1]);
+                for (r = 1; r < 4; r++) {
+                    v = vld2q_u8(p + (gsize) r * stride + 32 * h);
+                    sum[h][0] = vpadalq_u8(sum[h][0], v.val[0]);
+                    sum[h][1] = vpadalq_u8(sum[h][1], v.val[1]);
+                }
+            }
+            for (c = 0; c < 2; c++)
+                out.val[c] = vrshrn_n_u16(vcombine_u16(
+                        vpadd_u16(vget_low_u16(sum[0][c]), vget_high_u16(sum[0][c])),
+                        vpadd_u16(vget_low_u16(sum[1][c]), vget_high_u16(sum[1][c]))), 4);
+            vst2_u8(d + x, out);
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi16(1);
+    const __m128i eight = _mm_set1_epi16(8);
+
+    for (; x + 16 <= n; x += 16) {
+        __m128i q[4];
+        gint k, r;
+
+        /* q[k]: step 1, four i32 quad sums; step 2, two u16 (even, odd) pairs
+         * of sums in dwords 0 and 1 */
+        for (k = 0; k < 4; k++) {
+            __m128i lo = zero, hi = zero;
+
+            for (r = 0; r < 4; r++) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (s + (gsize) r * stride
+                        + 4 * x + 16 * k));
+
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+            }
+            if (step == 1) {
+                lo = _mm_shuffle_epi32(_mm_madd_epi16(lo, ones), _MM_SHUFFLE(3, 1, 2, 0));
+                hi = _mm_shuffle_epi32(_mm_madd_epi16(hi, ones), _MM_SHUFFLE(3, 1, 2, 0));
+                q[k] = _mm_add_epi32(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+            } else {
+                lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 4));
+                hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 4));
+                q[k] = _mm_unpacklo_epi32(lo, hi);
+            }
+        }
+        if (step == 1) {
+            q[0] = _mm_packs_epi32(q[0], q[1]);
+            q[2] = _mm_packs_epi32(q[2], q[3]);
+        } else {
+            q[0] = _mm_unpacklo_epi64(q[0], q[1]);
+            q[2] = _mm_unpacklo_epi64(q[2], q[3]);
+        }
+        q[0] = _mm_srli_epi16(_mm_add_epi16(q[0], eight), 4);
+        q[2] = _mm_srli_epi16(_mm_add_epi16(q[2], eight), 4);
+        _mm_storeu_si128((__m128i *) (d + x), _mm_packus_epi16(q[0], q[2]));
+    }
+#endif
+    for (; x < n; x++) {
+        gint i = x / step * 4 * step + x % step;
+        guint sum = 0;
+        gint r, k;
+
+        for (r = 0; r < 4; r++)
+            for (k = 0; k < 4; k++)
+                sum += s[(gsize) r * stride + i + k * step];
+        d[x] = (sum + 8) >> 4;
+    }
+}
+
+/* every dst sample is the rounded mean of a 1 << scale square of src
+ * samples, scale 1 or 2; width and height count dst bytes and rows, src
+ * holds width << scale bytes of height << scale rows */
+static void aml_scale_rows(guint8 *dst, gint dst_stride, const guint8 *src, gint src_stride,
+        gint width, gint height, gint step, gint scale, guint8 pad)
+{
+    gint y;
+
+    for (y = 0; y < height; y++) {
+        const guint8 *s = src + ((gsize) y << scale) * src_stride;
+        guint8 *d = dst + (gsize) y * dst_stride;
+
+        if (scale == 1)
+            aml_scale2_row(d, s, s + src_stride, width, step);
+        else
+            aml_scale4_row(d, s, src_stride, width, step);
+        memset(d + width, pad, dst_stride - width);
+    }
+}
+
+/* NV12/NV21 chroma row: n interleaved pairs into two planes */
+static void aml_split_uv(guint8 *u, guint8 *v, const guint8 *uv, gint n)
+{
+    gint x = 0;
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 16 <= n; x += 16) {
+        uint8x16x2_t t = vld2q_u8(uv + 2 * x);
+        vst1q_u8(u + x, t.val[0]);
+        vst1q_u8(v + x, t.val[1]);
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+
+    for (; x + 16 <= n; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (uv + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *) (uv + 2 * x + 16));
+        _mm_storeu_si128((__m128i *) (u + x),
+                _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *) (v + x),
+                _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#endif
+    for (; x < n; x++) {
+        u[x] = uv[2 * x];
+        v[x] = uv[2 * x + 1];
+    }
+}
+
+/* YUY2 row pair: Y0 U Y1 V per two pixels */
+static void aml_yuy2_rows(guint8 *y0, guint8 *y1, guint8 *u, guint8 *v,
+        const guint8 *s0, const guint8 *s1, gint width)
+{
+    gint x = 0;
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 16 <= width; x += 16) {
+        uint8x8x4_t t0 = vld4_u8(s0 + 2 * x);
+        uint8x8x4_t t1 = vld4_u8(s1 + 2 * x);
+        uint8x8x2_t l0 = { { t0.val[0], t0.val[2] } };
+        uint8x8x2_t l1 = { { t1.val[0], t1.val[2] } };
+        vst2_u8(y0 + x, l0);
+        vst2_u8(y1 + x, l1);
+        vst1_u8(u + x / 2, vrhadd_u8(t0.val[1], t1.val[1]));
+        vst1_u8(v + x / 2, vrhadd_u8(t0.val[3], t1.val[3]));
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (s0 + 2 * x));
+        __m128i b0 = _mm_loadu_si128((const __m128i *) (s0 + 2 * x + 16));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (s1 + 2 * x));
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (s1 + 2 * x + 16));
+        __m128i c;
+
+        _mm_storeu_si128((__m128i *) (y0 + x),
+                _mm_packus_epi16(_mm_and_si128(a0, mask), _mm_and_si128(b0, mask)));
+        _mm_storeu_si128((__m128i *) (y1 + x),
+                _mm_packus_epi16(_mm_and_si128(a1, mask), _mm_and_si128(b1, mask)));
+        /* U V U V ... of both rows, averaged */
+        c = _mm_avg_epu8(
+                _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(b0, 8)),
+                _mm_packus_epi16(_mm_srli_epi16(a1, 8), _mm_srli_epi16(b1, 8)));
+        _mm_storel_epi64((__m128i *) (u + x / 2),
+                _mm_packus_epi16(_mm_and_si128(c, mask), mask));
+        _mm_storel_epi64((__m128i *) (v + x / 2),
+                _mm_packus_epi16(_mm_srli_epi16(c, 8), mask));
+    }
+#endif
+    for (; x < width; x += 2) {
+        y0[x] = s0[2 * x];
+        y1[x] = s1[2 * x];
+        if (x + 1 < width) {
+            y0[x + 1] = s0[2 * x + 2];
+            y1[x + 1] = s1[2 * x + 2];
+        }
+        u[x / 2] = (s0[2 * x + 1] + s1[2 * x + 1] + 1) >> 1;
+        v[x / 2] = (s0[2 * x + 3] + s1[2 * x + 3] + 1) >> 1;
+    }
+}
+
+#define AML_RGB_Y(r, g, b)  ((((66 * (r) + 129 * (g) + 25 * (b) + 128) >> 8)) + 16)
+#define AML_RGB_U(r, g, b)  ((((-38 * (r) - 74 * (g) + 112 * (b) + 128) >> 8)) + 128)
+#define AML_RGB_V(r, g, b)  ((((112 * (r) - 94 * (g) - 18 * (b) + 128) >> 8)) + 128)
+
+#if defined(__SSE2__) && !(defined(__ARM_NEON__) || defined(__ARM_NEON))
+/* one 8 bit channel of 8 xRGB words as 16 bit lanes */
+static inline __m128i aml_rgb_channel(__m128i a, __m128i b, __m128i shift)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    return _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(a, shift), mask),
+            _mm_and_si128(_mm_srl_epi32(b, shift), mask));
+}
+
+static inline __m128i aml_rgb_luma(__m128i r, __m128i g, __m128i b)
+{
+    __m128i y = _mm_add_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                    _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+            _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)),
+                    _mm_set1_epi16(128)));
+    /* at most 56228, unsigned shift */
+    y = _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+    return _mm_packus_epi16(y, y);
+}
+
+/* mean of the 2x2 blocks of two rows of 8 samples, 4 lanes */
+static inline __m128i aml_rgb_mean(__m128i c0, __m128i c1)
+{
+    __m128i sum = _mm_madd_epi16(_mm_add_epi16(c0, c1), _mm_set1_epi16(1));
+    sum = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(2)), 2);
+    return _mm_packs_epi32(sum, sum);
+}
+
+static inline __m128i aml_rgb_chroma(__m128i r, __m128i g, __m128i b,
+        gint16 cr, gint16 cg, gint16 cb)
+{
+    __m128i c = _mm_add_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)),
+                    _mm_mullo_epi16(g, _mm_set1_epi16(cg))),
+            _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(cb)),
+                    _mm_set1_epi16(128)));
+    c = _mm_add_epi16(_mm_srai_epi16(c, 8), _mm_set1_epi16(128));
+    return _mm_packus_epi16(c, c);
+}
+#endif
+
+/* RGBx / BGRx row pair; bgr swaps the first and third byte */
+static void aml_rgb_rows(guint8 *y0, guint8 *y1, guint8 *u, guint8 *v,
+        const guint8 *s0, const guint8 *s1, gint width, gboolean bgr)
+{
+    gint ri = bgr ? 2 : 0, bi = bgr ? 0 : 2;
+    gint x = 0;
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 8 <= width; x += 8) {
+        uint8x8x4_t p0 = vld4_u8(s0 + 4 * x);
+        uint8x8x4_t p1 = vld4_u8(s1 + 4 * x);
+        uint8x8_t r0 = p0.val[ri], g0 = p0.val[1], b0 = p0.val[bi];
+        uint8x8_t r1 = p1.val[ri], g1 = p1.val[1], b1 = p1.val[bi];
+        uint16x8_t acc;
+        int16x4_t r, g, b, c;
+        uint8_t out[8];
+
+        acc = vmlal_u8(vmlal_u8(vmull_u8(r0, vdup_n_u8(66)), g0, vdup_n_u8(129)), b0, vdup_n_u8(25));
+        vst1_u8(y0 + x, vadd_u8(vshrn_n_u16(vaddq_u16(acc, vdupq_n_u16(128)), 8), vdup_n_u8(16)));
+        acc = vmlal_u8(vmlal_u8(vmull_u8(r1, vdup_n_u8(66)), g1, vdup_n_u8(129)), b1, vdup_n_u8(25));
+        vst1_u8(y1 + x, vadd_u8(vshrn_n_u16(vaddq_u16(acc, vdupq_n_u16(128)), 8), vdup_n_u8(16)));
+
+        r = vreinterpret_s16_u16(vrshr_n_u16(vadd_u16(vpaddl_u8(r0), vpaddl_u8(r1)), 2));
+        g = vreinterpret_s16_u16(vrshr_n_u16(vadd_u16(vpaddl_u8(g0), vpaddl_u8(g1)), 2));
+        b = vreinterpret_s16_u16(vrshr_n_u16(vadd_u16(vpaddl_u8(b0), vpaddl_u8(b1)), 2));
+        c = vmla_n_s16(vmla_n_s16(vmul_n_s16(r, -38), g, -74), b, 112);
+        c = vadd_s16(vshr_n_s16(vadd_s16(c, vdup_n_s16(128)), 8), vdup_n_s16(128));
+        vst1_u8(out, vqmovun_s16(vcombine_s16(c, c)));
+        memcpy(u + x / 2, out, 4);
+        c = vmla_n_s16(vmla_n_s16(vmul_n_s16(r, 112), g, -94), b, -18);
+        c = vadd_s16(vshr_n_s16(vadd_s16(c, vdup_n_s16(128)), 8), vdup_n_s16(128));
+        vst1_u8(out, vqmovun_s16(vcombine_s16(c, c)));
+        memcpy(v + x / 2, out, 4);
+    }
+#elif defined(__SSE2__)
+    const __m128i rs = _mm_cvtsi32_si128(ri * 8), gs = _mm_cvtsi32_si128(8);
+    const __m128i bs = _mm_cvtsi32_si128(bi * 8);
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (s0 + 4 * x));
+        __m128i b0 = _mm_loadu_si128((const __m128i *) (s0 + 4 * x + 16));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (s1 + 4 * x));
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (s1 + 4 * x + 16));
+        __m128i r0 = aml_rgb_channel(a0, b0, rs), r1 = aml_rgb_channel(a1, b1, rs);
+        __m128i g0 = aml_rgb_channel(a0, b0, gs), g1 = aml_rgb_channel(a1, b1, gs);
+        __m128i c0 = aml_rgb_channel(a0, b0, bs), c1 = aml_rgb_channel(a1, b1, bs);
+        __m128i r, g, b;
+        gint32 out;
+
+        _mm_storel_epi64((__m128i *) (y0 + x), aml_rgb_luma(r0, g0, c0));
+        _mm_storel_epi64((__m128i *) (y1 + x), aml_rgb_luma(r1, g1, c1));
+        r = aml_rgb_mean(r0, r1);
+        g = aml_rgb_mean(g0, g1);
+        b = aml_rgb_mean(c0, c1);
+        out = _mm_cvtsi128_si32(aml_rgb_chroma(r, g, b, -38, -74, 112));
+        memcpy(u + x / 2, &out, 4);
+        out = _mm_cvtsi128_si32(aml_rgb_chroma(r, g, b, 112, -94, -18));
+        memcpy(v + x / 2, &out, 4);
+    }
+#endif
+    for (; x < width; x += 2) {
+        const guint8 *p0 = s0 + 4 * x, *p1 = s1 + 4 * x;
+        /* a missing right pixel repeats the left one */
+        const guint8 *q0 = x + 1 < width ? p0 + 4 : p0;
+        const guint8 *q1 = x + 1 < width ? p1 + 4 : p1;
+        gint r = (p0[ri] + q0[ri] + p1[ri] + q1[ri] + 2) >> 2;
+        gint g = (p0[1] + q0[1] + p1[1] + q1[1] + 2) >> 2;
+        gint b = (p0[bi] + q0[bi] + p1[bi] + q1[bi] + 2) >> 2;
+
+        y0[x] = AML_RGB_Y(p0[ri], p0[1], p0[bi]);
+        y1[x] = AML_RGB_Y(p1[ri], p1[1], p1[bi]);
+        if (x + 1 < width) {
+            y0[x + 1] = AML_RGB_Y(q0[ri], q0[1], q0[bi]);
+            y1[x + 1] = AML_RGB_Y(q1[ri], q1[1], q1[bi]);
+        }
+        u[x / 2] = AML_RGB_U(r, g, b);
+        v[x / 2] = AML_RGB_V(r, g, b);
+    }
+}
+
+/* straight alpha to a 0..256 weight, exact at both ends */
+#define AML_BLEND_WEIGHT(a)     ((a) + ((a) >> 7))
+
+/* n AYUV pixels over n luma samples */
+static void aml_blend_luma(guint8 *d, const guint8 *s, gint n)
+{
+    gint x = 0;
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 8 <= n; x += 8) {
+        uint8x8x4_t p = vld4_u8(s + 4 * x);
+        uint16x8_t a = vaddw_u8(vmovl_u8(p.val[0]), vshr_n_u8(p.val[0], 7));
+        uint16x8_t acc = vmulq_u16(vmovl_u8(vld1_u8(d + x)), vsubq_u16(vdupq_n_u16(256), a));
+
+        /* at most 255 * 256 + 128, no overflow */
+        acc = vmlaq_u16(acc, vmovl_u8(p.val[1]), a);
+        vst1_u8(d + x, vshrn_n_u16(vaddq_u16(acc, vdupq_n_u16(128)), 8));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i as = _mm_cvtsi32_si128(0), ys = _mm_cvtsi32_si128(8);
+
+    for (; x + 8 <= n; x += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *) (s + 4 * x));
+        __m128i p1 = _mm_loadu_si128((const __m128i *) (s + 4 * x + 16));
+        __m128i a = aml_rgb_channel(p0, p1, as);
+        __m128i y = aml_rgb_channel(p0, p1, ys);
+        __m128i dv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (d + x)), zero);
+        __m128i acc;
+
+        a = _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+        acc = _mm_add_epi16(_mm_mullo_epi16(dv, _mm_sub_epi16(_mm_set1_epi16(256), a)),
+                _mm_mullo_epi16(y, a));
+        acc = _mm_srli_epi16(_mm_add_epi16(acc, _mm_set1_epi16(128)), 8);
+        _mm_storel_epi64((__m128i *) (d + x), _mm_packus_epi16(acc, acc));
+    }
+#endif
+    for (; x < n; x++) {
+        guint a = AML_BLEND_WEIGHT(s[4 * x]);
+
+        d[x] = (d[x] * (256 - a) + s[4 * x + 1] * a + 128) >> 8;
+    }
+}
+
+/* one chroma sample over overlay pixels px, px + 1 of rows s0 and s1,
+ * NULL rows and columns outside 0..w are transparent */
+static void aml_blend_chroma(guint8 *u, guint8 *v, const guint8 *s0, const guint8 *s1,
+        gint px, gint w)
+{
+    guint sum = 0, su = 0, sv = 0;
+    gint r, i;
+
+    for (r = 0; r < 2; r++) {
+        const guint8 *s = r ? s1 : s0;
+
+        if (!s)
+            continue;
+        for (i = MAX(px, 0); i < MIN(px + 2, w); i++) {
+            guint a = AML_BLEND_WEIGHT(s[4 * i]);
+
+            sum += a;
+            su += a * s[4 * i + 2];
+            sv += a * s[4 * i + 3];
+        }
+    }
+    *u = (*u * (1024 - sum) + su + 512) >> 10;
+    *v = (*v * (1024 - sum) + sv + 512) >> 10;
+}
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+/* four chroma samples from 8 pixels of both rows; step 2 is NV12/NV21,
+ * u and v then share 8 interleaved bytes */
+static void aml_blend_chroma4(guint8 *u, guint8 *v, gint step,
+        const guint8 *p0, const guint8 *p1)
+{
+    uint8x8x4_t r0 = vld4_u8(p0), r1 = vld4_u8(p1);
+    uint16x8_t a0 = vaddw_u8(vmovl_u8(r0.val[0]), vshr_n_u8(r0.val[0], 7));
+    uint16x8_t a1 = vaddw_u8(vmovl_u8(r1.val[0]), vshr_n_u8(r1.val[0], 7));
+    uint32x4_t inv = vsubq_u32(vdupq_n_u32(1024), vpadalq_u16(vpaddlq_u16(a0), a1));
+    /* a * c is at most 256 * 255, fits 16 bits */
+    uint32x4_t su = vpadalq_u16(vpaddlq_u16(vmulq_u16(a0, vmovl_u8(r0.val[2]))),
+            vmulq_u16(a1, vmovl_u8(r1.val[2])));
+    uint32x4_t sv = vpadalq_u16(vpaddlq_u16(vmulq_u16(a0, vmovl_u8(r0.val[3]))),
+            vmulq_u16(a1, vmovl_u8(r1.val[3])));
+    guint8 *lo = MIN(u, v);
+    uint8x8_t du, dv, ou, ov;
+    uint32_t w;
+
+    if (step == 1) {
+        memcpy(&w, u, 4);
+        du = vreinterpret_u8_u32(vdup_n_u32(w));
+        memcpy(&w, v, 4);
+        dv = vreinterpret_u8_u32(vdup_n_u32(w));
+    } else {
+        uint8x8_t raw = vld1_u8(lo);
+        uint8x8x2_t z = vuzp_u8(raw, raw);
+
+        du = z.val[u == lo ? 0 : 1];
+        dv = z.val[u == lo ? 1 : 0];
+    }
+    su = vmlaq_u32(su, vmovl_u16(vget_low_u16(vmovl_u8(du))), inv);
+    sv = vmlaq_u32(sv, vmovl_u16(vget_low_u16(vmovl_u8(dv))), inv);
+    su = vshrq_n_u32(vaddq_u32(su, vdupq_n_u32(512)), 10);
+    sv = vshrq_n_u32(vaddq_u32(sv, vdupq_n_u32(512)), 10);
+    ou = vmovn_u16(vcombine_u16(vmovn_u32(su), vmovn_u32(su)));
+    ov = vmovn_u16(vcombine_u16(vmovn_u32(sv), vmovn_u32(sv)));
+
+    if (step == 1) {
+        guint8 out[8];
+
+        vst1_u8(out, vext_u8(ou, ov, 4));
+        memcpy(u, out, 4);
+        memcpy(v, out + 4, 4);
+    } else {
+        vst1_u8(lo, u == lo ? vzip_u8(ou, ov).val[0] : vzip_u8(ov, ou).val[0]);
+    }
+}
+#define AML_BLEND_SIMD  1
+#elif defined(__SSE2__)
+static void aml_blend_chroma4(guint8 *u, guint8 *v, gint step,
+        const guint8 *p0, const guint8 *p1)
+{
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1);
+    const __m128i as = _mm_cvtsi32_si128(0), us = _mm_cvtsi32_si128(16);
+    const __m128i vs = _mm_cvtsi32_si128(24);
+    __m128i l0 = _mm_loadu_si128((const __m128i *) p0);
+    __m128i h0 = _mm_loadu_si128((const __m128i *) (p0 + 16));
+    __m128i l1 = _mm_loadu_si128((const __m128i *) p1);
+    __m128i h1 = _mm_loadu_si128((const __m128i *) (p1 + 16));
+    __m128i a0 = aml_rgb_channel(l0, h0, as), a1 = aml_rgb_channel(l1, h1, as);
+    __m128i inv, su, sv, du, dv, t;
+    guint8 *lo = MIN(u, v);
+    gint32 out;
+
+    a0 = _mm_add_epi16(a0, _mm_srli_epi16(a0, 7));
+    a1 = _mm_add_epi16(a1, _mm_srli_epi16(a1, 7));
+    /* madd sums the horizontal pairs into 32 bit lanes */
+    inv = _mm_sub_epi32(_mm_set1_epi32(1024),
+            _mm_add_epi32(_mm_madd_epi16(a0, one), _mm_madd_epi16(a1, one)));
+    su = _mm_add_epi32(_mm_madd_epi16(a0, aml_rgb_channel(l0, h0, us)),
+            _mm_madd_epi16(a1, aml_rgb_channel(l1, h1, us)));
+    sv = _mm_add_epi32(_mm_madd_epi16(a0, aml_rgb_channel(l0, h0, vs)),
+            _mm_madd_epi16(a1, aml_rgb_channel(l1, h1, vs)));
+
+    if (step == 1) {
+        memcpy(&out, u, 4);
+        du = _mm_cvtsi32_si128(out);
+        memcpy(&out, v, 4);
+        dv = _mm_cvtsi32_si128(out);
+        du = _mm_unpacklo_epi16(_mm_unpacklo_epi8(du, zero), zero);
+        dv = _mm_unpacklo_epi16(_mm_unpacklo_epi8(dv, zero), zero);
+    } else {
+        /* 32 bit lanes of even | odd << 16 */
+        t = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) lo), zero);
+        du = _mm_and_si128(t, _mm_set1_epi32(0xff));
+        dv = _mm_srli_epi32(t, 16);
+        if (u != lo) {
+            t = du;
+            du = dv;
+            dv = t;
+        }
+    }
+    /* d lanes are d | 0 << 16, madd is d * (1024 - sum a) */
+    su = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(su, _mm_madd_epi16(du, inv)),
+            _mm_set1_epi32(512)), 10);
+    sv = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(sv, _mm_madd_epi16(dv, inv)),
+            _mm_set1_epi32(512)), 10);
+    t = _mm_packs_epi32(su, sv);
+
+    if (step == 1) {
+        t = _mm_packus_epi16(t, t);
+        out = _mm_cvtsi128_si32(t);
+        memcpy(u, &out, 4);
+        out = _mm_cvtsi128_si32(_mm_srli_si128(t, 4));
+        memcpy(v, &out, 4);
+    } else {
+        /* u0..u3 v0..v3 to u0 v0 u1 v1 .. in memory order */
+        t = u == lo ? _mm_unpacklo_epi16(t, _mm_srli_si128(t, 8))
+                : _mm_unpacklo_epi16(_mm_srli_si128(t, 8), t);
+        _mm_storel_epi64((__m128i *) lo, _mm_packus_epi16(t, t));
+    }
+}
+#define AML_BLEND_SIMD  1
+#else
+#define AML_BLEND_SIMD  0
+#endif
+
+/* n chroma samples, the first over overlay pixel px (may be -1) */
+static void aml_blend_chroma_row(guint8 *u, guint8 *v, gint step,
+        const guint8 *s0, const guint8 *s1, gint px, gint n, gint w)
+{
+    gint k = 0;
+
+    for (; k < n && px + 2 * k < 0; k++)
+        aml_blend_chroma(u + k * step, v + k * step, s0, s1, px + 2 * k, w);
+#if AML_BLEND_SIMD
+    if (s0 && s1) {
+        for (; k + 4 <= n && px + 2 * k + 8 <= w; k += 4)
+            aml_blend_chroma4(u + k * step, v + k * step, step,
+                    s0 + 4 * (px + 2 * k), s1 + 4 * (px + 2 * k));
+    }
+#endif
+    for (; k < n; k++)
+        aml_blend_chroma(u + k * step, v + k * step, s0, s1, px + 2 * k, w);
+}
+
+void amlBlendOverlay(const AmlBlendFrame *f, const AmlOverlay *o)
+{
+    gint x0 = MAX(o->x, 0), y0 = MAX(o->y, 0);
+    gint x1 = MIN(o->x + o->width, f->width), y1 = MIN(o->y + o->height, f->height);
+    gint step = f->layout == AML_BLEND_I420 ? 1 : 2;
+    gint cx0, cx1, cy, cy1, y;
+
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    for (y = y0; y < y1; y++)
+        aml_blend_luma(f->dst[0] + (gsize) y * f->dst_stride[0] + x0,
+                o->src + (gsize) (y - o->y) * o->src_stride + 4 * (x0 - o->x), x1 - x0);
+
+    cx0 = x0 / 2;
+    cx1 = MIN((x1 + 1) / 2, (f->width + 1) / 2);
+    cy1 = MIN((y1 + 1) / 2, f->height / 2);
+    for (cy = y0 / 2; cy < cy1; cy++) {
+        gint r0 = 2 * cy - o->y;
+        const guint8 *s0 = r0 >= 0 && r0 < y1 - o->y
+                ? o->src + (gsize) r0 * o->src_stride : NULL;
+        const guint8 *s1 = r0 + 1 >= 0 && r0 + 1 < y1 - o->y
+                ? o->src + (gsize) (r0 + 1) * o->src_stride : NULL;
+        guint8 *u, *v;
+
+        if (f->layout == AML_BLEND_I420) {
+            u = f->dst[1] + (gsize) cy * f->dst_stride[1] + cx0;
+            v = f->dst[2] + (gsize) cy * f->dst_stride[2] + cx0;
+        } else {
+            guint8 *uv = f->dst[1] + (gsize) cy * f->dst_stride[1] + 2 * cx0;
+
+            u = f->layout == AML_BLEND_NV12 ? uv : uv + 1;
+            v = f->layout == AML_BLEND_NV12 ? uv + 1 : uv;
+        }
+        /* overlay pixels past the frame edge do not count */
+        aml_blend_chroma_row(u, v, step, s0, s1, 2 * cx0 - o->x, cx1 - cx0, x1 - o->x);
+    }
+}
+
+/* rows [row, row + rows) of the frame, row even; an odd last row pairs
+ * with itself */
+static void aml_convert_rows(const AmlConvertFrame *f, gint row, gint rows)
+{
+    gint cw = (f->width + 1) / 2;
+    gint y;
+
+    for (y = row; y < row + rows; y += 2) {
+        gint y1 = MIN(y + 1, f->height - 1);
+        guint8 *d0 = f->dst[0] + (gsize) y * f->dst_stride[0];
+        guint8 *d1 = f->dst[0] + (gsize) y1 * f->dst_stride[0];
+        guint8 *u = f->dst[1] + (gsize) (y / 2) * f->dst_stride[1];
+        guint8 *v = f->dst[2] + (gsize) (y / 2) * f->dst_stride[2];
+        const guint8 *s0 = f->src[0] + (gsize) y * f->src_stride[0];
+        const guint8 *s1 = f->src[0] + (gsize) y1 * f->src_stride[0];
+
+        switch (f->convert) {
+        case AML_CONVERT_NV12:
+        case AML_CONVERT_NV21:
+            aml_copy_rows(d0, f->dst_stride[0], s0, f->src_stride[0], f->width, 1, 0, f->flags);
+            if (y1 != y)
+                aml_copy_rows(d1, f->dst_stride[0], s1, f->src_stride[0], f->width, 1, 0, f->flags);
+            if (f->convert == AML_CONVERT_NV12)
+                aml_split_uv(u, v, f->src[1] + (gsize) (y / 2) * f->src_stride[1], cw);
+            else
+                aml_split_uv(v, u, f->src[1] + (gsize) (y / 2) * f->src_stride[1], cw);
+            break;
+        case AML_CONVERT_YUY2:
+            aml_yuy2_rows(d0, d1, u, v, s0, s1, f->width);
+            break;
+        case AML_CONVERT_RGBX:
+        case AML_CONVERT_BGRX:
+            aml_rgb_rows(d0, d1, u, v, s0, s1, f->width,
+                    f->convert == AML_CONVERT_BGRX);
+            break;
+        }
+
+        if (f->convert != AML_CONVERT_NV12 && f->convert != AML_CONVERT_NV21) {
+            memset(d0 + f->width, 0, f->dst_stride[0] - f->width);
+            memset(d1 + f->width, 0, f->dst_stride[0] - f->width);
+        }
+        memset(u + cw, 0x80, f->dst_stride[1] - cw);
+        memset(v + cw, 0x80, f->dst_stride[2] - cw);
+    }
+}
+
+static void aml_copy_band(const AmlCopyBand *band)
+{
+    const AmlPlane *plane = &band->plane;
+
+    if (band->frame) {
+        aml_convert_rows(band->frame, band->row, band->rows);
+        return;
+    }
+    if (plane->scale > 0)
+        aml_scale_rows(plane->dst, plane->dst_stride, plane->src, plane->src_stride,
+                plane->width, plane->height, MAX(plane->step, 1), plane->scale, plane->pad);
+    else
+        aml_copy_rows(plane->dst, plane->dst_stride, plane->src, plane->src_stride,
+                plane->width, plane->height, plane->pad, plane->flags);
+}
+
+static void aml_copy_worker(gpointer data, gpointer user_data)
+{
+    AmlCopyBand *band = data;
+    AmlCopyPool *pool = band->pool;
+
+    aml_copy_band(band);
+    g_mutex_lock(&pool->lock);
+    if (--pool->pending == 0)
+        g_cond_signal(&pool->done);
+    g_mutex_unlock(&pool->lock);
+}
+
+AmlCopyPool *amlCopyPoolNew(gint threads)
+{
+    AmlCopyPool *pool;
+
+    if (threads <= 0)
+        threads = g_get_num_processors();
+    threads = MIN(threads, AML_COPY_MAX_THREADS);
+    /* the calling thread copies a band itself */
+    if (threads < 2)
+        return NULL;
+
+    pool = g_new0(AmlCopyPool, 1);
+    pool->threads = g_thread_pool_new(aml_copy_worker, pool, threads - 1, TRUE, NULL);
+    if (!pool->threads) {
+        g_free(pool);
+        return NULL;
+    }
+    pool->n_threads = threads;
+    g_mutex_init(&pool->lock);
+    g_cond_init(&pool->done);
+    return pool;
+}
+
+void amlCopyPoolFree(AmlCopyPool *pool)
+{
+    if (!pool)
+        return;
+    g_thread_pool_free(pool->threads, FALSE, TRUE);
+    g_mutex_clear(&pool->lock);
+    g_cond_clear(&pool->done);
+    g_free(pool);
+}
+
+/* the last band is kept for the calling thread */
+static void aml_copy_run(AmlCopyPool *pool, AmlCopyBand *bands, gint n_bands)
+{
+    gint b;
+
+    if (n_bands == 0)
+        return;
+    g_mutex_lock(&pool->lock);
+    pool->pending = n_bands - 1;
+    g_mutex_unlock(&pool->lock);
+    for (b = 0; b < n_bands - 1; b++)
+        g_thread_pool_push(pool->threads, &bands[b], NULL);
+    aml_copy_band(&bands[n_bands - 1]);
+
+    g_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+        g_cond_wait(&pool->done, &pool->lock);
+    g_mutex_unlock(&pool->lock);
+}
+
+/* every plane is cut into n_threads bands of whole rows */
+void amlCopyPlanes(AmlCopyPool *pool, const AmlPlane *planes, gint n_planes)
+{
+    AmlCopyBand bands[3 * AML_COPY_MAX_THREADS];
+    gsize total = 0;
+    gint i, b, n_bands = 0;
+
+    for (i = 0; i < n_planes; i++)
+        total += (gsize) planes[i].dst_stride * planes[i].height;
+
+    if (!pool || total < AML_COPY_SPLIT_MIN || n_planes > 3) {
+        AmlCopyBand band = { NULL, };
+
+        for (i = 0; i < n_planes; i++) {
+            band.plane = planes[i];
+            aml_copy_band(&band);
+        }
+        return;
+    }
+
+    for (i = 0; i < n_planes; i++) {
+        const AmlPlane *plane = &planes[i];
+        gint rows = (plane->height + pool->n_threads - 1) / pool->n_threads;
+
+        for (b = 0; b < pool->n_threads && b * rows < plane->height; b++) {
+            AmlCopyBand *band = &bands[n_bands++];
+
+            band->pool = pool;
+            band->frame = NULL;
+            band->plane = *plane;
+            band->plane.dst += (gsize) b * rows * plane->dst_stride;
+            band->plane.src += ((gsize) b * rows << plane->scale) * plane->src_stride;
+            band->plane.height = MIN(rows, plane->height - b * rows);
+        }
+    }
+    aml_copy_run(pool, bands, n_bands);
+}
+
+/* bands of whole row pairs, one per thread */
+void amlConvertFrame(AmlCopyPool *pool, const AmlConvertFrame *frame)
+{
+    AmlCopyBand bands[AML_COPY_MAX_THREADS];
+    gsize total = (gsize) frame->dst_stride[0] * frame->height * 3 / 2;
+    gint b, rows, n_bands = 0;
+
+    if (!pool || total < AML_COPY_SPLIT_MIN) {
+        aml_convert_rows(frame, 0, frame->height);
+        return;
+    }
+
+    rows = ((frame->height + 1) / 2 + pool->n_threads - 1) / pool->n_threads * 2;
+    for (b = 0; b < pool->n_threads && b * rows < frame->height; b++) {
+        AmlCopyBand *band = &bands[n_bands++];
+
+        band->pool = pool;
+        band->frame = frame;
+        band->row = b * rows;
+        band->rows = MIN(rows, frame->height - b * rows);
+    }
+    aml_copy_run(pool, bands, n_bands);
+}
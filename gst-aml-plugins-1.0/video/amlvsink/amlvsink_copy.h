@@ -0,0 +1,94 @@
+/*
+ * amlvsink_copy.h
+ *
+ * Plane copy into the yuvplayer ION buffers: stride aware on both
+ * sides, the row padding up to the destination stride is filled with
+ * a constant, and large frames are cut into row bands that a small
+ * worker pool copies in parallel. Formats the display cannot take are
+ * converted to I420 in the same pass, planar and semi planar ones can
+ * be box filtered 2:1 or 4:1 instead. For write-combined destinations
+ * the copy can use non-temporal stores. Overlay rectangles are blended
+ * into the ION buffer afterwards, touching their own area only.
+ */
+
+#ifndef __AML_VSINK_COPY_H__
+#define __AML_VSINK_COPY_H__
+#include <gst/gst.h>
+
+typedef struct {
+    guint8 *dst;
+    gint dst_stride;
+    const guint8 *src;
+    gint src_stride;
+    gint width;                 /* bytes copied per row */
+    gint height;                /* rows */
+    guint8 pad;                 /* value of dst bytes width..dst_stride */
+    guint8 flags;               /* AML_COPY_*, plain copies only */
+    guint8 scale;               /* 1, 2: each dst byte is the mean of a 2x2, 4x4
+                                 * square of src samples, width and height
+                                 * count dst bytes and rows */
+    guint8 step;                /* bytes between samples of one component,
+                                 * 2 for NV12/NV21 chroma; 0 is 1 */
+} AmlPlane;
+
+/* non-temporal stores where the CPU has them (SSE2) and dst is 16 byte
+ * aligned, plain stores otherwise; for destinations that are not read
+ * back, like uncached ION buffers */
+#define AML_COPY_STREAM         (1 << 0)
+
+/* conversions to I420 fused into the copy into the ION buffer */
+typedef enum {
+    AML_CONVERT_NV12,
+    AML_CONVERT_NV21,
+    AML_CONVERT_YUY2,
+    AML_CONVERT_RGBX,
+    AML_CONVERT_BGRX,
+} AmlConvert;
+
+typedef struct {
+    AmlConvert convert;
+    const guint8 *src[2];       /* NV12/NV21: Y, UV; packed formats: [0] */
+    gint src_stride[2];
+    guint8 *dst[3];             /* I420 Y, U, V */
+    gint dst_stride[3];
+    gint width, height;         /* luma; odd sizes take the last chroma sample from one pixel */
+    guint flags;                /* AML_COPY_*, applies to the NV12/NV21 luma copy */
+} AmlConvertFrame;
+
+/* layouts of the ION buffer amlBlendOverlay writes to */
+typedef enum {
+    AML_BLEND_I420,
+    AML_BLEND_NV12,
+    AML_BLEND_NV21,
+} AmlBlendLayout;
+
+typedef struct {
+    AmlBlendLayout layout;
+    guint8 *dst[3];             /* Y, U, V; NV12/NV21: Y, UV */
+    gint dst_stride[3];
+    gint width, height;         /* overlays are clipped to this, height / 2 chroma rows */
+} AmlBlendFrame;
+
+/* AYUV with straight alpha, as gst_video_overlay_rectangle_get_pixels_ayuv() */
+typedef struct {
+    const guint8 *src;
+    gint src_stride;
+    gint x, y, width, height;   /* in the frame, may reach past its edges */
+} AmlOverlay;
+
+typedef struct _AmlCopyPool AmlCopyPool;
+
+/* threads <= 0 picks one per core; never more than AML_COPY_MAX_THREADS */
+#define AML_COPY_MAX_THREADS    4
+/* frames below this many bytes are copied by the calling thread only */
+#define AML_COPY_SPLIT_MIN      (1280 * 720 * 3 / 2)
+
+AmlCopyPool *amlCopyPoolNew(gint threads);
+void amlCopyPoolFree(AmlCopyPool *pool);
+void amlCopyPlanes(AmlCopyPool *pool, const AmlPlane *planes, gint n_planes);
+void amlConvertFrame(AmlCopyPool *pool, const AmlConvertFrame *frame);
+void amlBlendOverlay(const AmlBlendFrame *frame, const AmlOverlay *overlay);
+void amlCopyRows(guint8 *dst, gint dst_stride, const guint8 *src, gint src_stride,
+        gint width, gint height, guint8 pad);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * amlvsink_pool.c
+ *
+ * ION backed buffer pool of amlvsink, see amlvsink_pool.h.
+ *
+ * A buffer handed out is an ION buffer the display has given back;
+ * render queues it to amlv4l as is. When the display holds on to all of
+ * them, or upstream cannot take GstVideoMeta, acquire falls back to
+ * system memory, which render copies like any foreign buffer. Only the
+ * formats the ION buffers are queued in natively (I420, NV12, NV21) are
+ * handed out, packed and RGB input is converted by render.
+ */
+
+#include "amlvsink_pool.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_aml_vsink_pool_debug);
+#define GST_CAT_DEFAULT gst_aml_vsink_pool_debug
+
+#define parent_class gst_aml_vsink_pool_parent_class
+G_DEFINE_TYPE (GstAmlVsinkPool, gst_aml_vsink_pool, GST_TYPE_BUFFER_POOL);
+
+static G_DEFINE_QUARK (GstAmlVsinkPoolIndex, aml_vsink_pool_index);
+
+gint
+gst_aml_vsink_pool_buffer_index (GstBuffer * buffer)
+{
+    gpointer index = gst_mini_object_get_qdata(GST_MINI_OBJECT(buffer),
+            aml_vsink_pool_index_quark());
+    return index ? GPOINTER_TO_INT(index) - 1 : -1;
+}
+
+static const gchar **
+gst_aml_vsink_pool_get_options (GstBufferPool * pool)
+{
+    static const gchar *options[] = { GST_BUFFER_POOL_OPTION_VIDEO_META, NULL };
+    return options;
+}
+
+static gboolean
+gst_aml_vsink_pool_set_config (GstBufferPool * pool, GstStructure * config)
+{
+    GstAmlVsinkPool *self = GST_AML_VSINK_POOL(pool);
+    GstCaps *caps;
+    guint size, min, max;
+
+    if (!gst_buffer_pool_config_get_params(config, &caps, &size, &min, &max)
+            || !caps || !gst_video_info_from_caps(&self->info, caps)) {
+        GST_WARNING_OBJECT(pool, "invalid config");
+        return FALSE;
+    }
+    /* the ION buffers are laid out for the sink caps */
+    self->zero_copy = gst_buffer_pool_config_has_option(config,
+                    GST_BUFFER_POOL_OPTION_VIDEO_META)
+            && (GST_VIDEO_INFO_FORMAT(&self->info) == GST_VIDEO_FORMAT_I420
+                    || GST_VIDEO_INFO_FORMAT(&self->info) == GST_VIDEO_FORMAT_NV12
+                    || GST_VIDEO_INFO_FORMAT(&self->info) == GST_VIDEO_FORMAT_NV21)
+            && GST_VIDEO_INFO_WIDTH(&self->info) == self->sink->width
+            && GST_VIDEO_INFO_HEIGHT(&self->info) == self->sink->height;
+    GST_INFO_OBJECT(pool, "%" GST_PTR_FORMAT " zero copy %d", caps, self->zero_copy);
+
+    return GST_BUFFER_POOL_CLASS(parent_class)->set_config(pool, config);
+}
+
+/* nothing to preallocate, the ION buffers belong to the sink */
+static gboolean
+gst_aml_vsink_pool_start (GstBufferPool * pool)
+{
+    return TRUE;
+}
+
+static void
+gst_aml_vsink_pool_drop_buffers (GstAmlVsinkPool * self)
+{
+    gint i;
+
+    for (i = 0; i < AML_OUT_BUFFER_MAX; i++) {
+        if (self->buffers[i])
+            gst_buffer_unref(self->buffers[i]);
+        self->buffers[i] = NULL;
+    }
+}
+
+static GstBuffer *
+gst_aml_vsink_pool_wrap (GstAmlVsinkPool * self, gint index)
+{
+    GstAmlVsink *sink = self->sink;
+    gsize size = sink->align_width * sink->height * 3 / 2;
+    gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+    gint stride[GST_VIDEO_MAX_PLANES] = { 0, };
+    GstVideoFormat format = GST_VIDEO_INFO_FORMAT(&self->info);
+    GstVideoMeta *meta;
+    GstBuffer *buffer;
+
+    buffer = gst_buffer_new();
+    gst_buffer_append_memory(buffer, gst_memory_new_wrapped(0,
+            sink->mOutBuffer[index].fd_ptr, size, 0, size, NULL, NULL));
+
+    stride[0] = sink->align_width;
+    offset[1] = sink->align_width * sink->height;
+    if (format == GST_VIDEO_FORMAT_I420) {
+        stride[1] = stride[2] = sink->align_width / 2;
+        offset[2] = offset[1] + sink->align_width * sink->height / 4;
+    } else {
+        stride[1] = sink->align_width;
+    }
+    meta = gst_buffer_add_video_meta_full(buffer, GST_VIDEO_FRAME_FLAG_NONE,
+            format, sink->width, sink->height, GST_VIDEO_INFO_N_PLANES(&self->info),
+            offset, stride);
+    /* survives the reset on release */
+    GST_META_FLAG_SET(meta, GST_META_FLAG_POOLED);
+    GST_META_FLAG_SET(meta, GST_META_FLAG_LOCKED);
+
+    gst_mini_object_set_qdata(GST_MINI_OBJECT(buffer),
+            aml_vsink_pool_index_quark(), GINT_TO_POINTER(index + 1), NULL);
+    return buffer;
+}
+
+static GstFlowReturn
+gst_aml_vsink_pool_acquire_buffer (GstBufferPool * pool, GstBuffer ** buffer,
+        GstBufferPoolAcquireParams * params)
+{
+    GstAmlVsinkPool *self = GST_AML_VSINK_POOL(pool);
+    GstAmlVsink *sink = self->sink;
+    gint index = AML_OUT_BUFFER_TIMEOUT;
+
+    if (self->zero_copy) {
+        g_mutex_lock(&sink->out_lock);
+        /* the driver may have refused semi planar buffers, downscale
+         * may have shrunk them since set_config */
+        if (gst_aml_vsink_yuvplayer_start(sink) && sink->v4l_format
+                == gst_aml_vsink_v4l_format(GST_VIDEO_INFO_FORMAT(&self->info))
+                && sink->width == GST_VIDEO_INFO_WIDTH(&self->info)
+                && sink->height == GST_VIDEO_INFO_HEIGHT(&self->info))
+            index = gst_aml_vsink_get_out_buffer(sink,
+                    g_get_monotonic_time() + AML_DEQUEUE_TIMEOUT);
+        if (index >= 0) {
+            sink->mOutBuffer[index].in_use = 1;
+            /* upstream writes it through the cache, render ends the access */
+            gst_aml_vsink_cpu_access(sink, index, TRUE);
+            /* the sink reopened the yuvplayer since, none of them is out */
+            if (self->generation != sink->generation) {
+                gst_aml_vsink_pool_drop_buffers(self);
+                self->generation = sink->generation;
+            }
+        }
+        g_mutex_unlock(&sink->out_lock);
+    }
+
+    if (index == AML_OUT_BUFFER_UNLOCKED)
+        return GST_FLOW_FLUSHING;
+
+    if (index < 0) {
+        GST_DEBUG_OBJECT(pool, "no ION buffer free, system memory");
+        *buffer = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&self->info), NULL);
+        return *buffer ? GST_FLOW_OK : GST_FLOW_ERROR;
+    }
+
+    if (!self->buffers[index])
+        self->buffers[index] = gst_aml_vsink_pool_wrap(self, index);
+    *buffer = self->buffers[index];
+    GST_LOG_OBJECT(pool, "ION buffer %d", index);
+    return GST_FLOW_OK;
+}
+
+/* the last ref is gone; an ION buffer stays with the display if render
+ * queued it, otherwise it is free again */
+static void
+gst_aml_vsink_pool_release_buffer (GstBufferPool * pool, GstBuffer * buffer)
+{
+    GstAmlVsinkPool *self = GST_AML_VSINK_POOL(pool);
+    GstAmlVsink *sink = self->sink;
+    gint index = gst_aml_vsink_pool_buffer_index(buffer);
+
+    if (index < 0 || self->buffers[index] != buffer) {
+        gst_buffer_unref(buffer);
+        return;
+    }
+    g_mutex_lock(&sink->out_lock);
+    sink->mOutBuffer[index].in_use = 0;
+    gst_aml_vsink_cpu_access(sink, index, FALSE);
+    g_mutex_unlock(&sink->out_lock);
+}
+
+static void
+gst_aml_vsink_pool_finalize (GObject * object)
+{
+    GstAmlVsinkPool *self = GST_AML_VSINK_POOL(object);
+
+    gst_aml_vsink_pool_drop_buffers(self);
+    gst_object_unref(self->sink);
+    G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void
+gst_aml_vsink_pool_class_init (GstAmlVsinkPoolClass * klass)
+{
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    GstBufferPoolClass *pool_class = (GstBufferPoolClass *) klass;
+
+    gobject_class->finalize = gst_aml_vsink_pool_finalize;
+    pool_class->get_options = gst_aml_vsink_pool_get_options;
+    pool_class->set_config = gst_aml_vsink_pool_set_config;
+    pool_class->start = gst_aml_vsink_pool_start;
+    pool_class->acquire_buffer = gst_aml_vsink_pool_acquire_buffer;
+    pool_class->release_buffer = gst_aml_vsink_pool_release_buffer;
+
+    GST_DEBUG_CATEGORY_INIT(gst_aml_vsink_pool_debug, "amlvsinkpool", 0,
+            "Amlogic Video Sink ION buffer pool");
+}
+
+static void
+gst_aml_vsink_pool_init (GstAmlVsinkPool * pool)
+{
+}
+
+GstBufferPool *
+gst_aml_vsink_pool_new (GstAmlVsink * amlvsink)
+{
+    GstAmlVsinkPool *pool = g_object_new(GST_TYPE_AML_VSINK_POOL, NULL);
+
+    gst_object_ref_sink(pool);
+    pool->sink = gst_object_ref(amlvsink);
+    return GST_BUFFER_POOL(pool);
+}
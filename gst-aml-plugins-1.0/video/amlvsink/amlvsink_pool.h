@@ -0,0 +1,45 @@
+/*
+ * amlvsink_pool.h
+ *
+ * Buffer pool proposed by amlvsink: the buffers are the yuvplayer ION
+ * buffers themselves, with a GstVideoMeta for the 64 byte aligned
+ * stride, so a software decoder writes straight into displayable memory
+ * and render only queues the fd.
+ */
+
+#ifndef __AML_VSINK_POOL_H__
+#define __AML_VSINK_POOL_H__
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include "gstamlvsink.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_AML_VSINK_POOL \
+  (gst_aml_vsink_pool_get_type())
+#define GST_AML_VSINK_POOL(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_AML_VSINK_POOL,GstAmlVsinkPool))
+
+typedef struct _GstAmlVsinkPool GstAmlVsinkPool;
+typedef struct _GstAmlVsinkPoolClass GstAmlVsinkPoolClass;
+
+struct _GstAmlVsinkPool {
+  GstBufferPool parent;
+  GstAmlVsink *sink;
+  GstVideoInfo info;
+  gboolean zero_copy;       /* upstream takes GstVideoMeta */
+  GstBuffer *buffers[AML_OUT_BUFFER_MAX];
+  guint generation;         /* of the sink's ION buffers wrapped in buffers */
+};
+
+struct _GstAmlVsinkPoolClass {
+  GstBufferPoolClass parent_class;
+};
+
+GType gst_aml_vsink_pool_get_type(void);
+GstBufferPool *gst_aml_vsink_pool_new(GstAmlVsink *amlvsink);
+gint gst_aml_vsink_pool_buffer_index(GstBuffer *buffer);
+
+G_END_DECLS
+
+#endif
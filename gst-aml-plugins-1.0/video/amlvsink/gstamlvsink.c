@@ -3,10 +3,17 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
+#include <errno.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <yuvplayer/amlv4l.h>
 #include "gstamlvsink.h"
+#include "amlvsink_pool.h"
+#include "amlclock.h"
+#include "gstamlsysctl.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_aml_vsink_debug);
 #define GST_CAT_DEFAULT gst_aml_vsink_debug
@@ -17,8 +24,45 @@ enum
   ARG_0,
   PROP_WINDOW_SET,
   PROP_KEEPOSD,
+  PROP_DROPPED_FRAMES,
+  PROP_LATE_FRAMES,
+  PROP_BUFFER_COUNT,
+  PROP_DUMP_FRAMES,
+  PROP_DUMP_LOCATION,
+  PROP_COPY_MODE,
+  PROP_CACHE_SYNC_TIME,
+  PROP_DOWNSCALE,
 };
 
+/* <linux/dma-buf.h>, missing from older kernel headers */
+#ifndef DMA_BUF_IOCTL_SYNC
+struct dma_buf_sync {
+    guint64 flags;
+};
+#define DMA_BUF_SYNC_READ       (1 << 0)
+#define DMA_BUF_SYNC_WRITE      (2 << 0)
+#define DMA_BUF_SYNC_RW         (DMA_BUF_SYNC_READ | DMA_BUF_SYNC_WRITE)
+#define DMA_BUF_SYNC_START      (0 << 2)
+#define DMA_BUF_SYNC_END        (1 << 2)
+#define DMA_BUF_IOCTL_SYNC      _IOW('b', 0, struct dma_buf_sync)
+#endif
+
+#define GST_TYPE_AML_VSINK_COPY_MODE (gst_aml_vsink_copy_mode_get_type())
+static GType
+gst_aml_vsink_copy_mode_get_type (void)
+{
+    static GType type = 0;
+    static const GEnumValue values[] = {
+        { GST_AML_VSINK_COPY_CACHED, "Cached ION buffers, cache synced around each copy", "cached" },
+        { GST_AML_VSINK_COPY_WRITE_COMBINE, "Write-combined ION buffers, non-temporal stores", "write-combine" },
+        { 0, NULL, NULL },
+    };
+
+    if (!type)
+        type = g_enum_register_static("GstAmlVsinkCopyMode", values);
+    return type;
+}
+
 static void gst_aml_vsink_finalize(GObject * object);
 static gboolean gst_aml_vsink_start(GstBaseSink * bsink);
 static gboolean gst_aml_vsink_stop(GstBaseSink * bsink);
@@ -32,13 +76,19 @@ static GstStateChangeReturn gst_aml_vsink_change_state(GstElement * element,
         GstStateChange transition);
 static gboolean gst_aml_vsink_query(GstElement * element, GstQuery *query);
 static gboolean gst_aml_vsink_event(GstBaseSink * bsink, GstEvent *event);
+static gboolean gst_aml_vsink_propose_allocation(GstBaseSink * bsink, GstQuery * query);
+static gboolean gst_aml_vsink_unlock(GstBaseSink * bsink);
+static gboolean gst_aml_vsink_unlock_stop(GstBaseSink * bsink);
+static GstClock *gst_aml_vsink_provide_clock(GstElement * element);
 
-#define VIDEO_CAPS "{ I420 }"
+#define VIDEO_CAPS "{ I420, NV12, NV21, YUY2, RGBx, BGRx }"
 
 static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE(VIDEO_CAPS))
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE(VIDEO_CAPS) "; "
+        GST_VIDEO_CAPS_MAKE_WITH_FEATURES(
+            GST_CAPS_FEATURE_META_GST_VIDEO_OVERLAY_COMPOSITION, VIDEO_CAPS))
     );
 
 #define parent_class gst_aml_vsink_parent_class
@@ -74,6 +124,8 @@ gst_aml_vsink_class_init (GstAmlVsinkClass * klass)
     gstelement_class->change_state =
             GST_DEBUG_FUNCPTR(gst_aml_vsink_change_state);
     gstelement_class->query = GST_DEBUG_FUNCPTR(gst_aml_vsink_query);
+    gstelement_class->provide_clock =
+            GST_DEBUG_FUNCPTR(gst_aml_vsink_provide_clock);
     gobject_class->set_property = gst_aml_vsink_set_property;
     gobject_class->get_property = gst_aml_vsink_get_property;
     gobject_class->finalize = GST_DEBUG_FUNCPTR(gst_aml_vsink_finalize);
@@ -88,6 +140,49 @@ gst_aml_vsink_class_init (GstAmlVsinkClass * klass)
                 "Whether to keep OSD during playback",
                 FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+    g_object_class_install_property (G_OBJECT_CLASS(klass), PROP_DROPPED_FRAMES,
+            g_param_spec_uint64 ("dropped-frames", "dropped-frames",
+                "Frames dropped because no display buffer came back in time",
+                0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS(klass), PROP_LATE_FRAMES,
+            g_param_spec_uint64 ("late-frames", "late-frames",
+                "Frames queued to the display after their running time",
+                0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS(klass), PROP_BUFFER_COUNT,
+            g_param_spec_uint ("buffer-count", "buffer-count",
+                "ION buffers shared with the display, 0: from frame rate and render jitter",
+                0, AML_OUT_BUFFER_MAX, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS(klass), PROP_DUMP_FRAMES,
+            g_param_spec_uint ("dump-frames", "dump-frames",
+                "Keep a copy of the last N frames queued to the display in memory, 0: off",
+                0, AML_DUMP_FRAMES_MAX, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS(klass), PROP_DUMP_LOCATION,
+            g_param_spec_string ("dump-location", "dump-location",
+                "Setting it writes the kept frames to this file in the background, "
+                "raw I420/NV12/NV21 at the ION buffer stride",
+                NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS(klass), PROP_COPY_MODE,
+            g_param_spec_enum ("copy-mode", "copy-mode",
+                "Mapping of the ION buffers and the stores that fill them",
+                GST_TYPE_AML_VSINK_COPY_MODE, GST_AML_VSINK_COPY_CACHED,
+                G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS(klass), PROP_CACHE_SYNC_TIME,
+            g_param_spec_uint64 ("cache-sync-time", "cache-sync-time",
+                "Time spent in dma-buf cache maintenance of the ION buffers (ns)",
+                0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_property (G_OBJECT_CLASS(klass), PROP_DOWNSCALE,
+            g_param_spec_boolean ("downscale", "downscale",
+                "Box filter I420/NV12/NV21 frames 2:1 or 4:1 while copying them into the "
+                "ION buffers, as far as they stay larger than the window or display",
+                FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
     gst_element_class_add_static_pad_template(gstelement_class, &sinktemplate);
 
     gstbasesink_class->set_caps = GST_DEBUG_FUNCPTR(gst_aml_vsink_setcaps);
@@ -95,6 +190,10 @@ gst_aml_vsink_class_init (GstAmlVsinkClass * klass)
     gstbasesink_class->stop = GST_DEBUG_FUNCPTR(gst_aml_vsink_stop);
     gstbasesink_class->event = GST_DEBUG_FUNCPTR(gst_aml_vsink_event);
     gstbasesink_class->render = GST_DEBUG_FUNCPTR(gst_aml_vsink_render);
+    gstbasesink_class->propose_allocation =
+            GST_DEBUG_FUNCPTR(gst_aml_vsink_propose_allocation);
+    gstbasesink_class->unlock = GST_DEBUG_FUNCPTR(gst_aml_vsink_unlock);
+    gstbasesink_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_aml_vsink_unlock_stop);
 
     gst_element_class_set_static_metadata(gstelement_class,
             "Amlogic Video Sink",
@@ -109,64 +208,125 @@ gst_aml_vsink_init (GstAmlVsink * amlvsink)
     GstBaseSink *bsink = GST_BASE_SINK(amlvsink);
     gst_base_sink_set_sync(bsink, FALSE);
     gst_base_sink_set_async_enabled(bsink, FALSE);
+    gst_base_sink_set_qos_enabled(bsink, TRUE);
+    amlvsink->clock = gst_aml_clock_new("GstAmlClock");
+    GST_OBJECT_FLAG_SET(amlvsink, GST_ELEMENT_FLAG_PROVIDE_CLOCK);
     amlvsink->amvideo_dev = NULL;
     amlvsink->framerate_d = 1;
     amlvsink->framerate_n = 0;
 
     amlvsink->height = -1;
     amlvsink->align_width = -1;
-    amlvsink->mIonFd = 0;
+    amlvsink->mIonFd = -1;
     amlvsink->mOutBuffer = NULL;
     amlvsink->use_yuvplayer = 0;
+    amlvsink->v4l_format = V4L2_PIX_FMT_YUV420;
+    amlvsink->downscale = FALSE;
+    amlvsink->scale = 0;
+    amlvsink->overlay = NULL;
+    amlvsink->overlay_seqnum = 0;
+    amlvsink->overlay_scale = 0;
+    amlvsink->copy_pool = NULL;
+    amlvsink->copy_mode = GST_AML_VSINK_COPY_CACHED;
+    amlvsink->write_combine = FALSE;
+    amlvsink->cache_sync = FALSE;
+    amlvsink->sync_time = 0;
+    g_mutex_init(&amlvsink->out_lock);
+    amlvsink->prepare_thread = NULL;
+    amlvsink->poll = gst_poll_new(TRUE);
+    gst_poll_fd_init(&amlvsink->poll_fd);
+    amlvsink->rendered = amlvsink->dropped = amlvsink->late = 0;
+    amlvsink->buffer_count = 0;
+    amlvsink->buffer_count_prop = 0;
+    amlvsink->extra_buffers = 0;
+    amlvsink->ion_short = FALSE;
+    amlvsink->timeouts = 0;
+    amlvsink->reconfigure = FALSE;
+    amlvsink->caps_changed = FALSE;
+    amlvsink->generation = 0;
+    amlvsink->last_render = 0;
+    amlvsink->render_jitter = 20 * GST_MSECOND;
     amlvsink->segment.rate = 1.0;
     amlvsink->coordinate[0] = DEFAULT_WINDOW_X;
     amlvsink->coordinate[1] = DEFAULT_WINDOW_Y;
     amlvsink->coordinate[2] = DEFAULT_WINDOW_WIDTH;
     amlvsink->coordinate[3] = DEFAULT_WINDOW_HEIGHT;
     set_video_axis(amlvsink->coordinate);
-#if DEBUG_DUMP
-    amlvsink->dump_fd = open("/tmp/gst_aml_vsink.dump", O_CREAT | O_TRUNC | O_WRONLY, 0777);
-#endif
+    amlvsink->dump_frames = 0;
+    amlvsink->dump_ring = NULL;
+    amlvsink->dump_frame_size = 0;
+    amlvsink->dump_location = NULL;
     ptsrate = 1.0;
     gst_voption_ratepts(&ptsrate);
 }
 
+/* the buffers AllocDmaBuffers set up, if any */
+int FreeDmaBuffers(GstAmlVsink *amlvsink)
+{
+    int i = 0;
+    int buffer_size;
+    if (amlvsink->mIonFd < 0)
+        return 0;
+    buffer_size = amlvsink->buffer_size;
+    while (amlvsink->mOutBuffer && i < amlvsink->buffer_count) {
+        if (amlvsink->mOutBuffer[i].fd_ptr) {
+            munmap(amlvsink->mOutBuffer[i].fd_ptr, buffer_size);
+            close(amlvsink->mOutBuffer[i].fd);
+            GST_INFO("FreeDmaBuffers_mOutBuffer[i].fd=%d,mIonFd=%d\n",
+                    amlvsink->mOutBuffer[i].fd, amlvsink->mIonFd);
+            ion_free(amlvsink->mIonFd, amlvsink->mOutBuffer[i].ion_hnd);
+            amlvsink->mOutBuffer[i].fd_ptr = NULL;
+        }
+        i++;
+    }
+    int ret = ion_close(amlvsink->mIonFd);
+    amlvsink->mIonFd = -1;
+    return ret;
+}
+
+/* buffer_count ION buffers; when the carveout runs out, the ones already
+ * allocated are kept if there are at least AML_OUT_BUFFER_MIN, with
+ * buffer_count cut down to them, and freed otherwise */
 int AllocDmaBuffers(GstAmlVsink *amlvsink)
 {
     struct ion_handle *ion_hnd;
     int shared_fd;
     int ret = 0;
     int buffer_size;
+    /* without ION_FLAG_CACHED the carveout is mapped write-combined */
+    unsigned int ion_flags = amlvsink->copy_mode == GST_AML_VSINK_COPY_CACHED
+            ? ION_FLAG_CACHED | ION_FLAG_CACHED_NEEDS_SYNC : 0;
     buffer_size = amlvsink->align_width * amlvsink->height * 3 / 2;
+    amlvsink->buffer_size = buffer_size;
+    amlvsink->write_combine = ion_flags == 0;
+    amlvsink->cache_sync = ion_flags != 0;
     amlvsink->mIonFd = ion_open();
     if (amlvsink->mIonFd < 0) {
         GST_ERROR("ion open failed!\n");
         return -1;
     }
     int i = 0;
-    while (i < OUT_BUFFER_COUNT) {
-        unsigned int ion_flags = ION_FLAG_CACHED | ION_FLAG_CACHED_NEEDS_SYNC;
+    while (i < amlvsink->buffer_count) {
         ret = ion_alloc(amlvsink->mIonFd, buffer_size, 0,
                 ION_HEAP_CARVEOUT_MASK, ion_flags, &ion_hnd);
         if (ret) {
             GST_ERROR("ion alloc error");
-            ion_close(amlvsink->mIonFd);
-            return -1;
+            break;
         }
         ret = ion_share(amlvsink->mIonFd, ion_hnd, &shared_fd);
         if (ret) {
             GST_ERROR("ion share error!\n");
             ion_free(amlvsink->mIonFd, ion_hnd);
-            ion_close(amlvsink->mIonFd);
-            return -1;
+            break;
         }
         void *cpu_ptr = mmap(NULL, buffer_size, PROT_READ | PROT_WRITE,
                 MAP_SHARED, shared_fd, 0);
         if (MAP_FAILED == cpu_ptr) {
             GST_ERROR("ion mmap error!\n");
+            close(shared_fd);
             ion_free(amlvsink->mIonFd, ion_hnd);
-            ion_close(amlvsink->mIonFd);
-            return -1;
+            ret = -1;
+            break;
         }
 
         GST_INFO("i:%d shared_fd:%d cpu_ptr:%x\n", i, shared_fd, cpu_ptr);
@@ -175,51 +335,159 @@ int AllocDmaBuffers(GstAmlVsink *amlvsink)
         amlvsink->mOutBuffer[i].fd = shared_fd;
         amlvsink->mOutBuffer[i].pBuffer = NULL;
         amlvsink->mOutBuffer[i].own_by_v4l = -1;
+        amlvsink->mOutBuffer[i].in_use = 0;
         amlvsink->mOutBuffer[i].fd_ptr = cpu_ptr;
         amlvsink->mOutBuffer[i].ion_hnd = ion_hnd;
         i++;
     }
-    return ret;
+    if (i == amlvsink->buffer_count)
+        return 0;
+
+    /* auto mode stops asking for more */
+    amlvsink->ion_short = TRUE;
+    if (i >= AML_OUT_BUFFER_MIN) {
+        GST_WARNING("only %d of %d ION buffers", i, amlvsink->buffer_count);
+        amlvsink->buffer_count = i;
+        return 0;
+    }
+    amlvsink->buffer_count = i;
+    FreeDmaBuffers(amlvsink);
+    amlvsink->buffer_count = 0;
+    return -1;
 }
 
-int FreeDmaBuffers(GstAmlVsink *amlvsink)
+
+/* ION buffer size for info and scale, even when scaled so the chroma
+ * planes are exactly 1 << scale smaller too */
+static void gst_aml_vsink_frame_size(GstAmlVsink *amlvsink)
 {
-    int i = 0;
-    int buffer_size;
-    buffer_size = amlvsink->align_width * amlvsink->height * 3 / 2;
-    while (i < OUT_BUFFER_COUNT) {
-        munmap(amlvsink->mOutBuffer[i].fd_ptr, buffer_size);
-        close(amlvsink->mOutBuffer[i].fd);
-        GST_INFO("FreeDmaBuffers_mOutBuffer[i].fd=%d,mIonFd=%d\n",
-                amlvsink->mOutBuffer[i].fd, amlvsink->mIonFd);
-        ion_free(amlvsink->mIonFd, amlvsink->mOutBuffer[i].ion_hnd);
-        i++;
+    amlvsink->width = GST_VIDEO_INFO_WIDTH(&amlvsink->info);
+    amlvsink->height = GST_VIDEO_INFO_HEIGHT(&amlvsink->info);
+    if (amlvsink->scale > 0) {
+        amlvsink->width = (amlvsink->width >> amlvsink->scale) & ~1;
+        amlvsink->height = (amlvsink->height >> amlvsink->scale) & ~1;
     }
-    int ret = ion_close(amlvsink->mIonFd);
-    return ret;
+    amlvsink->align_width = (amlvsink->width + 63) & (~63);
+    amlvsink->yuv_width = (amlvsink->width + 15) & (~15);
 }
 
+/* 2:1 steps for downscale: as many as keep the frame at least as large
+ * as the window, or the display without one, the display scales the
+ * rest. Only frames render copies plane by plane are scaled, those it
+ * converts to I420 are not. */
+static gint gst_aml_vsink_downscale(GstAmlVsink *amlvsink, const GstVideoInfo *info,
+        guint32 v4l_format)
+{
+    GstVideoFormat format = GST_VIDEO_INFO_FORMAT(info);
+    gint width = amlvsink->coordinate[2] - amlvsink->coordinate[0];
+    gint height = amlvsink->coordinate[3] - amlvsink->coordinate[1];
+    gchar resolution[32] = { 0, };
+    gint scale = 0;
+
+    if (!amlvsink->downscale || (format != GST_VIDEO_FORMAT_I420
+            && v4l_format != gst_aml_vsink_v4l_format(format)))
+        return 0;
+    if (width <= 0 || height <= 0) {
+        if (get_sysfs_str("/sys/class/video/device_resolution", resolution,
+                sizeof(resolution)) < 0
+                || sscanf(resolution, "%dx%d", &width, &height) != 2
+                || width <= 0 || height <= 0)
+            return 0;
+    }
+    while (scale < AML_DOWNSCALE_MAX
+            && GST_VIDEO_INFO_WIDTH(info) >> (scale + 1) >= width
+            && GST_VIDEO_INFO_HEIGHT(info) >> (scale + 1) >= height)
+        scale++;
+    return scale;
+}
 
-static gboolean gst_aml_vsink_yuvplayer_init(GstAmlVsink *amlvsink)
+/* downscale or the window changed; called with out_lock, TRUE when the
+ * ION buffers change size */
+static gboolean gst_aml_vsink_rescale(GstAmlVsink *amlvsink)
+{
+    gint scale;
+
+    if (GST_VIDEO_INFO_WIDTH(&amlvsink->info) <= 0)
+        return FALSE;
+    scale = gst_aml_vsink_downscale(amlvsink, &amlvsink->info, amlvsink->v4l_format);
+    if (scale == amlvsink->scale)
+        return FALSE;
+    GST_INFO_OBJECT(amlvsink, "downscale %d:1", 1 << scale);
+    amlvsink->scale = scale;
+    gst_aml_vsink_frame_size(amlvsink);
+    if (amlvsink->use_yuvplayer) {
+        amlvsink->reconfigure = TRUE;
+        amlvsink->caps_changed = TRUE;
+    }
+    return TRUE;
+}
+
+/* buffer-count, or in auto mode: two for the display (shown and next),
+ * one being filled, one more per frame of measured render jitter, and
+ * those added after dequeue timeouts */
+static int gst_aml_vsink_buffer_count(GstAmlVsink *amlvsink)
+{
+    GstClockTime frame = 40 * GST_MSECOND;
+    int count;
+
+    if (amlvsink->buffer_count_prop > 0)
+        return MAX(amlvsink->buffer_count_prop, AML_OUT_BUFFER_MIN);
+    if (GST_VIDEO_INFO_FPS_N(&amlvsink->info) > 0)
+        frame = gst_util_uint64_scale(GST_SECOND, GST_VIDEO_INFO_FPS_D(&amlvsink->info),
+                GST_VIDEO_INFO_FPS_N(&amlvsink->info));
+    count = 3 + (amlvsink->render_jitter + frame - 1) / frame + amlvsink->extra_buffers;
+    return CLAMP(count, AML_OUT_BUFFER_MIN, AML_OUT_BUFFER_MAX);
+}
+
+/* ION buffers and amlv4l for the current caps, the display side is set
+ * up by yuvplayer_init */
+static int gst_aml_vsink_yuvplayer_open(GstAmlVsink *amlvsink)
 {
     int ret, i;
     vframebuf_t vf;
-    amsysfs_set_sysfs_str("/sys/class/vfm/map", "rm default");
-    amsysfs_set_sysfs_str("/sys/class/vfm/map",
-            "add default yuvplayer amvideo");
-    set_fb0_blank(1);
-    set_fb1_blank(1);
 
+    amlvsink->buffer_count = gst_aml_vsink_buffer_count(amlvsink);
+    GST_INFO_OBJECT(amlvsink, "%d buffers of %dx%d", amlvsink->buffer_count,
+            amlvsink->align_width, amlvsink->height);
+    amlvsink->generation++;
     amlvsink->mOutBuffer = (out_buffer_t *) malloc(
-            sizeof(out_buffer_t) * OUT_BUFFER_COUNT);
-    memset(amlvsink->mOutBuffer, 0, sizeof(out_buffer_t) * OUT_BUFFER_COUNT);
-    AllocDmaBuffers(amlvsink);
+            sizeof(out_buffer_t) * amlvsink->buffer_count);
+    memset(amlvsink->mOutBuffer, 0, sizeof(out_buffer_t) * amlvsink->buffer_count);
+    if (AllocDmaBuffers(amlvsink) < 0) {
+        free(amlvsink->mOutBuffer);
+        amlvsink->mOutBuffer = NULL;
+        amlvsink->buffer_count = 0;
+        return -__LINE__;
+    }
     amlvsink->amvideo_dev = new_amvideo(FLAGS_V4L_MODE);
     amlvsink->amvideo_dev->display_mode = 0;
 
     ret = amvideo_init(amlvsink->amvideo_dev, 0, amlvsink->align_width,
-            amlvsink->height, V4L2_PIX_FMT_YUV420,
-            OUT_BUFFER_COUNT);
+            amlvsink->height, amlvsink->v4l_format,
+            amlvsink->buffer_count);
+    if (ret < 0 && amlvsink->v4l_format != V4L2_PIX_FMT_YUV420) {
+        /* semi planar refused by the driver, render converts to I420 */
+        GST_WARNING("amvideo_init %" GST_FOURCC_FORMAT " failed =%d, using I420",
+                GST_FOURCC_ARGS(amlvsink->v4l_format), ret);
+        amlvsink->v4l_format = V4L2_PIX_FMT_YUV420;
+        if (amlvsink->scale > 0) {
+            /* the conversion does not scale, full size buffers */
+            amlvsink->scale = 0;
+            gst_aml_vsink_frame_size(amlvsink);
+            FreeDmaBuffers(amlvsink);
+            if (AllocDmaBuffers(amlvsink) < 0) {
+                amvideo_release(amlvsink->amvideo_dev);
+                amlvsink->amvideo_dev = NULL;
+                free(amlvsink->mOutBuffer);
+                amlvsink->mOutBuffer = NULL;
+                amlvsink->buffer_count = 0;
+                return -__LINE__;
+            }
+        }
+        ret = amvideo_init(amlvsink->amvideo_dev, 0, amlvsink->align_width,
+                amlvsink->height, amlvsink->v4l_format,
+                amlvsink->buffer_count);
+    }
     if (ret < 0) {
         GST_ERROR("amvideo_init failed =%d\n", ret);
         amvideo_release(amlvsink->amvideo_dev);
@@ -227,21 +495,25 @@ static gboolean gst_aml_vsink_yuvplayer_init(GstAmlVsink *amlvsink)
         return -__LINE__;
     }
     i = 0;
-    while (i < OUT_BUFFER_COUNT) {
+    while (i < amlvsink->buffer_count) {
         vf.index = amlvsink->mOutBuffer[i].index;
         vf.fd = amlvsink->mOutBuffer[i].fd;
         vf.length = amlvsink->align_width * amlvsink->height * 3 / 2;
 
+        gst_aml_vsink_cpu_access(amlvsink, i, TRUE);
         memset(amlvsink->mOutBuffer[i].fd_ptr, 0x0,
                 amlvsink->align_width * amlvsink->height);
         memset(
                 amlvsink->mOutBuffer[i].fd_ptr
                         + amlvsink->align_width * amlvsink->height, 0x80,
                 amlvsink->align_width * amlvsink->height / 2);
+        gst_aml_vsink_cpu_access(amlvsink, i, FALSE);
 
         int ret = amlv4l_queuebuf(amlvsink->amvideo_dev, &vf);
         if (ret < 0) {
             GST_ERROR("amlv4l_queuebuf failed =%d\n", ret);
+        } else {
+            amlvsink->mOutBuffer[i].own_by_v4l = AML_OUT_BUFFER_V4L;
         }
 
         if (i == 1) {
@@ -255,23 +527,177 @@ static gboolean gst_aml_vsink_yuvplayer_init(GstAmlVsink *amlvsink)
         }
         i++;
     }
+    /* displayed buffers come back as POLLOUT on the output queue */
+    if (amlvsink->amvideo_dev && amlvsink->amvideo_dev->devpriv) {
+        amlvsink->poll_fd.fd = ((amlv4l_priv *) amlvsink->amvideo_dev->devpriv)->v4l_fd;
+        gst_poll_add_fd(amlvsink->poll, &amlvsink->poll_fd);
+        gst_poll_fd_ctl_write(amlvsink->poll, &amlvsink->poll_fd, TRUE);
+    }
+    return 0;
+}
+
+static gboolean gst_aml_vsink_yuvplayer_init(GstAmlVsink *amlvsink)
+{
+    amsysfs_set_sysfs_str("/sys/class/vfm/map", "rm default");
+    amsysfs_set_sysfs_str("/sys/class/vfm/map",
+            "add default yuvplayer amvideo");
+    set_fb0_blank(1);
+    set_fb1_blank(1);
+
+    if (gst_aml_vsink_yuvplayer_open(amlvsink) < 0)
+        return -__LINE__;
+    amlvsink->copy_pool = amlCopyPoolNew(0);
     amlvsink->use_yuvplayer = 1;
     return TRUE;
 }
 
-static gboolean gst_aml_vsink_yuvplayer_deinit(GstAmlVsink *amlvsink)
+/* NV12 and NV21 keep their layout in the ION buffers, the display scans
+ * them out as they are; everything else is converted to I420 */
+guint32 gst_aml_vsink_v4l_format(GstVideoFormat format)
+{
+    switch (format) {
+    case GST_VIDEO_FORMAT_NV12:
+        return V4L2_PIX_FMT_NV12;
+    case GST_VIDEO_FORMAT_NV21:
+        return V4L2_PIX_FMT_NV21;
+    default:
+        return V4L2_PIX_FMT_YUV420;
+    }
+}
+
+/* called with out_lock, from render or from the pool on the first
+ * acquire, whichever comes first */
+gboolean gst_aml_vsink_yuvplayer_start(GstAmlVsink *amlvsink)
+{
+    if (amlvsink->use_yuvplayer == 0) {
+        gst_aml_vsink_yuvplayer_init(amlvsink);
+        g_print("yuvplayer\n");
+    }
+    return amlvsink->use_yuvplayer;
+}
+
+/* index of an ION buffer that may be filled: one already back from the
+ * display and not in use, else the next one amlv4l hands back, waiting
+ * on the v4l fd until deadline (g_get_monotonic_time() based).
+ * AML_OUT_BUFFER_TIMEOUT past the deadline, AML_OUT_BUFFER_UNLOCKED when
+ * unlock interrupted the wait. Called with out_lock, which is dropped
+ * while waiting. */
+gint gst_aml_vsink_get_out_buffer(GstAmlVsink *amlvsink, gint64 deadline)
+{
+    vframebuf_t vf;
+    gint64 now;
+    int i, ret;
+
+    while (1) {
+        for (i = 0; i < amlvsink->buffer_count; i++) {
+            if (amlvsink->mOutBuffer[i].own_by_v4l == AML_OUT_BUFFER_FREE
+                    && !amlvsink->mOutBuffer[i].in_use)
+                return i;
+        }
+        if (amlv4l_dequeuebuf(amlvsink->amvideo_dev, &vf) < 0) {
+            now = g_get_monotonic_time();
+            if (now >= deadline)
+                return AML_OUT_BUFFER_TIMEOUT;
+            /* a pool release frees buffers without touching the fd, and
+             * without an fd this is all there is: look again every 10ms */
+            g_mutex_unlock(&amlvsink->out_lock);
+            ret = gst_poll_wait(amlvsink->poll,
+                    MIN(deadline - now, 10000) * GST_USECOND);
+            g_mutex_lock(&amlvsink->out_lock);
+            if (ret < 0 && errno == EBUSY)
+                return AML_OUT_BUFFER_UNLOCKED;
+            continue;
+        }
+        for (i = 0; i < amlvsink->buffer_count; i++) {
+            if (vf.fd == amlvsink->mOutBuffer[i].fd) {
+                amlvsink->mOutBuffer[i].own_by_v4l = AML_OUT_BUFFER_FREE;
+                break;
+            }
+        }
+    }
+}
+
+/* called with out_lock */
+/* brackets CPU writes to a cached ION buffer with DMA_BUF_IOCTL_SYNC,
+ * so the lines are cleaned before the display reads it; called with
+ * out_lock held, END without a pending START does nothing */
+void gst_aml_vsink_cpu_access(GstAmlVsink *amlvsink, gint index, gboolean begin)
+{
+    out_buffer_t *buf = &amlvsink->mOutBuffer[index];
+    struct dma_buf_sync sync;
+    gint64 start;
+
+    if (!amlvsink->cache_sync || buf->cpu_access == begin)
+        return;
+    sync.flags = (begin ? DMA_BUF_SYNC_START : DMA_BUF_SYNC_END) | DMA_BUF_SYNC_RW;
+    start = g_get_monotonic_time();
+    if (ioctl(buf->fd, DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+        if (errno == ENOTTY || errno == EINVAL) {
+            /* ION fds of older kernels are not dma-bufs */
+            GST_INFO_OBJECT(amlvsink, "no dma-buf sync on ION buffers");
+            amlvsink->cache_sync = FALSE;
+        } else {
+            GST_WARNING_OBJECT(amlvsink, "DMA_BUF_IOCTL_SYNC failed: %s", g_strerror(errno));
+        }
+        return;
+    }
+    buf->cpu_access = begin;
+    amlvsink->sync_time += (g_get_monotonic_time() - start) * GST_USECOND;
+}
+
+void gst_aml_vsink_queue_out_buffer(GstAmlVsink *amlvsink, gint index, GstBuffer *buffer)
+{
+    vframebuf_t vf;
+    int ret;
+
+    gst_aml_vsink_cpu_access(amlvsink, index, FALSE);
+    memset(&vf, 0, sizeof(vf));
+    vf.index = amlvsink->mOutBuffer[index].index;
+    vf.fd = amlvsink->mOutBuffer[index].fd;
+    vf.length = amlvsink->align_width * amlvsink->height * 3 / 2;
+    if (GST_BUFFER_PTS_IS_VALID(buffer))
+        vf.pts = GST_BUFFER_PTS(buffer) * 9LL / 100000LL + 1L;
+    else if (GST_BUFFER_DTS_IS_VALID(buffer))
+        vf.pts = GST_BUFFER_DTS(buffer) * 9LL / 100000LL + 1L;
+    vf.width = amlvsink->align_width;
+    vf.height = amlvsink->height;
+    GST_INFO_OBJECT(amlvsink, " yuv pts = %x", (unsigned long) vf.pts);
+
+    ret = amlv4l_queuebuf(amlvsink->amvideo_dev, &vf);
+    if (ret < 0) {
+        GST_ERROR("amlv4l_queuebuf failed =%d\n", ret);
+    } else {
+        amlvsink->mOutBuffer[index].own_by_v4l = AML_OUT_BUFFER_V4L;
+    }
+}
+
+/* undoes yuvplayer_open */
+static void gst_aml_vsink_yuvplayer_close(GstAmlVsink *amlvsink)
 {
     vframebuf_t vf;
     int i;
-    for (i = 0; i < OUT_BUFFER_COUNT; i++) {
+    for (i = 0; amlvsink->amvideo_dev && i < amlvsink->buffer_count; i++) {
         amlv4l_dequeuebuf(amlvsink->amvideo_dev, &vf);
     }
+    if (amlvsink->poll_fd.fd >= 0) {
+        gst_poll_remove_fd(amlvsink->poll, &amlvsink->poll_fd);
+        gst_poll_fd_init(&amlvsink->poll_fd);
+    }
 
     if (amlvsink->amvideo_dev) {
         amvideo_stop(amlvsink->amvideo_dev);
         amvideo_release(amlvsink->amvideo_dev);
         amlvsink->amvideo_dev = NULL;
     }
+    FreeDmaBuffers(amlvsink);
+    if (amlvsink->mOutBuffer)
+        free(amlvsink->mOutBuffer);
+    amlvsink->mOutBuffer = NULL;
+}
+
+static gboolean gst_aml_vsink_yuvplayer_deinit(GstAmlVsink *amlvsink)
+{
+    gst_aml_vsink_yuvplayer_close(amlvsink);
     amsysfs_set_sysfs_str("/sys/class/video/disable_video", "2");
     set_fb0_blank(0);
     set_fb1_blank(0);
@@ -279,13 +705,74 @@ static gboolean gst_aml_vsink_yuvplayer_deinit(GstAmlVsink *amlvsink)
     amsysfs_set_sysfs_str("/sys/class/vfm/map",
             "add default decoder ppmgr deinterlace amvideo");
 
-    FreeDmaBuffers(amlvsink);
+    amlCopyPoolFree(amlvsink->copy_pool);
+    amlvsink->copy_pool = NULL;
     amlvsink->use_yuvplayer = 0;
-    if (amlvsink->mOutBuffer)
-        free(amlvsink->mOutBuffer);
     return TRUE;
 }
 
+/* new ION buffers for changed caps or count, the display stays on the
+ * yuvplayer; not while the pool has a buffer out. Called with out_lock. */
+static gboolean gst_aml_vsink_yuvplayer_reopen(GstAmlVsink *amlvsink)
+{
+    int i;
+
+    for (i = 0; i < amlvsink->buffer_count; i++) {
+        if (amlvsink->mOutBuffer[i].in_use)
+            return FALSE;
+    }
+    gst_aml_vsink_yuvplayer_close(amlvsink);
+    amlvsink->reconfigure = FALSE;
+    amlvsink->caps_changed = FALSE;
+    if (gst_aml_vsink_yuvplayer_open(amlvsink) < 0) {
+        gst_aml_vsink_yuvplayer_deinit(amlvsink);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* yuvplayer set up, or reconfigured for new caps, while upstream decodes
+ * the first frame, so render only copies and queues. Holds out_lock
+ * like render does; a render that gets there first waits for it or
+ * finds the work done. */
+static gpointer gst_aml_vsink_prepare_thread(gpointer data)
+{
+    GstAmlVsink *amlvsink = data;
+    gint64 start = g_get_monotonic_time();
+
+    g_mutex_lock(&amlvsink->out_lock);
+    if (!amlvsink->use_yuvplayer)
+        gst_aml_vsink_yuvplayer_start(amlvsink);
+    else if (amlvsink->reconfigure)
+        gst_aml_vsink_yuvplayer_reopen(amlvsink);
+    g_mutex_unlock(&amlvsink->out_lock);
+    GST_INFO_OBJECT(amlvsink, "yuvplayer prepared in %" G_GINT64_FORMAT " us",
+            g_get_monotonic_time() - start);
+    return NULL;
+}
+
+static void gst_aml_vsink_prepare_join(GstAmlVsink *amlvsink)
+{
+    if (amlvsink->prepare_thread) {
+        g_thread_join(amlvsink->prepare_thread);
+        amlvsink->prepare_thread = NULL;
+    }
+}
+
+static void gst_aml_vsink_prepare(GstAmlVsink *amlvsink)
+{
+    GError *error = NULL;
+
+    gst_aml_vsink_prepare_join(amlvsink);
+    amlvsink->prepare_thread = g_thread_try_new("amlvsinkprep",
+            gst_aml_vsink_prepare_thread, amlvsink, &error);
+    if (!amlvsink->prepare_thread) {
+        GST_WARNING_OBJECT(amlvsink, "no prepare thread, the first render sets up: %s",
+                error->message);
+        g_error_free(error);
+    }
+}
+
 static void
 gst_aml_vsink_set_osd_blank(int blank)
 {
@@ -317,6 +804,20 @@ gst_aml_vsink_set_osd_blank(int blank)
     return;
 }
 
+/* a pool handing out ION buffers stops doing so once they no longer
+ * match the caps, ask upstream to negotiate a new one */
+static void
+gst_aml_vsink_set_scale (GstAmlVsink * amlvsink)
+{
+    gboolean changed;
+
+    g_mutex_lock(&amlvsink->out_lock);
+    changed = gst_aml_vsink_rescale(amlvsink);
+    g_mutex_unlock(&amlvsink->out_lock);
+    if (changed)
+        gst_pad_push_event(GST_BASE_SINK_PAD(amlvsink), gst_event_new_reconfigure());
+}
+
 static void
 gst_aml_vsink_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
@@ -345,10 +846,60 @@ gst_aml_vsink_set_property (GObject * object, guint prop_id,
             GST_DEBUG_OBJECT(amlvsink, " set window rect (%d %d %d %d)\n",
                     amlvsink->coordinate[0], amlvsink->coordinate[1],
                     amlvsink->coordinate[2], amlvsink->coordinate[3]);
+            gst_aml_vsink_set_scale(amlvsink);
         }
         g_strfreev(parts);
         break;
     }
+    case PROP_DOWNSCALE:
+        g_mutex_lock(&amlvsink->out_lock);
+        amlvsink->downscale = g_value_get_boolean(value);
+        g_mutex_unlock(&amlvsink->out_lock);
+        gst_aml_vsink_set_scale(amlvsink);
+        break;
+    case PROP_BUFFER_COUNT:
+        g_mutex_lock(&amlvsink->out_lock);
+        amlvsink->buffer_count_prop = g_value_get_uint(value);
+        amlvsink->extra_buffers = 0;
+        amlvsink->ion_short = FALSE;
+        if (amlvsink->use_yuvplayer
+                && gst_aml_vsink_buffer_count(amlvsink) != amlvsink->buffer_count)
+            amlvsink->reconfigure = TRUE;
+        g_mutex_unlock(&amlvsink->out_lock);
+        break;
+    case PROP_COPY_MODE:
+        g_mutex_lock(&amlvsink->out_lock);
+        amlvsink->copy_mode = g_value_get_enum(value);
+        /* the ION buffers are allocated for one mode */
+        if (amlvsink->use_yuvplayer && amlvsink->write_combine
+                != (amlvsink->copy_mode == GST_AML_VSINK_COPY_WRITE_COMBINE))
+            amlvsink->reconfigure = TRUE;
+        g_mutex_unlock(&amlvsink->out_lock);
+        break;
+    case PROP_DUMP_FRAMES:
+        GST_OBJECT_LOCK(amlvsink);
+        amlvsink->dump_frames = g_value_get_uint(value);
+        /* sized again by the next frame */
+        amlDumpRingFree(amlvsink->dump_ring);
+        amlvsink->dump_ring = NULL;
+        GST_OBJECT_UNLOCK(amlvsink);
+        break;
+    case PROP_DUMP_LOCATION:
+        GST_OBJECT_LOCK(amlvsink);
+        g_free(amlvsink->dump_location);
+        amlvsink->dump_location = g_value_dup_string(value);
+        if (amlvsink->dump_location) {
+            if (!amlvsink->dump_ring)
+                GST_WARNING_OBJECT(amlvsink, "no frames kept, set dump-frames first");
+            else if (amlDumpRingDump(amlvsink->dump_ring, amlvsink->dump_location,
+                    AML_DUMP_RAW, NULL, 0))
+                GST_INFO_OBJECT(amlvsink, "dumping %s frames %dx%d stride %d to %s",
+                        gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(&amlvsink->info)),
+                        amlvsink->width, amlvsink->height, amlvsink->align_width,
+                        amlvsink->dump_location);
+        }
+        GST_OBJECT_UNLOCK(amlvsink);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -369,6 +920,48 @@ gst_aml_vsink_get_property (GObject * object, guint prop_id, GValue * value,
         g_value_set_boolean (value, keeposd);
         break;
 
+    case PROP_DROPPED_FRAMES:
+        g_mutex_lock(&amlvsink->out_lock);
+        g_value_set_uint64(value, amlvsink->dropped);
+        g_mutex_unlock(&amlvsink->out_lock);
+        break;
+
+    case PROP_LATE_FRAMES:
+        g_mutex_lock(&amlvsink->out_lock);
+        g_value_set_uint64(value, amlvsink->late);
+        g_mutex_unlock(&amlvsink->out_lock);
+        break;
+
+    case PROP_BUFFER_COUNT:
+        g_value_set_uint(value, amlvsink->buffer_count_prop);
+        break;
+
+    case PROP_COPY_MODE:
+        g_value_set_enum(value, amlvsink->copy_mode);
+        break;
+
+    case PROP_CACHE_SYNC_TIME:
+        g_mutex_lock(&amlvsink->out_lock);
+        g_value_set_uint64(value, amlvsink->sync_time);
+        g_mutex_unlock(&amlvsink->out_lock);
+        break;
+
+    case PROP_DOWNSCALE:
+        g_value_set_boolean(value, amlvsink->downscale);
+        break;
+
+    case PROP_DUMP_FRAMES:
+        GST_OBJECT_LOCK(amlvsink);
+        g_value_set_uint(value, amlvsink->dump_frames);
+        GST_OBJECT_UNLOCK(amlvsink);
+        break;
+
+    case PROP_DUMP_LOCATION:
+        GST_OBJECT_LOCK(amlvsink);
+        g_value_set_string(value, amlvsink->dump_location);
+        GST_OBJECT_UNLOCK(amlvsink);
+        break;
+
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -379,7 +972,7 @@ static void
 gst_aml_vsink_finalize (GObject * object)
 {
     GstAmlVsink *amlvsink = GST_AMLVSINK(object);
-    G_OBJECT_CLASS(parent_class)->finalize(object);
+    gst_aml_vsink_prepare_join(amlvsink);
     if (amlvsink->use_yuvplayer) {
         gst_aml_vsink_yuvplayer_deinit(amlvsink);
     }
@@ -388,6 +981,14 @@ gst_aml_vsink_finalize (GObject * object)
         if (!keeposd)
             gst_aml_vsink_set_osd_blank(0);
     }
+    gst_poll_free(amlvsink->poll);
+    gst_object_unref(amlvsink->clock);
+    amlDumpRingFree(amlvsink->dump_ring);
+    g_free(amlvsink->dump_location);
+    if (amlvsink->overlay)
+        gst_video_overlay_composition_unref(amlvsink->overlay);
+    g_mutex_clear(&amlvsink->out_lock);
+    G_OBJECT_CLASS(parent_class)->finalize(object);
 }
 
 static GstStateChangeReturn
@@ -438,16 +1039,8 @@ gst_aml_vsink_query (GstElement * element, GstQuery * query)
     {
         GstClockTime cur;
         GstFormat format;
-        unsigned long pts = get_sysfs_int("/sys/class/tsync/pts_pcrscr");
-        if (pts && pts != 1) {
-            if (amlvsink->segment.rate < 0.0) {
-                pts = ~pts;
-            }
+        if (amlPositionGet(amlvsink->segment.rate, ptsrate, &cur)) {
             gst_query_parse_position(query, &format, NULL);
-            cur = (GstClockTime) pts * 100000LL / 9LL;
-            if (ptsrate != 1 && ptsrate > 0 && ptsrate <= MAXRATE) {
-                cur = cur *ptsrate;
-            }
             gst_query_set_position(query, format, cur);
             res = TRUE;
         } else {
@@ -491,15 +1084,41 @@ gst_aml_vsink_setcaps (GstBaseSink * bsink, GstCaps * vscapslist)
     GstStructure *structure;
     const GValue *fps;
 
+    GstVideoInfo info;
+    guint32 v4l_format;
+    gint scale;
+
     amlvsink = GST_AMLVSINK(bsink);
+    if (!gst_video_info_from_caps(&info, vscapslist)) {
+        GST_ERROR_OBJECT(amlvsink, "invalid caps %" GST_PTR_FORMAT, vscapslist);
+        return FALSE;
+    }
+    /* a running yuvplayer gets new ION buffers at the next render, which
+     * also gives the carveout back when the resolution drops */
+    v4l_format = gst_aml_vsink_v4l_format(GST_VIDEO_INFO_FORMAT(&info));
+    g_mutex_lock(&amlvsink->out_lock);
+    scale = gst_aml_vsink_downscale(amlvsink, &info, v4l_format);
+    if (amlvsink->use_yuvplayer && (amlvsink->v4l_format != v4l_format
+            || amlvsink->scale != scale
+            || GST_VIDEO_INFO_WIDTH(&amlvsink->info) != GST_VIDEO_INFO_WIDTH(&info)
+            || GST_VIDEO_INFO_HEIGHT(&amlvsink->info) != GST_VIDEO_INFO_HEIGHT(&info))) {
+        GST_INFO_OBJECT(amlvsink, "reconfigure for %" GST_PTR_FORMAT, vscapslist);
+        amlvsink->reconfigure = TRUE;
+        amlvsink->caps_changed = TRUE;
+    }
+    amlvsink->v4l_format = v4l_format;
+    amlvsink->info = info;
+    amlvsink->scale = scale;
+    gst_aml_vsink_frame_size(amlvsink);
     structure = gst_caps_get_structure(vscapslist, 0);
-    gst_structure_get_int(structure, "width", &amlvsink->width);
-    gst_structure_get_int(structure, "height", &amlvsink->height);
     gst_structure_get_fraction(structure, "framerate",
             &amlvsink->framerate_n,
             &amlvsink->framerate_d);
-    amlvsink->align_width = (amlvsink->width + 63) & (~63);
-    amlvsink->yuv_width = (amlvsink->width + 15) & (~15);
+    g_mutex_unlock(&amlvsink->out_lock);
+    /* amlvdec frames go through the hardware and never need the yuvplayer;
+     * everything else arrives in system memory to be copied */
+    if (!gst_structure_has_field(structure, "aml-hw-decoded"))
+        gst_aml_vsink_prepare(amlvsink);
     return TRUE;
 }
 /*
@@ -529,6 +1148,43 @@ done:
     return caps;
 }
 */
+/* software decoders get the ION buffers themselves; the yuvplayer is
+ * only started once they acquire one, amlvdec never does */
+static gboolean
+gst_aml_vsink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
+{
+    GstAmlVsink *amlvsink = GST_AMLVSINK(bsink);
+    GstBufferPool *pool = NULL;
+    GstStructure *config;
+    GstCaps *caps;
+    gboolean need_pool;
+    GstVideoInfo info;
+
+    gst_query_parse_allocation(query, &caps, &need_pool);
+    if (!caps || !gst_video_info_from_caps(&info, caps)) {
+        GST_DEBUG_OBJECT(amlvsink, "no or invalid caps");
+        return FALSE;
+    }
+
+    if (need_pool) {
+        pool = gst_aml_vsink_pool_new(amlvsink);
+        config = gst_buffer_pool_get_config(pool);
+        gst_buffer_pool_config_set_params(config, caps, info.size, 0, AML_OUT_BUFFER_MAX);
+        if (!gst_buffer_pool_set_config(pool, config)) {
+            GST_ERROR_OBJECT(amlvsink, "failed to set pool config");
+            gst_object_unref(pool);
+            return FALSE;
+        }
+    }
+    gst_query_add_allocation_pool(query, pool, info.size, 0, AML_OUT_BUFFER_MAX);
+    if (pool)
+        gst_object_unref(pool);
+    gst_query_add_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL);
+    /* blended by render, no compositor pass needed upstream */
+    gst_query_add_allocation_meta(query, GST_VIDEO_OVERLAY_COMPOSITION_META_API_TYPE, NULL);
+    return TRUE;
+}
+
 static gboolean
 gst_aml_vsink_start (GstBaseSink * bsink)
 {
@@ -540,112 +1196,431 @@ static gboolean
 gst_aml_vsink_stop (GstBaseSink * bsink)
 {
     GstAmlVsink *amlvsink = GST_AMLVSINK(bsink);
+    gst_aml_vsink_prepare_join(amlvsink);
+    return TRUE;
+}
+
+static GstClock *
+gst_aml_vsink_provide_clock (GstElement * element)
+{
+    GstAmlVsink *amlvsink = GST_AMLVSINK(element);
+    return gst_object_ref(amlvsink->clock);
+}
+
+/* wakes render out of the dequeue wait for flushes and state changes */
+static gboolean
+gst_aml_vsink_unlock (GstBaseSink * bsink)
+{
+    GstAmlVsink *amlvsink = GST_AMLVSINK(bsink);
+    gst_poll_set_flushing(amlvsink->poll, TRUE);
     return TRUE;
 }
 
+static gboolean
+gst_aml_vsink_unlock_stop (GstBaseSink * bsink)
+{
+    GstAmlVsink *amlvsink = GST_AMLVSINK(bsink);
+    gst_poll_set_flushing(amlvsink->poll, FALSE);
+    return TRUE;
+}
+
+/* deviation of the render interval from the frame duration, smoothed;
+ * the auto buffer count covers it. Called with out_lock. */
+static void
+gst_aml_vsink_measure_jitter (GstAmlVsink * amlvsink)
+{
+    gint64 now = g_get_monotonic_time();
+    GstClockTime frame, interval;
+
+    if (amlvsink->last_render && GST_VIDEO_INFO_FPS_N(&amlvsink->info) > 0) {
+        frame = gst_util_uint64_scale(GST_SECOND, GST_VIDEO_INFO_FPS_D(&amlvsink->info),
+                GST_VIDEO_INFO_FPS_N(&amlvsink->info));
+        interval = (now - amlvsink->last_render) * GST_USECOND;
+        /* pauses and seeks are not jitter */
+        if (interval < GST_SECOND)
+            amlvsink->render_jitter = (7 * amlvsink->render_jitter
+                    + (interval > frame ? interval - frame : frame - interval)) / 8;
+    }
+    amlvsink->last_render = now;
+}
+
+/* running time of buffer, the clock time it is due on the display and
+ * the g_get_monotonic_time() to give up waiting for an ION buffer: one
+ * frame past due, at most AML_DEQUEUE_MAX_WAIT away. Outside PLAYING or
+ * without a timestamp due is NONE and the wait AML_DEQUEUE_TIMEOUT. */
+static gint64
+gst_aml_vsink_deadline (GstAmlVsink * amlvsink, GstBuffer * buffer,
+        GstClockTime * running, GstClockTime * due)
+{
+    GstBaseSink *bsink = GST_BASE_SINK(amlvsink);
+    GstElement *element = GST_ELEMENT(amlvsink);
+    gint64 now = g_get_monotonic_time();
+    GstClockTime frame = 20 * GST_MSECOND;
+    GstClockTimeDiff slack;
+    GstClock *clock;
+
+    *running = *due = GST_CLOCK_TIME_NONE;
+    if (amlvsink->segment.format == GST_FORMAT_TIME)
+        *running = gst_segment_to_running_time(&amlvsink->segment,
+                GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    if (!GST_CLOCK_TIME_IS_VALID(*running) || GST_STATE(element) != GST_STATE_PLAYING)
+        return now + AML_DEQUEUE_TIMEOUT;
+    clock = gst_element_get_clock(element);
+    if (!clock)
+        return now + AML_DEQUEUE_TIMEOUT;
+
+    if (GST_BUFFER_DURATION_IS_VALID(buffer))
+        frame = GST_BUFFER_DURATION(buffer);
+    else if (GST_VIDEO_INFO_FPS_N(&amlvsink->info) > 0)
+        frame = gst_util_uint64_scale(GST_SECOND, GST_VIDEO_INFO_FPS_D(&amlvsink->info),
+                GST_VIDEO_INFO_FPS_N(&amlvsink->info));
+    *due = gst_element_get_base_time(element) + *running
+            + gst_base_sink_get_latency(bsink) + gst_base_sink_get_render_delay(bsink);
+    slack = GST_CLOCK_DIFF(gst_clock_get_time(clock), *due) + frame;
+    gst_object_unref(clock);
+    return now + CLAMP(slack / GST_USECOND, 0, AML_DEQUEUE_MAX_WAIT);
+}
+
+/* how far past due the clock is now */
+static GstClockTimeDiff
+gst_aml_vsink_jitter (GstAmlVsink * amlvsink, GstClockTime due)
+{
+    GstClock *clock = gst_element_get_clock(GST_ELEMENT(amlvsink));
+    GstClockTimeDiff jitter = 0;
+
+    if (clock && GST_CLOCK_TIME_IS_VALID(due))
+        jitter = GST_CLOCK_DIFF(due, gst_clock_get_time(clock));
+    if (clock)
+        gst_object_unref(clock);
+    return jitter;
+}
+
+/* late frames tell upstream to skip work, dropped ones are posted too */
+static void
+gst_aml_vsink_qos (GstAmlVsink * amlvsink, GstBuffer * buffer, GstClockTime running,
+        GstClockTimeDiff jitter, guint64 rendered, guint64 dropped, gboolean drop)
+{
+    GstBaseSink *bsink = GST_BASE_SINK(amlvsink);
+    GstMessage *message;
+    GstClockTime stream_time = GST_CLOCK_TIME_NONE;
+
+    if (!gst_base_sink_is_qos_enabled(bsink))
+        return;
+    if (GST_CLOCK_TIME_IS_VALID(running)) {
+        gst_pad_push_event(GST_BASE_SINK_PAD(bsink),
+                gst_event_new_qos(GST_QOS_TYPE_UNDERFLOW, 1.0, jitter, running));
+        stream_time = gst_segment_to_stream_time(&amlvsink->segment,
+                GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    }
+    if (!drop)
+        return;
+    message = gst_message_new_qos(GST_OBJECT(amlvsink), FALSE, running, stream_time,
+            GST_BUFFER_PTS(buffer), GST_BUFFER_DURATION(buffer));
+    gst_message_set_qos_values(message, jitter, 1.0, 1000000);
+    gst_message_set_qos_stats(message, GST_FORMAT_BUFFERS, rendered, dropped);
+    gst_element_post_message(GST_ELEMENT(amlvsink), message);
+}
+
+/* keeps a copy of an ION buffer about to be queued for dump-location;
+ * the copy is all render pays, the file is written on request only */
+static void
+gst_aml_vsink_dump_frame (GstAmlVsink * amlvsink, const guint8 * data, GstBuffer * buffer)
+{
+    gsize size = amlvsink->align_width * amlvsink->height * 3 / 2;
+    AmlEsRecord record;
+
+    GST_OBJECT_LOCK(amlvsink);
+    if (amlvsink->dump_frames == 0) {
+        GST_OBJECT_UNLOCK(amlvsink);
+        return;
+    }
+    /* frames of another size would not line up in a raw dump */
+    if (!amlvsink->dump_ring || amlvsink->dump_frame_size != size) {
+        amlDumpRingFree(amlvsink->dump_ring);
+        amlvsink->dump_ring = amlDumpRingNew(amlvsink->dump_frames
+                * (sizeof(record) + AML_ES_ALIGN(size)));
+        amlvsink->dump_frame_size = size;
+    }
+    memset(&record, 0, sizeof(record));
+    record.type = GUINT32_TO_LE(AML_ES_RECORD_DATA);
+    record.size = GUINT32_TO_LE((guint32) size);
+    record.time = GUINT64_TO_LE(g_get_monotonic_time() * GST_USECOND);
+    record.timestamp = GUINT64_TO_LE(GST_BUFFER_PTS(buffer));
+    amlDumpRingPush(amlvsink->dump_ring, &record, data);
+    GST_OBJECT_UNLOCK(amlvsink);
+}
+
+/* the composition in ION buffer coordinates when downscaled; the copy
+ * is kept while upstream attaches the same one, so its rectangles keep
+ * their scaled pixels cached */
+static GstVideoOverlayComposition *
+gst_aml_vsink_scaled_overlay (GstAmlVsink * amlvsink, GstVideoOverlayComposition * comp)
+{
+    guint seqnum = gst_video_overlay_composition_get_seqnum(comp);
+    gint scale = amlvsink->scale;
+    guint i, n;
+
+    if (scale == 0)
+        return comp;
+    if (amlvsink->overlay && amlvsink->overlay_seqnum == seqnum
+            && amlvsink->overlay_scale == scale)
+        return amlvsink->overlay;
+
+    if (amlvsink->overlay)
+        gst_video_overlay_composition_unref(amlvsink->overlay);
+    amlvsink->overlay = gst_video_overlay_composition_copy(comp);
+    amlvsink->overlay_seqnum = seqnum;
+    amlvsink->overlay_scale = scale;
+    n = gst_video_overlay_composition_n_rectangles(amlvsink->overlay);
+    for (i = 0; i < n; i++) {
+        GstVideoOverlayRectangle *rect =
+                gst_video_overlay_composition_get_rectangle(amlvsink->overlay, i);
+        gint x, y;
+        guint width, height;
+
+        if (gst_video_overlay_rectangle_get_render_rectangle(rect, &x, &y, &width, &height))
+            gst_video_overlay_rectangle_set_render_rectangle(rect, x >> scale, y >> scale,
+                    MAX(width >> scale, 1), MAX(height >> scale, 1));
+    }
+    return amlvsink->overlay;
+}
+
+/* GstVideoOverlayCompositionMeta rectangles straight into the ION
+ * buffer after the frame is in; only the rectangles are read back and
+ * written, which keeps the uncached reads of copy-mode write-combine
+ * down to the subtitle area */
+static void
+gst_aml_vsink_blend_overlays (GstAmlVsink * amlvsink, GstBuffer * buffer, guint8 * base)
+{
+    GstVideoOverlayCompositionMeta *meta;
+    GstVideoOverlayComposition *comp;
+    AmlBlendFrame frame;
+    guint i, n;
+
+    meta = gst_buffer_get_video_overlay_composition_meta(buffer);
+    if (!meta || !meta->overlay)
+        return;
+    comp = gst_aml_vsink_scaled_overlay(amlvsink, meta->overlay);
+
+    frame.layout = amlvsink->v4l_format == V4L2_PIX_FMT_NV12 ? AML_BLEND_NV12
+            : amlvsink->v4l_format == V4L2_PIX_FMT_NV21 ? AML_BLEND_NV21 : AML_BLEND_I420;
+    frame.dst[0] = base;
+    frame.dst_stride[0] = amlvsink->align_width;
+    frame.dst[1] = base + amlvsink->align_width * amlvsink->height;
+    if (frame.layout == AML_BLEND_I420) {
+        frame.dst[2] = base + amlvsink->align_width * amlvsink->height * 5 / 4;
+        frame.dst_stride[1] = frame.dst_stride[2] = amlvsink->align_width / 2;
+    } else {
+        frame.dst[2] = NULL;
+        frame.dst_stride[1] = amlvsink->align_width;
+        frame.dst_stride[2] = 0;
+    }
+    frame.width = amlvsink->width;
+    frame.height = amlvsink->height;
+
+    n = gst_video_overlay_composition_n_rectangles(comp);
+    for (i = 0; i < n; i++) {
+        GstVideoOverlayRectangle *rect =
+                gst_video_overlay_composition_get_rectangle(comp, i);
+        AmlOverlay overlay;
+        GstVideoMeta *vmeta;
+        GstBuffer *pixels;
+        GstMapInfo map;
+        guint width, height;
+
+        if (!gst_video_overlay_rectangle_get_render_rectangle(rect, &overlay.x, &overlay.y,
+                &width, &height))
+            continue;
+        /* scaled to the render size with global alpha applied; the
+         * rectangle caches it, so a subtitle held for several frames is
+         * converted once */
+        pixels = gst_video_overlay_rectangle_get_pixels_ayuv(rect,
+                GST_VIDEO_OVERLAY_FORMAT_FLAG_NONE);
+        if (!pixels || !gst_buffer_map(pixels, &map, GST_MAP_READ))
+            continue;
+        vmeta = gst_buffer_get_video_meta(pixels);
+        overlay.src = map.data + (vmeta ? vmeta->offset[0] : 0);
+        overlay.src_stride = vmeta ? vmeta->stride[0] : (gint) width * 4;
+        overlay.width = width;
+        overlay.height = height;
+        amlBlendOverlay(&frame, &overlay);
+        gst_buffer_unmap(pixels, &map);
+    }
+}
+
 static GstFlowReturn
 gst_aml_vsink_render (GstBaseSink * vsink, GstBuffer * buffer)
 {
 
     GstAmlVsink *amlvsink;
-    vframebuf_t vf;
-    GstMapInfo map;
-    int ret, retry = 0;
+    GstVideoFrame frame;
+    AmlPlane planes[3];
+    GstClockTime running, due;
+    GstClockTimeDiff jitter;
+    GstFlowReturn ret;
+    guint64 rendered, dropped;
+    gboolean late = FALSE;
+    gint64 deadline;
+    int index;
     void *cpu_ptr = NULL;
     amlvsink = GST_AMLVSINK(vsink);
     GST_DEBUG_OBJECT(amlvsink, "%llu", GST_BUFFER_TIMESTAMP (buffer));
 
+    g_mutex_lock(&amlvsink->out_lock);
     if (GST_BUFFER_FLAG_IS_SET(buffer, (1 << 16))) {
         if (!keeposd)
             gst_aml_vsink_set_osd_blank(1);
         ; //g_print("AMDEC FLAG SET\n");
-    } else if (amlvsink->use_yuvplayer == 0) {
-        gst_aml_vsink_yuvplayer_init(amlvsink);
-        g_print("yuvplayer\n");
+    } else {
+        gst_aml_vsink_yuvplayer_start(amlvsink);
+    }
+    if (!amlvsink->use_yuvplayer) {
+        g_mutex_unlock(&amlvsink->out_lock);
+        return GST_FLOW_OK;
+    }
+    gst_aml_vsink_measure_jitter(amlvsink);
+    if (amlvsink->reconfigure && !gst_aml_vsink_yuvplayer_reopen(amlvsink)
+            && (amlvsink->caps_changed || !amlvsink->use_yuvplayer)) {
+        /* old buffers still with the pool, wait for it to let go */
+        g_mutex_unlock(&amlvsink->out_lock);
+        GST_DEBUG_OBJECT(amlvsink, "yuvplayer not reconfigured yet, skip frame");
+        return GST_FLOW_OK;
     }
-    if (amlvsink->use_yuvplayer) {
-        gst_buffer_map(buffer, &map, GST_MAP_READ);
-        while ((ret = amlv4l_dequeuebuf(amlvsink->amvideo_dev, &vf)) < 0
-                && retry < 5) {
-            //wait amlv4l ready
-            usleep(10000);
-            retry++;
-        }
-        if (ret >= 0) {
-            int j, i = 0;
-            while (i < OUT_BUFFER_COUNT) {
-                if (vf.fd == amlvsink->mOutBuffer[i].fd) {
-                    cpu_ptr = amlvsink->mOutBuffer[i].fd_ptr;
-                    break;
-                }
-                i++;
-            }
-            //		output_frame_count++;
-
-            vf.index = amlvsink->mOutBuffer[i].index;
-            vf.fd = amlvsink->mOutBuffer[i].fd;
-            vf.length = amlvsink->align_width * amlvsink->height * 3 / 2;
-            if (GST_BUFFER_PTS_IS_VALID(buffer))
-                vf.pts = GST_BUFFER_PTS(buffer) * 9LL / 100000LL + 1L;
-            else if (GST_BUFFER_DTS_IS_VALID(buffer))
-                vf.pts = GST_BUFFER_DTS(buffer) * 9LL / 100000LL + 1L;
-            vf.width = amlvsink->align_width;
-            vf.height = amlvsink->height;
-            GST_INFO_OBJECT(amlvsink, " yuv pts = %x", (unsigned long) vf.pts);
-            for (j = 0; j < amlvsink->height; j++) {
-                memcpy(cpu_ptr + amlvsink->align_width * j,
-                        map.data + j * amlvsink->width, amlvsink->width);
-                memset(cpu_ptr + amlvsink->align_width * j + amlvsink->width, 0,
-                        amlvsink->align_width - amlvsink->width);
-            }
 
-            for (j = 0; j < amlvsink->height / 2; j++) {
-                memcpy(
-                        cpu_ptr + amlvsink->align_width * amlvsink->height
-                                + amlvsink->align_width * j / 2,
-                        map.data + amlvsink->width * amlvsink->height
-                                + j * amlvsink->yuv_width / 2,
-                        amlvsink->yuv_width / 2);
-                memset(
-                        cpu_ptr + amlvsink->align_width * amlvsink->height
-                                + amlvsink->align_width * j / 2
-                                + amlvsink->width / 2, 0x80,
-                        (amlvsink->align_width - amlvsink->width) / 2);
-            }
+    /* decoded straight into one of our ION buffers */
+    index = gst_aml_vsink_pool_buffer_index(buffer);
+    if (index >= 0 && amlvsink->mOutBuffer[index].in_use
+            && amlvsink->mOutBuffer[index].own_by_v4l == AML_OUT_BUFFER_FREE) {
+        gst_aml_vsink_blend_overlays(amlvsink, buffer, amlvsink->mOutBuffer[index].fd_ptr);
+        gst_aml_vsink_dump_frame(amlvsink, amlvsink->mOutBuffer[index].fd_ptr, buffer);
+        gst_aml_vsink_queue_out_buffer(amlvsink, index, buffer);
+        amlvsink->rendered++;
+        g_mutex_unlock(&amlvsink->out_lock);
+        return GST_FLOW_OK;
+    }
 
-            for (j = 0; j < amlvsink->height / 2; j++) {
-                memcpy(
-                        cpu_ptr + amlvsink->align_width * amlvsink->height
-                                + amlvsink->align_width * amlvsink->height / 4
-                                + amlvsink->align_width * j / 2,
-                        map.data + amlvsink->width * amlvsink->height
-                                + amlvsink->yuv_width * amlvsink->height / 4
-                                + j * amlvsink->yuv_width / 2,
-                        amlvsink->width / 2);
-                memset(
-                        cpu_ptr + amlvsink->align_width * amlvsink->height
-                                + amlvsink->align_width * amlvsink->height / 4
-                                + amlvsink->align_width * j / 2
-                                + amlvsink->width / 2, 0x80,
-                        (amlvsink->align_width - amlvsink->width) / 2);
+    /* honours GstVideoMeta strides and offsets */
+    if (!gst_video_frame_map(&frame, &amlvsink->info, buffer, GST_MAP_READ)) {
+        g_mutex_unlock(&amlvsink->out_lock);
+        GST_ERROR_OBJECT(amlvsink, "could not map video frame, skip");
+        return GST_FLOW_OK;
+    }
+    deadline = gst_aml_vsink_deadline(amlvsink, buffer, &running, &due);
+    while ((index = gst_aml_vsink_get_out_buffer(amlvsink, deadline))
+            == AML_OUT_BUFFER_UNLOCKED) {
+        g_mutex_unlock(&amlvsink->out_lock);
+        ret = gst_base_sink_wait_preroll(vsink);
+        if (ret != GST_FLOW_OK) {
+            gst_video_frame_unmap(&frame);
+            return ret;
+        }
+        deadline = gst_aml_vsink_deadline(amlvsink, buffer, &running, &due);
+        g_mutex_lock(&amlvsink->out_lock);
+    }
+    if (index >= 0) {
+        GstVideoFormat format = GST_VIDEO_FRAME_FORMAT(&frame);
+        guint8 *y_ptr, *u_ptr, *v_ptr;
+        guint copy_flags = amlvsink->write_combine ? AML_COPY_STREAM : 0;
+        int p;
+
+        /* keep the pool off it while copying without the lock */
+        amlvsink->mOutBuffer[index].in_use = 1;
+        gst_aml_vsink_cpu_access(amlvsink, index, TRUE);
+        g_mutex_unlock(&amlvsink->out_lock);
+        cpu_ptr = amlvsink->mOutBuffer[index].fd_ptr;
+        //		output_frame_count++;
+
+        /* ION layout: Y at align_width stride, then U and V at
+         * align_width / 2, height / 2 rows each, or NV12/NV21 with the
+         * chroma pairs at align_width */
+        y_ptr = (guint8 *) cpu_ptr;
+        u_ptr = y_ptr + amlvsink->align_width * amlvsink->height;
+        v_ptr = y_ptr + amlvsink->align_width * amlvsink->height * 5 / 4;
+        if (format == GST_VIDEO_FORMAT_I420
+                || amlvsink->v4l_format != V4L2_PIX_FMT_YUV420) {
+            gint n_planes = GST_VIDEO_FRAME_N_PLANES(&frame);
+
+            for (p = 0; p < n_planes; p++) {
+                planes[p].dst = p == 0 ? y_ptr : p == 1 ? u_ptr : v_ptr;
+                planes[p].src = GST_VIDEO_FRAME_PLANE_DATA(&frame, p);
+                planes[p].src_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, p);
+                planes[p].width = GST_VIDEO_FRAME_COMP_WIDTH(&frame, p)
+                        * GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, p);
+                planes[p].dst_stride = p == 0 || n_planes == 2
+                        ? amlvsink->align_width : amlvsink->align_width / 2;
+                planes[p].height = p == 0 ? amlvsink->height : amlvsink->height / 2;
+                planes[p].pad = p == 0 ? 0 : 0x80;
+                planes[p].flags = copy_flags;
+                planes[p].scale = amlvsink->scale;
+                planes[p].step = p == 1 && n_planes == 2 ? 2 : 1;
+                /* the ION size, width is even when scaled */
+                if (amlvsink->scale > 0)
+                    planes[p].width = p == 0 || n_planes == 2
+                            ? amlvsink->width : amlvsink->width / 2;
             }
-
-#if DEBUG_DUMP
-            if (amlvsink->dump_fd > 0) {
-                write(amlvsink->dump_fd, cpu_ptr, amlvsink->align_width * amlvsink->height * 3 / 2);
+            amlCopyPlanes(amlvsink->copy_pool, planes, n_planes);
+        } else {
+            AmlConvertFrame convert;
+
+            convert.convert = format == GST_VIDEO_FORMAT_NV12 ? AML_CONVERT_NV12
+                    : format == GST_VIDEO_FORMAT_NV21 ? AML_CONVERT_NV21
+                    : format == GST_VIDEO_FORMAT_YUY2 ? AML_CONVERT_YUY2
+                    : format == GST_VIDEO_FORMAT_BGRx ? AML_CONVERT_BGRX
+                    : AML_CONVERT_RGBX;
+            for (p = 0; p < 2; p++) {
+                gboolean plane = p < GST_VIDEO_FRAME_N_PLANES(&frame);
+
+                convert.src[p] = plane ? GST_VIDEO_FRAME_PLANE_DATA(&frame, p) : NULL;
+                convert.src_stride[p] = plane ? GST_VIDEO_FRAME_PLANE_STRIDE(&frame, p) : 0;
             }
-#endif
+            convert.dst[0] = y_ptr;
+            convert.dst[1] = u_ptr;
+            convert.dst[2] = v_ptr;
+            convert.dst_stride[0] = amlvsink->align_width;
+            convert.dst_stride[1] = convert.dst_stride[2] = amlvsink->align_width / 2;
+            /* the ION buffers hold height / 2 chroma rows */
+            convert.width = amlvsink->width;
+            convert.height = amlvsink->height & ~1;
+            convert.flags = copy_flags;
+            amlConvertFrame(amlvsink->copy_pool, &convert);
+        }
 
-            ret = amlv4l_queuebuf(amlvsink->amvideo_dev, &vf);
-            if (ret < 0) {
-                GST_ERROR("amlv4l_queuebuf failed =%d\n", ret);
-            }
-        } else {
-            GST_ERROR("skip frame");
+        gst_aml_vsink_blend_overlays(amlvsink, buffer, cpu_ptr);
+        gst_aml_vsink_dump_frame(amlvsink, cpu_ptr, buffer);
+
+        jitter = gst_aml_vsink_jitter(amlvsink, due);
+        g_mutex_lock(&amlvsink->out_lock);
+        gst_aml_vsink_queue_out_buffer(amlvsink, index, buffer);
+        amlvsink->mOutBuffer[index].in_use = 0;
+        amlvsink->rendered++;
+        if (GST_CLOCK_TIME_IS_VALID(due) && jitter > 0) {
+            amlvsink->late++;
+            late = TRUE;
+        }
+        amlvsink->timeouts = 0;
+    } else {
+        jitter = gst_aml_vsink_jitter(amlvsink, due);
+        amlvsink->dropped++;
+        /* the display keeps more frames than the ring allows for */
+        if (index == AML_OUT_BUFFER_TIMEOUT && amlvsink->buffer_count_prop == 0
+                && ++amlvsink->timeouts >= AML_GROW_TIMEOUTS
+                && amlvsink->buffer_count < AML_OUT_BUFFER_MAX && !amlvsink->ion_short) {
+            amlvsink->extra_buffers++;
+            amlvsink->reconfigure = TRUE;
+            amlvsink->timeouts = 0;
+            GST_INFO_OBJECT(amlvsink, "dequeue timeouts, grow to %d buffers",
+                    amlvsink->buffer_count + 1);
         }
-        gst_buffer_unmap(buffer, &map);
+        GST_DEBUG_OBJECT(amlvsink, "no display buffer, drop frame %" GST_TIME_FORMAT
+                " jitter %" G_GINT64_FORMAT, GST_TIME_ARGS(GST_BUFFER_PTS(buffer)), jitter);
     }
+    rendered = amlvsink->rendered;
+    dropped = amlvsink->dropped;
+    g_mutex_unlock(&amlvsink->out_lock);
+    gst_video_frame_unmap(&frame);
 
+    if (late || index < 0)
+        gst_aml_vsink_qos(amlvsink, buffer, running, jitter, rendered, dropped, index < 0);
     return GST_FLOW_OK;
 }
 
@@ -9,11 +9,17 @@
 #include <gst/video/video.h>
 #include <yuvplayer/ion.h>
 #include <yuvplayer/amvideo.h>
+#include "amlvsink_copy.h"
+#include "amldumpring.h"
 
 
 G_BEGIN_DECLS
 
-#define OUT_BUFFER_COUNT   4
+/* ION buffers shared with the display, see the buffer-count property */
+#define AML_OUT_BUFFER_MIN 3
+#define AML_OUT_BUFFER_MAX 8
+/* dequeue timeouts in a row before the auto count grows by one */
+#define AML_GROW_TIMEOUTS  3
 #define AMLDEC_FLAG (1<<16)
 
 #define GST_TYPE_AMLVSINK \
@@ -37,11 +43,38 @@ G_BEGIN_DECLS
 typedef struct _GstAmlVsink GstAmlVsink;
 typedef struct _GstAmlVsinkClass GstAmlVsinkClass;
 
+/* out_buffer_t.own_by_v4l */
+#define AML_OUT_BUFFER_FREE 0
+#define AML_OUT_BUFFER_V4L  1
+
+/* gst_aml_vsink_get_out_buffer() failures */
+#define AML_OUT_BUFFER_TIMEOUT  (-1)
+#define AML_OUT_BUFFER_UNLOCKED (-2)
+
+/* dequeue wait in us for buffers without a running time */
+#define AML_DEQUEUE_TIMEOUT     50000
+/* never wait longer than this for the display, whatever the timestamps */
+#define AML_DEQUEUE_MAX_WAIT    1000000
+
+/* copy-mode: how the CPU writes the ION buffers */
+typedef enum {
+    GST_AML_VSINK_COPY_CACHED,          /* cached mapping, dma-buf sync around CPU access */
+    GST_AML_VSINK_COPY_WRITE_COMBINE,   /* uncached mapping, non-temporal stores */
+} GstAmlVsinkCopyMode;
+
+/* downscale: at most 4:1, as two 2:1 steps */
+#define AML_DOWNSCALE_MAX       2
+
+/* upper bound of the dump-frames property, ~3MB each at 1080p */
+#define AML_DUMP_FRAMES_MAX     256
+
 typedef struct {
     int index;
     int fd;
     void * pBuffer;
     int own_by_v4l;
+    int in_use;     /* handed out by the pool or being filled by render */
+    int cpu_access; /* DMA_BUF_SYNC_START issued, END pending */
     void *fd_ptr; //only for non-nativebuffer!
     struct ion_handle *ion_hnd; //only for non-nativebuffer!
 }out_buffer_t;
@@ -50,16 +83,45 @@ struct _GstAmlVsink {
   GstBaseSink basesink;
   struct amvideo_dev *amvideo_dev;
   out_buffer_t * mOutBuffer;
-  int align_width, yuv_width, width, height;
+  int align_width, yuv_width, width, height;    /* of the ION buffers */
   int framerate_n, framerate_d;
   int mIonFd;
+  int buffer_count;         /* of mOutBuffer */
+  int buffer_size;
+  guint buffer_count_prop;  /* 0: auto */
+  int extra_buffers;        /* added by auto after dequeue timeouts */
+  gboolean ion_short;       /* an ION allocation failed, auto stops growing */
+  int timeouts;             /* dequeue timeouts in a row */
+  gboolean reconfigure;     /* reopen the yuvplayer at the next render */
+  gboolean caps_changed;    /* ION buffers no longer fit the caps */
+  guint generation;         /* bumped by every yuvplayer open */
+  gint64 last_render;
+  GstClockTime render_jitter;
   int use_yuvplayer;
+  GstVideoInfo info;
+  gboolean downscale;       /* box filter large frames towards the window size */
+  gint scale;               /* ION buffers are 1 << scale smaller than info */
+  GstVideoOverlayComposition *overlay;  /* last composition, scaled copy */
+  guint overlay_seqnum;
+  gint overlay_scale;
+  guint32 v4l_format;       /* pixel format the ION buffers are queued as */
+  AmlCopyPool *copy_pool;
+  GstAmlVsinkCopyMode copy_mode;
+  gboolean write_combine;   /* mOutBuffer allocated for copy-mode write-combine */
+  gboolean cache_sync;      /* mOutBuffer cached and the kernel has DMA_BUF_IOCTL_SYNC */
+  GstClockTime sync_time;   /* spent in DMA_BUF_IOCTL_SYNC, under out_lock */
+  GMutex out_lock;          /* mOutBuffer states, render vs. pool acquire */
+  GThread *prepare_thread;  /* yuvplayer set up from setcaps, before the first frame */
+  GstClock *clock;          /* tsync PCR, offered to the pipeline */
+  GstPoll *poll;            /* amlv4l fd, set flushing by unlock */
+  GstPollFD poll_fd;
+  guint64 rendered, dropped, late;  /* frames, under out_lock */
   GstSegment segment;
   int coordinate[4];
-#if DEBUG_DUMP
-  int dump_fd;
-#endif
-
+  guint dump_frames;        /* frames kept for dump-location, 0: off */
+  AmlDumpRing *dump_ring;   /* last dump_frames ION buffers, under the object lock */
+  gsize dump_frame_size;
+  gchar *dump_location;
 };
 
 struct _GstAmlVsinkClass {
@@ -68,6 +130,12 @@ struct _GstAmlVsinkClass {
 
 GType gst_aml_vsink_get_type(void);
 
+guint32 gst_aml_vsink_v4l_format(GstVideoFormat format);
+gboolean gst_aml_vsink_yuvplayer_start(GstAmlVsink *amlvsink);
+gint gst_aml_vsink_get_out_buffer(GstAmlVsink *amlvsink, gint64 deadline);
+void gst_aml_vsink_queue_out_buffer(GstAmlVsink *amlvsink, gint index, GstBuffer *buffer);
+void gst_aml_vsink_cpu_access(GstAmlVsink *amlvsink, gint index, gboolean begin);
+
 G_END_DECLS
 
 #endif /* __GST_GSTAMLVSINK_H__ */